@@ -29,9 +29,22 @@
 #define _BOX2DUTIL_H_INCLUDED
 
 #include "Box2D.h"
+
+// the CGPoint and CGSize conversions need cocos2d and CoreGraphics, so they're only built on Apple
+// platforms.  define BOX2DUTIL_USE_COCOS2D to 0 or 1 to choose for yourself.
+#ifndef BOX2DUTIL_USE_COCOS2D
+#if defined(__APPLE__)
+#define BOX2DUTIL_USE_COCOS2D 1
+#else
+#define BOX2DUTIL_USE_COCOS2D 0
+#endif
+#endif
+
+#if BOX2DUTIL_USE_COCOS2D
 #include "ccMacros.h"
 
 #include <CoreGraphics/CGGeometry.h>
+#endif
 
 // Pixel to meters ratio. Box2D uses metres as the unit for measurement.
 // This ratio defines how many pixels correspond to one Box2D meter
@@ -93,6 +106,7 @@ inline float32 fromb2(float32 v)
 	return v * kPhysicsPTMRatio;
 }
 
+#if BOX2DUTIL_USE_COCOS2D
 inline b2Vec2 ccptob2(const CGPoint& point, bool scale = true )
 {
 	if( scale )
@@ -122,6 +136,7 @@ inline CGPoint b2toccp(const b2Vec2& point, bool scale = true)
 	
 	return CGPointMake(point.x, point.y);	
 }
+#endif
 
 inline float32 getAngle(const b2Vec2& v)
 {
@@ -132,27 +147,123 @@ inline float32 getAngle(const b2Vec2& v)
 inline b2AABB bodyAABB(b2Body* body)
 {
 	b2AABB aabb;
+	aabb.lowerBound = aabb.upperBound = body->GetPosition();
 	
 	bool first = true;
 	
 	for( b2Fixture* fixture = body->GetFixtureList(); fixture; fixture = fixture->GetNext() )
 	{
-		b2AABB shapeAABB;
-		fixture->GetShape()->ComputeAABB(&shapeAABB, body->GetTransform(), 0);
+		b2Shape* shape = fixture->GetShape();
 		
-		
-		if( first )
+		for( int32 childIdx = 0; childIdx < shape->GetChildCount(); ++childIdx )
 		{
-			first = false;
-			aabb = shapeAABB;
+			b2AABB shapeAABB;
+			shape->ComputeAABB(&shapeAABB, body->GetTransform(), childIdx);
+			
+			if( first )
+			{
+				first = false;
+				aabb = shapeAABB;
+			}
+			else
+			{
+				aabb.Combine(aabb, shapeAABB);
+			}
 		}
-		else
+	}
+	
+	return aabb;
+}
+
+// same as bodyAABB, but built from the AABBs each fixture already keeps for the broadphase, so
+// nothing has to be computed.  those are not the broadphase's fattened AABBs: each covers the fixture
+// at both ends of the body's last step, so for a moving body this is a little bigger than bodyAABB.
+// good enough for culling.  b2World::Step and SetTransform keep them up to date.
+// an inactive body has none, so it gets an invalid AABB (see b2AABB::IsValid).
+inline b2AABB bodyFatAABB(b2Body* body)
+{
+	b2AABB aabb;
+	
+	if( !body->IsActive() )
+	{
+		aabb.lowerBound.Set(b2_maxFloat, b2_maxFloat);
+		aabb.upperBound.Set(-b2_maxFloat, -b2_maxFloat);
+		return aabb;
+	}
+	
+	aabb.lowerBound = aabb.upperBound = body->GetPosition();
+	
+	bool first = true;
+	
+	for( b2Fixture* fixture = body->GetFixtureList(); fixture; fixture = fixture->GetNext() )
+	{
+		for( int32 childIdx = 0; childIdx < fixture->GetShape()->GetChildCount(); ++childIdx )
 		{
-			aabb.Combine(aabb, shapeAABB);
+			const b2AABB& fixtureAABB = fixture->GetAABB(childIdx);
+			
+			if( first )
+			{
+				first = false;
+				aabb = fixtureAABB;
+			}
+			else
+			{
+				aabb.Combine(aabb, fixtureAABB);
+			}
 		}
 	}
 	
 	return aabb;
 }
 
+// fills aabbs[i] with the bounds of bodies[i], either exact (bodyAABB) or from the fixtures' own (bodyFatAABB)
+inline void bodyAABBs(b2Body* const* bodies, int count, b2AABB* aabbs, bool fat = false)
+{
+	if( fat )
+	{
+		for( int bodyIdx = 0; bodyIdx < count; ++bodyIdx )
+			aabbs[bodyIdx] = bodyFatAABB(bodies[bodyIdx]);
+	}
+	else
+	{
+		for( int bodyIdx = 0; bodyIdx < count; ++bodyIdx )
+			aabbs[bodyIdx] = bodyAABB(bodies[bodyIdx]);
+	}
+}
+
+// exact bounds of a body, cached until the body moves.  keep one of these alongside each body
+// you need bounds for every frame; sleeping and static bodies then cost one compare.
+// call invalidate after adding or removing fixtures, or changing their shapes.
+struct BodyBounds
+{
+	BodyBounds()
+	: angle(0)
+	, valid(false)
+	{
+	}
+	
+	const b2AABB& get(b2Body* body)
+	{
+		if( !valid || !(body->GetPosition() == position) || body->GetAngle() != angle )
+		{
+			aabb = bodyAABB(body);
+			position = body->GetPosition();
+			angle = body->GetAngle();
+			valid = true;
+		}
+		
+		return aabb;
+	}
+	
+	void invalidate()
+	{
+		valid = false;
+	}
+	
+	b2AABB aabb;
+	b2Vec2 position;
+	float32 angle;
+	bool valid;
+};
+
 #endif
@@ -0,0 +1,201 @@
+//
+//	CategoryIndex.cpp
+//
+//	Created by Aaron Pendley on 4/9/10.
+//	Copyright 2010 Aaron Pendley.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+// 
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+// 
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+
+#include "CategoryIndex.h"
+
+
+CategoryIndex::CategoryIndex()
+: mStamp(0)
+{
+}
+
+CategoryIndex::~CategoryIndex()
+{
+	Clear();
+	
+	for( size_t groupIdx = 0; groupIdx < mGroups.size(); ++groupIdx )
+		delete mGroups[groupIdx];
+}
+
+void CategoryIndex::Clear()
+{
+	for( EntryMap::iterator it = mEntries.begin(); it != mEntries.end(); ++it )
+		DestroyProxies(&it->second);
+	
+	mEntries.clear();
+}
+
+int CategoryIndex::FindGroup( const b2Filter& filter )
+{
+	for( size_t groupIdx = 0; groupIdx < mGroups.size(); ++groupIdx )
+	{
+		const b2Filter& groupFilter = mGroups[groupIdx]->filter;
+		
+		if( groupFilter.maskBits == filter.maskBits && groupFilter.categoryBits == filter.categoryBits )
+			return (int)groupIdx;
+	}
+	
+	Group* group = new Group;
+	group->filter = filter;
+	group->filter.groupIndex = 0;
+	group->proxyCount = 0;
+	
+	mGroups.push_back(group);
+	return (int)mGroups.size() - 1;
+}
+
+void CategoryIndex::AddProxies( b2Fixture* fixture, Entry* entry )
+{
+	const b2Filter& filter = fixture->GetFilterData();
+	b2Body* body = fixture->GetBody();
+	b2Shape* shape = fixture->GetShape();
+	
+	entry->body = body;
+	entry->shape = shape;
+	entry->group = FindGroup(filter);
+	entry->maskBits = filter.maskBits;
+	entry->categoryBits = filter.categoryBits;
+	entry->position = body->GetPosition();
+	entry->angle = body->GetAngle();
+	entry->proxyCount = shape->GetChildCount();
+	entry->proxies = new b2FixtureProxy[entry->proxyCount];
+	
+	Group* group = mGroups[entry->group];
+	
+	for( int32 childIdx = 0; childIdx < entry->proxyCount; ++childIdx )
+	{
+		b2FixtureProxy& proxy = entry->proxies[childIdx];
+		
+		shape->ComputeAABB(&proxy.aabb, body->GetTransform(), childIdx);
+		proxy.fixture = fixture;
+		proxy.childIndex = childIdx;
+		proxy.proxyId = group->tree.CreateProxy(proxy.aabb, &proxy);
+	}
+	
+	group->proxyCount += entry->proxyCount;
+}
+
+void CategoryIndex::DestroyProxies( Entry* entry )
+{
+	Group* group = mGroups[entry->group];
+	
+	// never touches the fixture, it may already be gone
+	for( int32 childIdx = 0; childIdx < entry->proxyCount; ++childIdx )
+		group->tree.DestroyProxy(entry->proxies[childIdx].proxyId);
+	
+	group->proxyCount -= entry->proxyCount;
+	
+	delete [] entry->proxies;
+	entry->proxies = NULL;
+	entry->proxyCount = 0;
+}
+
+void CategoryIndex::MoveProxies( b2Fixture* fixture, Entry* entry )
+{
+	b2Body* body = fixture->GetBody();
+	b2Shape* shape = fixture->GetShape();
+	Group* group = mGroups[entry->group];
+	
+	b2Vec2 displacement = body->GetPosition() - entry->position;
+	
+	for( int32 childIdx = 0; childIdx < entry->proxyCount; ++childIdx )
+	{
+		b2FixtureProxy& proxy = entry->proxies[childIdx];
+		
+		shape->ComputeAABB(&proxy.aabb, body->GetTransform(), childIdx);
+		group->tree.MoveProxy(proxy.proxyId, proxy.aabb, displacement);
+	}
+	
+	entry->position = body->GetPosition();
+	entry->angle = body->GetAngle();
+}
+
+void CategoryIndex::Sync( b2World* world )
+{
+	mStamp++;
+	
+	for( b2Body* body = world->GetBodyList(); body; body = body->GetNext() )
+	{
+		// the world's broadphase doesn't hold inactive bodies either, so their fixtures go unstamped and are dropped below
+		if( !body->IsActive() )
+			continue;
+		
+		for( b2Fixture* fixture = body->GetFixtureList(); fixture; fixture = fixture->GetNext() )
+		{
+			std::pair<EntryMap::iterator, bool> inserted = mEntries.insert(std::make_pair(fixture, Entry()));
+			Entry& entry = inserted.first->second;
+			
+			if( inserted.second )
+			{
+				AddProxies(fixture, &entry);
+			}
+			else
+			{
+				const b2Filter& filter = fixture->GetFilterData();
+				
+				// a different filter means a different group.  a different body, shape or child count means
+				// the fixture was destroyed and a new one took its address without us being told.
+				if( entry.maskBits != filter.maskBits || entry.categoryBits != filter.categoryBits
+				   || entry.body != body || entry.shape != fixture->GetShape() || entry.proxyCount != fixture->GetShape()->GetChildCount() )
+				{
+					DestroyProxies(&entry);
+					AddProxies(fixture, &entry);
+				}
+				else if( !(entry.position == body->GetPosition()) || entry.angle != body->GetAngle() )
+				{
+					MoveProxies(fixture, &entry);
+				}
+			}
+			
+			entry.stamp = mStamp;
+		}
+	}
+	
+	// anything we didn't see has been destroyed
+	for( EntryMap::iterator it = mEntries.begin(); it != mEntries.end(); )
+	{
+		if( it->second.stamp != mStamp )
+		{
+			DestroyProxies(&it->second);
+			it = mEntries.erase(it);
+		}
+		else
+		{
+			++it;
+		}
+	}
+}
+
+void CategoryIndex::RemoveFixture( b2Fixture* fixture )
+{
+	EntryMap::iterator it = mEntries.find(fixture);
+	
+	if( it != mEntries.end() )
+	{
+		DestroyProxies(&it->second);
+		mEntries.erase(it);
+	}
+}
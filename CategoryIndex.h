@@ -0,0 +1,118 @@
+//
+//	CategoryIndex.h
+//
+//	Created by Aaron Pendley on 4/9/10.
+//	Copyright 2010 Aaron Pendley.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+// 
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+// 
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+
+
+#ifndef _CATEGORYINDEX_H_INCLUDED_
+#define _CATEGORYINDEX_H_INCLUDED_
+
+#include "Box2D.h"
+#include "CollisionUtil.h"
+
+#include <unordered_map>
+#include <vector>
+
+
+// a second broadphase for the world's fixtures, split up by filter data.  fixtures with the same
+// mask and category bits go in the same group, and each group has its own dynamic tree, so a
+// query only walks the groups its QueryFilter can pass at all.  a "terrain only" query in a world
+// full of enemies never sees the enemies.
+//
+// QueryFilter only looks at mask and category bits, so the whole group passes or fails together
+// and no fixture inside a passing group needs testing.  games use a handful of distinct filters,
+// so there are few groups.
+//
+// the index isn't updated by Box2D, call Sync after every step and after creating fixtures, and
+// RemoveFixture from your b2DestructionListener.  fixtures on inactive bodies are left out, as the
+// world's broadphase leaves them out.  Sync only notices a body moving, so after editing a fixture's
+// shape in place call RemoveFixture, and the next Sync adds it back.  pass the index in place of
+// the world to the CollisionUtil queries that take one.
+class CategoryIndex
+{
+public:
+	CategoryIndex();
+	~CategoryIndex();
+	
+	// brings the index up to date: adds new fixtures, moves fixtures whose bodies moved, regroups
+	// fixtures whose filter data changed and drops fixtures that are no longer in the world.
+	void Sync( b2World* world );
+	
+	// drops a fixture straight away
+	void RemoveFixture( b2Fixture* fixture );
+	
+	void Clear();
+	
+	int GetFixtureCount() const { return (int)mEntries.size(); }
+	
+	// each group's tree has a b2FixtureProxy* as the user data of every proxy
+	int GetGroupCount() const { return (int)mGroups.size(); }
+	const b2Filter& GetGroupFilter( int group ) const { return mGroups[group]->filter; }
+	const b2DynamicTree& GetGroupTree( int group ) const { return mGroups[group]->tree; }
+	
+	// true if fixtures in the group can pass the filter
+	bool GroupPasses( int group, const QueryFilter& filter ) const
+	{
+		const Group* g = mGroups[group];
+		return g->proxyCount > 0 && filter.test(g->filter.maskBits, g->filter.categoryBits);
+	}
+	
+private:
+	CategoryIndex( const CategoryIndex& );
+	CategoryIndex& operator = ( const CategoryIndex& );
+	
+	struct Group
+	{
+		b2Filter filter;
+		b2DynamicTree tree;
+		int proxyCount;
+	};
+	
+	struct Entry
+	{
+		b2Body* body;
+		const b2Shape* shape;
+		int group;
+		uint16 maskBits;
+		uint16 categoryBits;
+		b2Vec2 position;
+		float32 angle;
+		b2FixtureProxy* proxies;
+		int32 proxyCount;
+		unsigned int stamp;
+	};
+	
+	typedef std::unordered_map<b2Fixture*, Entry> EntryMap;
+	
+	int FindGroup( const b2Filter& filter );
+	void AddProxies( b2Fixture* fixture, Entry* entry );
+	void DestroyProxies( Entry* entry );
+	void MoveProxies( b2Fixture* fixture, Entry* entry );
+	
+	std::vector<Group*> mGroups;
+	EntryMap mEntries;
+	unsigned int mStamp;
+};
+
+#endif
@@ -0,0 +1,232 @@
+//
+//	CollisionStats.cpp
+//
+//	Created by Aaron Pendley on 4/9/10.
+//	Copyright 2010 Aaron Pendley.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+// 
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+// 
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+
+#include "CollisionStats.h"
+
+#include <string.h>
+
+#if COLLISION_UTIL_STATS
+#include <atomic>
+#endif
+
+
+uint64_t CollisionQueryStats::GetLatencyPercentile( float percentile ) const
+{
+	if( count == 0 )
+		return 0;
+	
+	uint64_t target = (uint64_t)(percentile * (float)count);
+	uint64_t seen = 0;
+	
+	for( int bucketIdx = 0; bucketIdx < kCollisionStatsLatencyBuckets; ++bucketIdx )
+	{
+		seen += latency[bucketIdx];
+		
+		if( seen > target )
+			return (uint64_t)1 << (bucketIdx + 1);
+	}
+	
+	return maxNanoseconds;
+}
+
+const char* GetCollisionStatsQueryName( CollisionStatsQuery query )
+{
+	static const char* names[e_statsQueryTypeCount] =
+	{
+		"QueryAABB",
+		"QueryShape",
+		"QueryShapeBatch",
+		"QueryNearest",
+		"QueryKNearest",
+		"CollideRay",
+		"CollideRayClosest",
+		"CollideRayAny",
+		"CollideRayNearest",
+		"CollideRayBatch",
+		"RayProbe",
+		"CollideSweptPair",
+		"CollideSwept",
+		"CollideSweptClosest",
+		"CollideSweptAny",
+		"CollideSweptTOI",
+	};
+	
+	return query >= 0 && query < e_statsQueryTypeCount ? names[query] : "unknown";
+}
+
+const char* GetCollisionStatsCounterName( CollisionStatsCounter counter )
+{
+	static const char* names[e_statsCounterCount] =
+	{
+		"candidates",
+		"fixturesFiltered",
+		"toiCalls",
+		"toiIterations",
+		"distanceCalls",
+		"distanceIterations",
+		"resultBufferFull",
+		"packetOverflows",
+	};
+	
+	return counter >= 0 && counter < e_statsCounterCount ? names[counter] : "unknown";
+}
+
+#if COLLISION_UTIL_STATS
+
+// threads are spread over this many copies of the counters so they don't fight over cache lines
+static const int kShardCount = 16;
+
+struct QueryCounters
+{
+	std::atomic<uint64_t> count;
+	std::atomic<uint64_t> fixturesReported;
+	std::atomic<uint64_t> totalNanoseconds;
+	std::atomic<uint64_t> maxNanoseconds;
+	std::atomic<uint64_t> latency[kCollisionStatsLatencyBuckets];
+};
+
+struct alignas(64) StatsShard
+{
+	QueryCounters queries[e_statsQueryTypeCount];
+	std::atomic<uint64_t> counters[e_statsCounterCount];
+};
+
+// static storage, so everything starts at zero
+static StatsShard sShards[kShardCount];
+static std::atomic<int> sNextShard(0);
+
+static StatsShard& GetThreadShard()
+{
+	static thread_local int shardIdx = sNextShard.fetch_add(1, std::memory_order_relaxed) % kShardCount;
+	return sShards[shardIdx];
+}
+
+static int GetLatencyBucket( uint64_t nanoseconds )
+{
+	int bucket = 0;
+	
+	while( nanoseconds > 1 && bucket < kCollisionStatsLatencyBuckets - 1 )
+	{
+		nanoseconds >>= 1;
+		bucket++;
+	}
+	
+	return bucket;
+}
+
+void CollisionStatsCount( CollisionStatsCounter counter, uint64_t amount )
+{
+	GetThreadShard().counters[counter].fetch_add(amount, std::memory_order_relaxed);
+}
+
+void CollisionStatsQueryDone( CollisionStatsQuery query, uint64_t nanoseconds, int fixturesReported )
+{
+	QueryCounters& counters = GetThreadShard().queries[query];
+	
+	counters.count.fetch_add(1, std::memory_order_relaxed);
+	counters.fixturesReported.fetch_add((uint64_t)fixturesReported, std::memory_order_relaxed);
+	counters.totalNanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+	counters.latency[GetLatencyBucket(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+	
+	uint64_t currentMax = counters.maxNanoseconds.load(std::memory_order_relaxed);
+	
+	while( nanoseconds > currentMax && !counters.maxNanoseconds.compare_exchange_weak(currentMax, nanoseconds, std::memory_order_relaxed) )
+	{
+	}
+}
+
+// reads a counter, zeroing it as well if asked to
+static inline uint64_t ReadCounter( std::atomic<uint64_t>& counter, bool take )
+{
+	return take ? counter.exchange(0, std::memory_order_relaxed) : counter.load(std::memory_order_relaxed);
+}
+
+// sums the shards into the snapshot.  counts recorded while this runs land in this snapshot or
+// the next one, never neither.
+static void ReadStats( CollisionStatsSnapshot* snapshot, bool take )
+{
+	memset(snapshot, 0, sizeof(CollisionStatsSnapshot));
+	
+	for( int shardIdx = 0; shardIdx < kShardCount; ++shardIdx )
+	{
+		StatsShard& shard = sShards[shardIdx];
+		
+		for( int queryIdx = 0; queryIdx < e_statsQueryTypeCount; ++queryIdx )
+		{
+			QueryCounters& counters = shard.queries[queryIdx];
+			CollisionQueryStats& stats = snapshot->queries[queryIdx];
+			
+			stats.count += ReadCounter(counters.count, take);
+			stats.fixturesReported += ReadCounter(counters.fixturesReported, take);
+			stats.totalNanoseconds += ReadCounter(counters.totalNanoseconds, take);
+			
+			uint64_t maxNanoseconds = ReadCounter(counters.maxNanoseconds, take);
+			
+			if( maxNanoseconds > stats.maxNanoseconds )
+				stats.maxNanoseconds = maxNanoseconds;
+			
+			for( int bucketIdx = 0; bucketIdx < kCollisionStatsLatencyBuckets; ++bucketIdx )
+				stats.latency[bucketIdx] += ReadCounter(counters.latency[bucketIdx], take);
+		}
+		
+		for( int counterIdx = 0; counterIdx < e_statsCounterCount; ++counterIdx )
+			snapshot->counters[counterIdx] += ReadCounter(shard.counters[counterIdx], take);
+	}
+}
+
+void GetCollisionStats( CollisionStatsSnapshot* snapshot )
+{
+	ReadStats(snapshot, false);
+}
+
+void TakeCollisionStats( CollisionStatsSnapshot* snapshot )
+{
+	ReadStats(snapshot, true);
+}
+
+void ResetCollisionStats()
+{
+	CollisionStatsSnapshot discarded;
+	ReadStats(&discarded, true);
+}
+
+#else
+
+void GetCollisionStats( CollisionStatsSnapshot* snapshot )
+{
+	memset(snapshot, 0, sizeof(CollisionStatsSnapshot));
+}
+
+void TakeCollisionStats( CollisionStatsSnapshot* snapshot )
+{
+	memset(snapshot, 0, sizeof(CollisionStatsSnapshot));
+}
+
+void ResetCollisionStats()
+{
+}
+
+#endif
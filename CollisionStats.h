@@ -0,0 +1,162 @@
+//
+//	CollisionStats.h
+//
+//	Created by Aaron Pendley on 4/9/10.
+//	Copyright 2010 Aaron Pendley.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+// 
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+// 
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+
+#ifndef _COLLISIONSTATS_H_INCLUDED_
+#define _COLLISIONSTATS_H_INCLUDED_
+
+#include <stdint.h>
+
+
+// hot path counters and latency histograms for the CollisionUtil queries.
+//
+// recording is compiled in by building with COLLISION_UTIL_STATS=1.  otherwise the recording
+// macros expand to nothing, their arguments aren't evaluated, and the snapshot functions just
+// hand back zeroes, so code that reads the stats builds either way.
+//
+// counters are kept per thread shard and summed when read, so recording is safe and cheap from
+// any number of threads at once.  call TakeCollisionStats once per frame to get that frame's numbers.
+
+#ifndef COLLISION_UTIL_STATS
+#define COLLISION_UTIL_STATS 0
+#endif
+
+enum CollisionStatsQuery
+{
+	e_statsQueryAABB,
+	e_statsQueryShape,
+	e_statsQueryShapeBatch,
+	e_statsQueryNearest,
+	e_statsQueryKNearest,
+	e_statsCollideRay,
+	e_statsCollideRayClosest,
+	e_statsCollideRayAny,
+	e_statsCollideRayNearest,
+	e_statsCollideRayBatch,
+	e_statsRayProbe,
+	e_statsCollideSweptPair,		// the shape vs shape and shape vs fixture overloads
+	e_statsCollideSwept,
+	e_statsCollideSweptClosest,
+	e_statsCollideSweptAny,
+	e_statsCollideSweptTOI,
+	e_statsQueryTypeCount
+};
+
+enum CollisionStatsCounter
+{
+	e_statsCandidates,				// fixture proxies handed to a query by the broadphase
+	e_statsFixturesFiltered,		// of those, the ones a QueryFilter rejected
+	e_statsTOICalls,
+	e_statsTOIIterations,			// taken from Box2D's own b2_toiIters, so only exact with one thread sweeping at a time
+	e_statsDistanceCalls,
+	e_statsDistanceIterations,
+	e_statsResultBufferFull,		// queries that stopped because the caller's result buffer filled up
+	e_statsPacketOverflows,			// ray packets with too many candidates, cast one ray at a time instead
+	e_statsCounterCount
+};
+
+// latency bucket i counts queries that took [2^i, 2^(i+1)) nanoseconds, the last one counts everything slower
+static const int kCollisionStatsLatencyBuckets = 32;
+
+struct CollisionQueryStats
+{
+	uint64_t count;
+	uint64_t fixturesReported;		// results handed back to the caller
+	uint64_t totalNanoseconds;
+	uint64_t maxNanoseconds;
+	uint64_t latency[kCollisionStatsLatencyBuckets];
+	
+	// upper bound of the bucket holding the given percentile (0 to 1), 0 if there were no queries
+	uint64_t GetLatencyPercentile( float percentile ) const;
+	
+	double GetAverageNanoseconds() const { return count > 0 ? (double)totalNanoseconds / (double)count : 0.0; }
+};
+
+struct CollisionStatsSnapshot
+{
+	CollisionQueryStats queries[e_statsQueryTypeCount];
+	uint64_t counters[e_statsCounterCount];
+};
+
+// totals since the last take or reset
+void GetCollisionStats( CollisionStatsSnapshot* snapshot );
+
+// totals since the last take or reset, and starts counting again from zero
+void TakeCollisionStats( CollisionStatsSnapshot* snapshot );
+
+void ResetCollisionStats();
+
+const char* GetCollisionStatsQueryName( CollisionStatsQuery query );
+const char* GetCollisionStatsCounterName( CollisionStatsCounter counter );
+
+
+////////////////////////////////////////////////////////////////////////////
+// recording, for use inside the query implementations
+
+#if COLLISION_UTIL_STATS
+
+#include <chrono>
+
+void CollisionStatsCount( CollisionStatsCounter counter, uint64_t amount );
+void CollisionStatsQueryDone( CollisionStatsQuery query, uint64_t nanoseconds, int fixturesReported );
+
+// times a query from construction to destruction
+class CollisionStatsScope
+{
+public:
+	explicit CollisionStatsScope( CollisionStatsQuery query )
+	: mQuery(query)
+	, mReported(0)
+	, mStart(std::chrono::steady_clock::now())
+	{
+	}
+	
+	~CollisionStatsScope()
+	{
+		std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - mStart;
+		CollisionStatsQueryDone(mQuery, (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(), mReported);
+	}
+	
+	void SetReported( int reported ) { mReported = reported; }
+	
+private:
+	CollisionStatsQuery mQuery;
+	int mReported;
+	std::chrono::steady_clock::time_point mStart;
+};
+
+#define COLLISION_STATS_QUERY(query) CollisionStatsScope collisionStatsScope(query)
+#define COLLISION_STATS_REPORTED(count) collisionStatsScope.SetReported(count)
+#define COLLISION_STATS_COUNT(counter, amount) CollisionStatsCount(counter, amount)
+
+#else
+
+#define COLLISION_STATS_QUERY(query) ((void)sizeof(query))
+#define COLLISION_STATS_REPORTED(count) ((void)0)
+#define COLLISION_STATS_COUNT(counter, amount) ((void)0)
+
+#endif
+
+#endif
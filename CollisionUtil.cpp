@@ -24,435 +24,2116 @@
 //
 
 #include "CollisionUtil.h"
+#include "CategoryIndex.h"
+#include "CollisionStats.h"
+#include "QueryPolicies.h"
+#include "RayKernels.h"
+#include "StaticBVH.h"
+#include "SweepCache.h"
 
+#include <algorithm>
 
-class WorldAABBQuery : public b2QueryCallback
+
+// b2DistanceProxy::Set points a chain child's proxy at its own m_buffer, so a plain copy would still
+// point at the buffer of the proxy it was copied from.  this copies and points it back.
+static inline void CopyDistanceProxy( const b2DistanceProxy& from, b2DistanceProxy* to )
 {
-public:	
-	WorldAABBQuery(b2Fixture** results, int maxResults, const QueryFilter& filter)
-	: mFilter(filter)
-	, mResults(results)
-	, mResultCount(0)
-	, mMaxResults(maxResults)
-	{
-	}
+	*to = from;
 	
-	// Called for each fixture found in the query AABB.
-	// return false to terminate the query.
-	bool ReportFixture(b2Fixture* fixture)
-	{
-		if( mFilter.test(fixture->GetFilterData()) )
-		{
-			mResults[mResultCount] = fixture;
-			mResultCount++;
-		}
-		
-		return mResultCount < mMaxResults;
-	}
+	if( from.m_vertices == from.m_buffer )
+		to->m_vertices = to->m_buffer;
+}
+
+// a fixture child's proxy, kept in the cache when there is one, otherwise built in storage
+static inline const b2DistanceProxy& GetFixtureProxy( b2Fixture* fixture, int32 childIndex, SweepCache* cache, b2DistanceProxy* storage )
+{
+	if( cache != NULL )
+		return cache->GetProxy(fixture, childIndex);
 	
-	QueryFilter mFilter;		
-	b2Fixture** mResults;
-	int mResultCount;	
-	int mMaxResults;	
-};
+	storage->Set(fixture->GetShape(), childIndex);
+	return *storage;
+}
 
 int QueryAABB(b2World* world, const b2AABB& aabb, const QueryFilter& filter, b2Fixture** results, int maxResults )
 {	
-	WorldAABBQuery cb(results, maxResults, filter);
-	world->QueryAABB(&cb, aabb);
-	return cb.mResultCount;
+	COLLISION_STATS_QUERY(e_statsQueryAABB);
+	
+	FirstNFixturesCollector collector(results, maxResults);
+	QueryAABBWith(world, aabb, &collector, CategoryFilterPolicy(filter));
+	
+	COLLISION_STATS_REPORTED(collector.mResultCount);
+	return collector.mResultCount;
+}
+
+int QueryAABB(b2World* world, const b2AABB& aabb, const QueryFilter& filter, QueryContext* context, b2Fixture*** results )
+{
+	COLLISION_STATS_QUERY(e_statsQueryAABB);
+	
+	QueryArray<b2Fixture*> fixtures(context);
+	AllFixturesCollector collector(&fixtures);
+	QueryAABBWith(world, aabb, &collector, CategoryFilterPolicy(filter));
+	
+	COLLISION_STATS_REPORTED(fixtures.GetCount());
+	
+	*results = fixtures.GetData();
+	return fixtures.GetCount();
 }
 
 
 ////////////////////////////////////////////////////////////////////////////
 // raycasting
 
-class RayCastCB : public b2RayCastCallback
+int CollideRay( b2World* world, const b2Vec2& from, const b2Vec2& to, const QueryFilter& filter, RayCastResult* results, int maxResults )
 {
-public:
-	RayCastCB( RayCastResult* results, int maxResults, const QueryFilter& filter )
-	: mResults(results)
-	, mResultCount(0)
-	, mMaxResults(maxResults)
-	, mFilter(filter)
-	{
-		assert(results != NULL);
-	}
+	assert(results != NULL);
 	
-	RayCastResult* mResults;
-	int mResultCount;	
-	int mMaxResults;
-	QueryFilter mFilter;
+	COLLISION_STATS_QUERY(e_statsCollideRay);
 	
+	FirstNHitsCollector collector(results, maxResults);
+	CollideRayWith(world, from, to, &collector, QueryFilterPolicy(filter));
 	
-	/// Called for each fixture found in the query. You control how the ray cast
-	/// proceeds by returning a float:
-	/// return -1: ignore this fixture and continue
-	/// return 0: terminate the ray cast
-	/// return fraction: clip the ray to this point
-	/// return 1: don't clip the ray and continue
-	/// @param fixture the fixture hit by the ray
-	/// @param point the point of initial intersection
-	/// @param normal the normal vector at the point of intersection
-	/// @return -1 to filter, 0 to terminate, fraction to clip the ray for
-	/// closest hit, 1 to continue	
-	virtual float32 ReportFixture( b2Fixture* fixture, const b2Vec2& point, const b2Vec2& normal, float32 fraction)
-	{
-		bool ignore = mFilter.ignored != NULL && mFilter.ignored == fixture->GetBody()->GetUserData();
-		
-		if( !ignore && mFilter.test(fixture->GetFilterData()) )
-		{
-			RayCastResult& result = mResults[mResultCount];
-			
-			result.fixture = fixture;
-			result.point = point;
-			result.normal = normal;
-			result.fraction = fraction;
-			
-			mResultCount++;
-		}
-		
-		return mResultCount < mMaxResults ? 1 : 0;
-	}
-};
+	COLLISION_STATS_REPORTED(collector.mResultCount);
+	return collector.mResultCount;
+}
 
-int CollideRay( b2World* world, const b2Vec2& from, const b2Vec2& to, const QueryFilter& filter, RayCastResult* results, int maxResults )
+bool CollideRayClosest( b2World* world, const b2Vec2& from, const b2Vec2& to, const QueryFilter& filter, RayCastResult* result)
+{
+	// fixtures are not reported in order along the ray, but clipping the ray at each hit means
+	// only closer ones get reported after it, so the last one reported is the closest
+	COLLISION_STATS_QUERY(e_statsCollideRayClosest);
+	
+	ClosestHitCollector collector(result);
+	CollideRayWith(world, from, to, &collector, QueryFilterPolicy(filter));
+	
+	COLLISION_STATS_REPORTED(collector.mHit ? 1 : 0);
+	return collector.mHit;	
+}
+
+bool CollideRayAny( b2World* world, const b2Vec2& from, const b2Vec2& to, const QueryFilter& filter )
+{
+	COLLISION_STATS_QUERY(e_statsCollideRayAny);
+	
+	AnyHitCollector collector;
+	CollideRayWith(world, from, to, &collector, QueryFilterPolicy(filter));
+	
+	COLLISION_STATS_REPORTED(collector.HasHit() ? 1 : 0);
+	return collector.HasHit();
+}
+
+int CollideRayNearest( b2World* world, const b2Vec2& from, const b2Vec2& to, const QueryFilter& filter, RayCastResult* results, int maxResults )
+{
+	assert(results != NULL || maxResults <= 0);
+	
+	COLLISION_STATS_QUERY(e_statsCollideRayNearest);
+	
+	NearestHitsCollector collector(results, maxResults);
+	CollideRayWith(world, from, to, &collector, QueryFilterPolicy(filter));
+	collector.Finish();
+	
+	COLLISION_STATS_REPORTED(collector.mResultCount);
+	return collector.mResultCount;
+}
+
+
+////////////////////////////////////////////////////////////////////////////
+// category index queries.  the index only searches groups that pass the filter's mask and
+// category test, so all that's left to check per fixture is the ignored body.
+
+int QueryAABB( const CategoryIndex* index, const b2AABB& aabb, const QueryFilter& filter, b2Fixture** results, int maxResults )
+{
+	COLLISION_STATS_QUERY(e_statsQueryAABB);
+	
+	FirstNFixturesCollector collector(results, maxResults);
+	QueryAABBWith(index, aabb, filter, &collector, AcceptAllPolicy());
+	
+	COLLISION_STATS_REPORTED(collector.mResultCount);
+	return collector.mResultCount;
+}
+
+int CollideRay( const CategoryIndex* index, const b2Vec2& from, const b2Vec2& to, const QueryFilter& filter, RayCastResult* results, int maxResults )
+{
+	assert(results != NULL);
+	
+	COLLISION_STATS_QUERY(e_statsCollideRay);
+	
+	FirstNHitsCollector collector(results, maxResults);
+	CollideRayWith(index, from, to, filter, &collector, IgnoredBodyFilterPolicy(filter));
+	
+	COLLISION_STATS_REPORTED(collector.mResultCount);
+	return collector.mResultCount;
+}
+
+bool CollideRayClosest( const CategoryIndex* index, const b2Vec2& from, const b2Vec2& to, const QueryFilter& filter, RayCastResult* result )
+{
+	COLLISION_STATS_QUERY(e_statsCollideRayClosest);
+	
+	ClosestHitCollector collector(result);
+	CollideRayWith(index, from, to, filter, &collector, IgnoredBodyFilterPolicy(filter));
+	
+	COLLISION_STATS_REPORTED(collector.mHit ? 1 : 0);
+	return collector.mHit;
+}
+
+bool CollideRayAny( const CategoryIndex* index, const b2Vec2& from, const b2Vec2& to, const QueryFilter& filter )
+{
+	COLLISION_STATS_QUERY(e_statsCollideRayAny);
+	
+	AnyHitCollector collector;
+	CollideRayWith(index, from, to, filter, &collector, IgnoredBodyFilterPolicy(filter));
+	
+	COLLISION_STATS_REPORTED(collector.HasHit() ? 1 : 0);
+	return collector.HasHit();
+}
+
+int CollideRayNearest( const CategoryIndex* index, const b2Vec2& from, const b2Vec2& to, const QueryFilter& filter, RayCastResult* results, int maxResults )
 {
-	RayCastCB cb(results, maxResults, filter);
-	world->RayCast(&cb, from, to);
-	return cb.mResultCount;
+	assert(results != NULL || maxResults <= 0);
+	
+	COLLISION_STATS_QUERY(e_statsCollideRayNearest);
+	
+	// the clip carries over from one group's tree to the next, so later groups only see nearer hits
+	NearestHitsCollector collector(results, maxResults);
+	CollideRayWith(index, from, to, filter, &collector, IgnoredBodyFilterPolicy(filter));
+	collector.Finish();
+	
+	COLLISION_STATS_REPORTED(collector.mResultCount);
+	return collector.mResultCount;
 }
 
 
+////////////////////////////////////////////////////////////////////////////
+// batched raycasting
+
+// maximum number of rays that share a single broadphase walk
+static const int kRayPacketSize = 16;
+
+// maximum number of fixture proxies collected for a packet.  if a packet overflows this,
+// its rays fall back to individual CollideRayClosest calls.
+static const int kMaxPacketCandidates = 256;
 
+static inline b2AABB RayAABB(const b2Vec2& from, const b2Vec2& to)
+{
+	b2AABB aabb;
+	aabb.lowerBound = b2Min(from, to);
+	aabb.upperBound = b2Max(from, to);
+	return aabb;
+}
 
+static inline float32 AABBPerimeter(const b2AABB& aabb)
+{
+	return 2.0f * ((aabb.upperBound.x - aabb.lowerBound.x) + (aabb.upperBound.y - aabb.lowerBound.y));
+}
 
-class RayCastClosestCB : public b2RayCastCallback
+// collects the fixture proxies overlapping a packet's bounds, straight from the broadphase.
+// the filter is applied here, once per fixture, rather than once per fixture per ray.
+class RayPacketQuery
 {
 public:
-	RayCastClosestCB( RayCastResult* result, const QueryFilter& filter )
-	: mResult(result)
+	RayPacketQuery( const b2BroadPhase* broadPhase, const QueryFilter& filter )
+	: mBroadPhase(broadPhase)
 	, mFilter(filter)
-	, mFraction(1.f)
-	, mHit(false)
+	, mCandidateCount(0)
+	, mOverflow(false)
 	{
 	}
 	
-	RayCastResult* mResult;
-	QueryFilter mFilter;
-	int mFraction;
-	bool mHit;
-	
-	virtual float32 ReportFixture( b2Fixture* fixture, const b2Vec2& point, const b2Vec2& normal, float32 fraction)
+	// called by b2BroadPhase::Query for each proxy overlapping the packet bounds
+	bool QueryCallback(int32 proxyId)
 	{
-		bool ignore = mFilter.ignored != NULL && mFilter.ignored == fixture->GetBody()->GetUserData();		
+		b2FixtureProxy* proxy = (b2FixtureProxy*)mBroadPhase->GetUserData(proxyId);
 		
-		// apendley - don't actually know if this is necessary.  we may be alright just returning the first hit
-		if( !ignore && mFilter.test(fixture->GetFilterData()) && fraction <= mFraction )
+		COLLISION_STATS_COUNT(e_statsCandidates, 1);
+		
+		if( !mFilter.Accept(proxy->fixture) )
 		{
-			mHit = true;
-			mFraction = fraction;
-			
-			if( mResult )
-			{
-				mResult->fixture = fixture;
-				mResult->point = point;
-				mResult->normal = normal;
-				mResult->fraction = fraction;
-			}
-			
-			return 1;
+			COLLISION_STATS_COUNT(e_statsFixturesFiltered, 1);
+			return true;
+		}
+		
+		if( mCandidateCount == kMaxPacketCandidates )
+		{
+			COLLISION_STATS_COUNT(e_statsPacketOverflows, 1);
+			mOverflow = true;
+			return false;
 		}
 		
-		return -1;
+		mCandidates[mCandidateCount] = proxy;
+		mCandidateCount++;
+		
+		return true;
 	}
+	
+	const b2BroadPhase* mBroadPhase;
+	QueryFilterPolicy mFilter;
+	b2FixtureProxy* mCandidates[kMaxPacketCandidates];
+	int mCandidateCount;
+	bool mOverflow;
 };
 
+// the circle candidates of a packet, in world space, for RayCastCircles
+struct PacketCircles
+{
+	float32 centerX[kMaxPacketCandidates];
+	float32 centerY[kMaxPacketCandidates];
+	float32 radius[kMaxPacketCandidates];
+	b2Fixture* fixtures[kMaxPacketCandidates];
+	int32 count;
+};
 
-bool CollideRayClosest( b2World* world, const b2Vec2& from, const b2Vec2& to, const QueryFilter& filter, RayCastResult* result)
+static inline void SetPacketHit( b2Fixture* fixture, const b2RayCastOutput& output, b2RayCastInput* input, RayCastResult* result )
 {
-	RayCastClosestCB cb(result, filter);
-	world->RayCast(&cb, from, to);
-	return cb.mHit;	
+	// same math b2World::RayCast uses, so results match the scalar query
+	float32 fraction = output.fraction;
+	
+	result->fixture = fixture;
+	result->point = (1.0f - fraction) * input->p1 + fraction * input->p2;
+	result->normal = output.normal;
+	result->fraction = fraction;
+	
+	input->maxFraction = fraction;
 }
 
-
-
-
-
-////////////////////////////////////////////////////////////////////////////
-// shape casting (swept collision test)
-
-// sweep a shape against another known shape in the world
-bool CollideSwept( b2Shape* shape, const b2Transform& xform, const b2Vec2& localCenter, b2Shape* shapeOther, const b2Transform& xformOther, const b2Vec2& localCenterOther, const b2Vec2& motion, ShapeCastResult* result )
+static int CollideRayPacket( b2World* world, const b2BroadPhase* broadPhase, const b2AABB& packetAABB, const RaySegment* rays, int rayCount, const QueryFilter& filter, RayCastResult* results )
 {
-	b2Sweep sweep;
+	RayPacketQuery query(broadPhase, filter);
+	broadPhase->Query(&query, packetAABB);
 	
-	// build sweep structures
-	sweep.a0 = sweep.a = xform.GetAngle();
-	sweep.localCenter = localCenter;
-	sweep.c0 = xform.position;
-	sweep.c = xform.position + motion;
+	int hitCount = 0;
 	
-	b2Sweep otherSweep;
-	b2Transform otherTransform = xformOther;
-	otherSweep.localCenter = localCenterOther;
-	otherSweep.a0 = otherSweep.a = xformOther.GetAngle();
-	otherSweep.c0 = otherSweep.c = b2Mul(otherTransform, otherSweep.localCenter);
+	if( query.mOverflow )
+	{
+		for( int rayIdx = 0; rayIdx < rayCount; ++rayIdx )
+		{
+			results[rayIdx] = RayCastResult();
+			
+			if( CollideRayClosest(world, rays[rayIdx].from, rays[rayIdx].to, filter, &results[rayIdx]) )
+				hitCount++;
+		}
+		
+		return hitCount;
+	}
 	
-	// now let's get a TOI on the collision
-	b2TOIInput toiInput;
-	toiInput.proxyA.Set(shape, 0);
-	toiInput.proxyB.Set(shapeOther, 0);
-	toiInput.sweepA = sweep;
-	toiInput.sweepB = otherSweep;
-	toiInput.tMax = 1.0f;
+	b2RayCastInput inputs[kRayPacketSize];
 	
-	b2TOIOutput toiOutput;
-	b2TimeOfImpact(&toiOutput, &toiInput);		
+	for( int rayIdx = 0; rayIdx < rayCount; ++rayIdx )
+	{
+		results[rayIdx] = RayCastResult();
+		
+		inputs[rayIdx].p1 = rays[rayIdx].from;
+		inputs[rayIdx].p2 = rays[rayIdx].to;
+		inputs[rayIdx].maxFraction = 1.0f;
+	}
 	
-	// i want to be aware of anything unexpected...
-	assert(toiOutput.state == b2TOIOutput::e_touching || toiOutput.state == b2TOIOutput::e_separated || toiOutput.state == b2TOIOutput::e_overlapped);
+	// each candidate is tested against all of the packet's rays at once.  polygons go through the
+	// RayKernels a packet at a time, circles are gathered up and done a whole packet's worth per ray,
+	// and anything else is cast one ray at a time.
+	PacketCircles circles;
+	circles.count = 0;
 	
-	if( toiOutput.state == b2TOIOutput::e_touching )
+	for( int candidateIdx = 0; candidateIdx < query.mCandidateCount; ++candidateIdx )
 	{
-		// get the collision info to hand back to the caller
-		b2DistanceInput distInput;
-		distInput.proxyA.Set(shape, 0);
-		distInput.proxyB.Set(shapeOther, 0);
-		sweep.GetTransform(&distInput.transformA, toiOutput.t);				
-		distInput.transformB = xformOther;
-		distInput.useRadii = false;
+		b2FixtureProxy* proxy = query.mCandidates[candidateIdx];
+		b2Fixture* fixture = proxy->fixture;
+		const b2Shape* shape = fixture->GetShape();
+		const b2Transform& xf = fixture->GetBody()->GetTransform();
 		
-		b2SimplexCache cache;
-		cache.count = 0;
+		if( shape->GetType() == b2Shape::e_circle )
+		{
+			const b2CircleShape* circle = (const b2CircleShape*)shape;
+			b2Vec2 center = b2Mul(xf, circle->m_p);
+			
+			circles.centerX[circles.count] = center.x;
+			circles.centerY[circles.count] = center.y;
+			circles.radius[circles.count] = circle->m_radius;
+			circles.fixtures[circles.count] = fixture;
+			circles.count++;
+			continue;
+		}
 		
-		b2DistanceOutput distOutput;
-		b2Distance(&distOutput, &cache, &distInput);
+		// cheap rejection against the fixture's own AABB, using each ray clipped to its closest hit so far
+		int laneRays[kRayPacketSize];
+		b2RayCastInput laneInputs[kRayPacketSize];
+		int laneCount = 0;
 		
-		if( result != NULL )
+		for( int rayIdx = 0; rayIdx < rayCount; ++rayIdx )
 		{
-			// calculate collision normal
-			b2Vec2 normal = distOutput.pointA - distOutput.pointB;
-			normal *= (1.f / distOutput.distance);
-			result->normal = normal;
+			const b2RayCastInput& input = inputs[rayIdx];
+			b2AABB clippedAABB = RayAABB(input.p1, input.p1 + input.maxFraction * (input.p2 - input.p1));
 			
-			// hmm..guess i'll return the collision point on the other fixture.  we could average the points also.
-			// or some other third way that is the actual correct way to do it
-			result->contactPoint = distOutput.pointB;
-			//b2Vec2 intersection = distanceOutput.pointA + shape->m_radius * normal;			
+			if( !b2TestOverlap(clippedAABB, proxy->aabb) )
+				continue;
+			
+			laneRays[laneCount] = rayIdx;
+			laneInputs[laneCount] = input;
+			laneCount++;
+		}
+		
+		if( laneCount == 0 )
+			continue;
+		
+		RayPolygonSoA polygon;
+		
+		if( shape->GetType() == b2Shape::e_polygon && polygon.Set((const b2PolygonShape*)shape) )
+		{
+			b2RayCastOutput outputs[kRayPacketSize];
+			bool hits[kRayPacketSize];
 			
-			// reuse result from calculated b2DistanceInput
-			result->toi = distInput.transformA.position;
+			if( RayCastPolygon(polygon, xf, laneInputs, laneCount, outputs, hits) == 0 )
+				continue;
 			
-			// no fixture
-			result->fixture = NULL;
+			for( int laneIdx = 0; laneIdx < laneCount; ++laneIdx )
+			{
+				if( hits[laneIdx] )
+				{
+					int rayIdx = laneRays[laneIdx];
+					SetPacketHit(fixture, outputs[laneIdx], &inputs[rayIdx], &results[rayIdx]);
+				}
+			}
+		}
+		else
+		{
+			for( int laneIdx = 0; laneIdx < laneCount; ++laneIdx )
+			{
+				int rayIdx = laneRays[laneIdx];
+				b2RayCastOutput output;
+				
+				if( fixture->RayCast(&output, inputs[rayIdx], proxy->childIndex) )
+					SetPacketHit(fixture, output, &inputs[rayIdx], &results[rayIdx]);
+			}
 		}
+	}
+	
+	// circles are cheaper to test in lanes than to cull one at a time, so they skip the AABB rejection
+	if( circles.count > 0 )
+	{
+		RayCircleSoA circleSoA;
+		circleSoA.centerX = circles.centerX;
+		circleSoA.centerY = circles.centerY;
+		circleSoA.radius = circles.radius;
+		circleSoA.count = circles.count;
 		
-		return true;		
-	}		
+		for( int rayIdx = 0; rayIdx < rayCount; ++rayIdx )
+		{
+			b2RayCastOutput output;
+			int circleIdx = RayCastCircles(circleSoA, inputs[rayIdx], &output);
+			
+			if( circleIdx >= 0 )
+				SetPacketHit(circles.fixtures[circleIdx], output, &inputs[rayIdx], &results[rayIdx]);
+		}
+	}
 	
-	return false;	
+	for( int rayIdx = 0; rayIdx < rayCount; ++rayIdx )
+	{
+		if( results[rayIdx].fixture != NULL )
+			hitCount++;
+	}
 	
+	return hitCount;
 }
 
-bool CollideSwept( b2Shape* shape, const b2Transform& xform, const b2Vec2& localCenter, b2Fixture* otherFixture, const b2Vec2& motion, ShapeCastResult* result )
-{
-	return CollideSwept(shape, xform, localCenter, 
-						otherFixture->GetShape(), 
-						otherFixture->GetBody()->GetTransform(), 
-						otherFixture->GetBody()->GetLocalCenter(),
-						motion, result);	
-}
-
-int CollideSwept( b2World* world, b2Shape* shape, const b2Transform& xform, const b2Vec2& localCenter, const b2Vec2& motion, const QueryFilter& filter, ShapeCastResult* results, int maxResults)
+int CollideRayBatch( b2World* world, const RaySegment* rays, int rayCount, const QueryFilter& filter, RayCastResult* results )
 {
-	int resultCount = 0;
+	assert(rays != NULL && results != NULL);
 	
-	b2AABB sweptAABB;
-	shape->ComputeAABB(&sweptAABB, xform, 0);
+	COLLISION_STATS_QUERY(e_statsCollideRayBatch);
 	
-	b2AABB toAABB;
-	toAABB.lowerBound = sweptAABB.lowerBound + motion; 
-	toAABB.upperBound = sweptAABB.upperBound + motion;
-	sweptAABB.Combine(sweptAABB, toAABB);
+	const b2BroadPhase* broadPhase = &world->GetContactManager().m_broadPhase;
 	
-	// first do the AABB query to collect any fixtures along our swept AABB
-	static int const kMaxAABBResults = 16;
-	b2Fixture* queryResults[kMaxAABBResults];
-	int aabbCount = QueryAABB(world, sweptAABB, filter, queryResults, kMaxAABBResults);
+	int hitCount = 0;
+	int packetStart = 0;
 	
-	for( int fixtureIdx = 0; fixtureIdx < aabbCount; ++fixtureIdx )
+	while( packetStart < rayCount )
 	{
-		b2Fixture* otherFixture = queryResults[fixtureIdx];
-		b2Body* otherBody = otherFixture->GetBody();
-		
-		if( otherBody->GetUserData() != NULL && otherBody->GetUserData() == filter.ignored )
-			continue;
+		b2AABB packetAABB = RayAABB(rays[packetStart].from, rays[packetStart].to);
+		float32 perimeterSum = AABBPerimeter(packetAABB);
+		int packetSize = 1;
 		
-		// build sweep structures
-		b2Sweep sweep;
-		sweep.a0 = sweep.a = xform.GetAngle();
-		sweep.localCenter = localCenter;
-		sweep.c0 = xform.position;
-		sweep.c = xform.position + motion;
-		
-		b2Sweep otherSweep;
-		b2Transform otherTransform = otherBody->GetTransform();
-		otherSweep.localCenter = otherBody->GetLocalCenter();
-		otherSweep.a0 = otherSweep.a = otherBody->GetAngle();
-		otherSweep.c0 = otherSweep.c = b2Mul(otherTransform, otherSweep.localCenter);
-		
-		// now let's get a TOI on the collision
-		b2TOIInput toiInput;
-		toiInput.proxyA.Set(shape, 0);
-		toiInput.proxyB.Set(otherFixture->GetShape(), 0);
-		toiInput.sweepA = sweep;
-		toiInput.sweepB = otherSweep;
-		toiInput.tMax = 1.0f;
-		
-		b2TOIOutput toiOutput;
-		b2TimeOfImpact(&toiOutput, &toiInput);		
-		
-		// i want to be aware of anything unexpected...
-		assert(toiOutput.state == b2TOIOutput::e_touching || toiOutput.state == b2TOIOutput::e_separated);
-		
-		if( toiOutput.state == b2TOIOutput::e_touching )
-		{
-			// get the collision info to hand back to the caller
-			b2DistanceInput distInput;
-			distInput.proxyA.Set(shape, 0);
-			distInput.proxyB.Set(otherFixture->GetShape(), 0);
-			sweep.GetTransform(&distInput.transformA, toiOutput.t);				
-			distInput.transformB = otherFixture->GetBody()->GetTransform();
-			distInput.useRadii = false;
-			
-			b2SimplexCache cache;
-			cache.count = 0;
-			
-			b2DistanceOutput distOutput;
-			b2Distance(&distOutput, &cache, &distInput);
-			
-			ShapeCastResult& result = results[resultCount];
-
-			// calculate collision normal
-			b2Vec2 normal = distOutput.pointA - distOutput.pointB;
-			normal *= (1.f / distOutput.distance);
-			result.normal = normal;
+		// grow the packet while the rays stay coherent, i.e. while the combined bounds are no bigger
+		// than the rays' own bounds laid end to end.  past that, sharing a walk costs more than it saves.
+		while( packetSize < kRayPacketSize && packetStart + packetSize < rayCount )
+		{
+			const RaySegment& ray = rays[packetStart + packetSize];
+			b2AABB rayAABB = RayAABB(ray.from, ray.to);
 			
-			// hmm..guess i'll return the collision point on the other fixture.  we could average the points also.
-			// or some other third way that is the actual correct way to do it
-			result.contactPoint = distOutput.pointB;
-			//b2Vec2 intersection = distanceOutput.pointA + shape->m_radius * normal;			
+			b2AABB combined;
+			combined.Combine(packetAABB, rayAABB);
 			
-			// reuse result from calculated b2DistanceInput
-			result.toi = distInput.transformA.position;
+			float32 rayPerimeter = AABBPerimeter(rayAABB);
 			
-			result.fixture = otherFixture;
+			if( AABBPerimeter(combined) > perimeterSum + rayPerimeter )
+				break;
 			
-			resultCount++;
+			packetAABB = combined;
+			perimeterSum += rayPerimeter;
+			packetSize++;
 		}
+		
+		hitCount += CollideRayPacket(world, broadPhase, packetAABB, rays + packetStart, packetSize, filter, results + packetStart);
+		packetStart += packetSize;
 	}
 	
-	return resultCount;
+	COLLISION_STATS_REPORTED(hitCount);
+	return hitCount;
+}
+
+
+
+
+
+////////////////////////////////////////////////////////////////////////////
+// shape overlap query
+
+// a fixture can overlap through more than one pair of children, keep it once
+static int RemoveDuplicateFixtures( b2Fixture** fixtures, int count )
+{
+	std::sort(fixtures, fixtures + count);
+	return (int)(std::unique(fixtures, fixtures + count) - fixtures);
 }
 
-bool CollideSweptClosest( b2World* world, b2Shape* shape, const b2Transform& xform, const b2Vec2& localCenter, const b2Vec2& motion, const QueryFilter& filter, ShapeCastResult* result )
+int QueryShape( b2World* world, const b2Shape* shape, const b2Transform& xform, const QueryFilter& filter, b2Fixture** results, int maxResults )
 {
-	b2AABB sweptAABB;
-	shape->ComputeAABB(&sweptAABB, xform, 0);
+	COLLISION_STATS_QUERY(e_statsQueryShape);
 	
-	b2AABB toAABB;
-	toAABB.lowerBound = sweptAABB.lowerBound + motion; 
-	toAABB.upperBound = sweptAABB.upperBound + motion;
-	sweptAABB.Combine(sweptAABB, toAABB);
+	if( maxResults <= 0 )
+		return 0;
 	
-	// first do the AABB query to collect any fixtures along our swept AABB
-	static int const kMaxAABBResults = 16;
-	b2Fixture* queryResults[kMaxAABBResults];
-	int aabbCount = QueryAABB(world, sweptAABB, filter, queryResults, kMaxAABBResults);
+	// duplicates are dropped as they come in, so they can't take up room a distinct fixture needs
+	FirstNUniqueFixturesCollector collector(results, maxResults);
+	QueryShapeWith(world, shape, xform, &collector, QueryFilterPolicy(filter));
 	
-	b2Fixture* closest = NULL;
-	float smallestTOI = 1.0f;
-	b2Sweep sweep;
+	COLLISION_STATS_REPORTED(collector.mResultCount);
+	return collector.mResultCount;
+}
+
+int QueryShape( b2World* world, const b2Shape* shape, const b2Transform& xform, const QueryFilter& filter, QueryContext* context, b2Fixture*** results )
+{
+	COLLISION_STATS_QUERY(e_statsQueryShape);
+	
+	QueryArray<b2Fixture*> fixtures(context);
+	AllFixturesCollector collector(&fixtures);
+	QueryShapeWith(world, shape, xform, &collector, QueryFilterPolicy(filter));
+	
+	fixtures.Truncate(RemoveDuplicateFixtures(fixtures.GetData(), fixtures.GetCount()));
+	
+	COLLISION_STATS_REPORTED(fixtures.GetCount());
 	
-	for( int fixtureIdx = 0; fixtureIdx < aabbCount; ++fixtureIdx )
+	*results = fixtures.GetData();
+	return fixtures.GetCount();
+}
+
+// maximum number of probes that share a single broadphase walk
+static const int kShapePacketSize = 16;
+
+static b2AABB ComputeProbeAABB( const ShapeProbe& probe )
+{
+	b2AABB aabb;
+	probe.shape->ComputeAABB(&aabb, probe.xform, 0);
+	
+	for( int32 childIdx = 1; childIdx < probe.shape->GetChildCount(); ++childIdx )
 	{
-		b2Fixture* otherFixture = queryResults[fixtureIdx];
-		b2Body* otherBody = otherFixture->GetBody();
-		
-		if( otherBody->GetUserData() != NULL && otherBody->GetUserData() == filter.ignored )
-			continue;		
-		
-		// build sweep structures
-		sweep.a0 = sweep.a = xform.GetAngle();
-		sweep.localCenter = localCenter;
-		sweep.c0 = xform.position;
-		sweep.c = xform.position + motion;
-		
-		b2Sweep otherSweep;
-		b2Transform otherTransform = otherBody->GetTransform();
-		otherSweep.localCenter = otherBody->GetLocalCenter();
-		otherSweep.a0 = otherSweep.a = otherBody->GetAngle();
-		otherSweep.c0 = otherSweep.c = b2Mul(otherTransform, otherSweep.localCenter);
-		
-		// now let's get a TOI on the collision
-		b2TOIInput toiInput;
-		toiInput.proxyA.Set(shape, 0);
-		toiInput.proxyB.Set(otherFixture->GetShape(), 0);
-		toiInput.sweepA = sweep;
-		toiInput.sweepB = otherSweep;
-		toiInput.tMax = 1.0f;
-		
-		b2TOIOutput toiOutput;
-		b2TimeOfImpact(&toiOutput, &toiInput);		
-		
-		// i want to be aware of anything unexpected...
-		assert(toiOutput.state == b2TOIOutput::e_touching || toiOutput.state == b2TOIOutput::e_separated || toiOutput.state == b2TOIOutput::e_overlapped);
-		
-		if( toiOutput.state == b2TOIOutput::e_touching && toiOutput.t < smallestTOI )
-		{
-			closest = otherFixture;
-			smallestTOI = toiOutput.t;
-		}		
+		b2AABB childAABB;
+		probe.shape->ComputeAABB(&childAABB, probe.xform, childIdx);
+		aabb.Combine(aabb, childAABB);
 	}
 	
-	if( closest != NULL )
+	return aabb;
+}
+
+static void QueryShapePacket( b2World* world, const b2BroadPhase* broadPhase, const b2AABB& packetAABB, const ShapeProbe* probes, int probeCount, const QueryFilter& filter, QueryArray<b2Fixture*>* fixtures, int* resultStarts )
+{
+	// the packet's proxies are gathered the same way a ray packet's are
+	RayPacketQuery query(broadPhase, filter);
+	broadPhase->Query(&query, packetAABB);
+	
+	for( int probeIdx = 0; probeIdx < probeCount; ++probeIdx )
 	{
-		// get the collision info to hand back to the caller
-		b2DistanceInput distInput;
-		distInput.proxyA.Set(shape, 0);
-		distInput.proxyB.Set(closest->GetShape(), 0);
-		sweep.GetTransform(&distInput.transformA, smallestTOI);				
-		distInput.transformB = closest->GetBody()->GetTransform();
-		distInput.useRadii = false;
+		const ShapeProbe& probe = probes[probeIdx];
+		int probeStart = fixtures->GetCount();
+		resultStarts[probeIdx] = probeStart;
 		
-		b2SimplexCache cache;
-		cache.count = 0;
+		if( query.mOverflow )
+		{
+			AllFixturesCollector collector(fixtures);
+			QueryShapeWith(world, probe.shape, probe.xform, &collector, QueryFilterPolicy(filter));
+		}
+		else
+		{
+			for( int32 childIdx = 0; childIdx < probe.shape->GetChildCount(); ++childIdx )
+			{
+				b2AABB childAABB;
+				probe.shape->ComputeAABB(&childAABB, probe.xform, childIdx);
+				
+				for( int candidateIdx = 0; candidateIdx < query.mCandidateCount; ++candidateIdx )
+				{
+					b2FixtureProxy* proxy = query.mCandidates[candidateIdx];
+					
+					if( !b2TestOverlap(childAABB, proxy->aabb) )
+						continue;
+					
+					b2Fixture* fixture = proxy->fixture;
+					
+					if( b2TestOverlap(probe.shape, childIdx, fixture->GetShape(), proxy->childIndex, probe.xform, fixture->GetBody()->GetTransform()) )
+						fixtures->Push(fixture);
+				}
+			}
+		}
 		
-		b2DistanceOutput distOutput;
-		b2Distance(&distOutput, &cache, &distInput);
+		int uniqueCount = RemoveDuplicateFixtures(fixtures->GetData() + probeStart, fixtures->GetCount() - probeStart);
+		fixtures->Truncate(probeStart + uniqueCount);
+	}
+}
+
+int QueryShapeBatch( b2World* world, const ShapeProbe* probes, int probeCount, const QueryFilter& filter, QueryContext* context, b2Fixture*** results, int* resultStarts )
+{
+	assert(probes != NULL && resultStarts != NULL);
+	
+	COLLISION_STATS_QUERY(e_statsQueryShapeBatch);
+	
+	const b2BroadPhase* broadPhase = &world->GetContactManager().m_broadPhase;
+	
+	QueryArray<b2Fixture*> fixtures(context);
+	int packetStart = 0;
+	
+	while( packetStart < probeCount )
+	{
+		b2AABB packetAABB = ComputeProbeAABB(probes[packetStart]);
+		float32 perimeterSum = AABBPerimeter(packetAABB);
+		int packetSize = 1;
 		
-		if( result != NULL )
+		// same rule as ray packets, grow while the combined bounds are no bigger than the probes' own laid end to end
+		while( packetSize < kShapePacketSize && packetStart + packetSize < probeCount )
 		{
-			// calculate collision normal
-			b2Vec2 normal = distOutput.pointA - distOutput.pointB;
-			normal *= (1.f / distOutput.distance);
-			result->normal = normal;
+			b2AABB probeAABB = ComputeProbeAABB(probes[packetStart + packetSize]);
+			
+			b2AABB combined;
+			combined.Combine(packetAABB, probeAABB);
 			
-			// hmm..guess i'll return the collision point on the other fixture.  we could average the points also.
-			// or some other third way that is the actual correct way to do it
-			result->contactPoint = distOutput.pointB;
-			//b2Vec2 intersection = distanceOutput.pointA + shape->m_radius * normal;			
+			float32 probePerimeter = AABBPerimeter(probeAABB);
 			
-			// reuse result from calculated b2DistanceInput
-			result->toi = distInput.transformA.position;
+			if( AABBPerimeter(combined) > perimeterSum + probePerimeter )
+				break;
 			
-			result->fixture = closest;
+			packetAABB = combined;
+			perimeterSum += probePerimeter;
+			packetSize++;
 		}
 		
-		return true;
-	}	
+		QueryShapePacket(world, broadPhase, packetAABB, probes + packetStart, packetSize, filter, &fixtures, resultStarts + packetStart);
+		packetStart += packetSize;
+	}
 	
-	return false;
-}
\ No newline at end of file
+	resultStarts[probeCount] = fixtures.GetCount();
+	
+	COLLISION_STATS_REPORTED(fixtures.GetCount());
+	
+	*results = fixtures.GetData();
+	return fixtures.GetCount();
+}
+
+
+////////////////////////////////////////////////////////////////////////////
+// nearest fixture queries
+
+static inline float32 AABBDistanceSquared( const b2AABB& a, const b2AABB& b )
+{
+	float32 dx = b2Max(0.0f, b2Max(a.lowerBound.x - b.upperBound.x, b.lowerBound.x - a.upperBound.x));
+	float32 dy = b2Max(0.0f, b2Max(a.lowerBound.y - b.upperBound.y, b.lowerBound.y - a.upperBound.y));
+	return dx * dx + dy * dy;
+}
+
+// orders results farthest first for the heap, which leaves them nearest first once sorted
+struct NearestResultLess
+{
+	bool operator () ( const NearestResult& a, const NearestResult& b ) const
+	{
+		return a.distance < b.distance;
+	}
+};
+
+// measures fixtures from a point or a shape, keeping the maxResults nearest.  the results are kept as a
+// max heap on distance while the query runs, call Finish to sort them nearest first.
+class NearestCollector
+{
+public:
+	NearestCollector( const b2Vec2& point, float32 maxDistance, NearestResult* results, int maxResults )
+	: mShape(NULL)
+	, mPoint(point)
+	, mMaxDistance(maxDistance)
+	, mResults(results)
+	, mResultCount(0)
+	, mMaxResults(maxResults)
+	{
+		mXform.SetIdentity();
+		mAABB.lowerBound = point;
+		mAABB.upperBound = point;
+		
+		mProxy.m_vertices = &mPoint;
+		mProxy.m_count = 1;
+		mProxy.m_radius = 0.0f;
+	}
+	
+	NearestCollector( const b2Shape* shape, const b2Transform& xform, float32 maxDistance, NearestResult* results, int maxResults )
+	: mShape(shape)
+	, mXform(xform)
+	, mPoint(0.0f, 0.0f)
+	, mMaxDistance(maxDistance)
+	, mResults(results)
+	, mResultCount(0)
+	, mMaxResults(maxResults)
+	{
+		shape->ComputeAABB(&mAABB, xform, 0);
+		
+		for( int32 childIdx = 1; childIdx < shape->GetChildCount(); ++childIdx )
+		{
+			b2AABB childAABB;
+			shape->ComputeAABB(&childAABB, xform, childIdx);
+			mAABB.Combine(mAABB, childAABB);
+		}
+		
+		// the proxy of a single child shape is the same for every candidate, so it is built once here
+		if( shape->GetChildCount() == 1 )
+			mProxy.Set(shape, 0);
+	}
+	
+	const b2AABB& GetAABB() const { return mAABB; }
+	
+	// a fixture farther away than this can't make it into the results
+	float32 GetBound() const
+	{
+		return mResultCount < mMaxResults ? mMaxDistance : mResults[0].distance;
+	}
+	
+	void Test( b2Fixture* fixture, int32 childIndex )
+	{
+		b2DistanceInput input;
+		input.proxyB.Set(fixture->GetShape(), childIndex);
+		input.transformA = mXform;
+		input.transformB = fixture->GetBody()->GetTransform();
+		input.useRadii = true;
+		
+		NearestResult nearest;
+		nearest.fixture = fixture;
+		nearest.distance = b2_maxFloat;
+		
+		int32 childCount = mShape != NULL ? mShape->GetChildCount() : 1;
+		
+		for( int32 childIdx = 0; childIdx < childCount; ++childIdx )
+		{
+			if( childCount == 1 )
+				CopyDistanceProxy(mProxy, &input.proxyA);
+			else
+				input.proxyA.Set(mShape, childIdx);
+			
+			b2SimplexCache cache;
+			cache.count = 0;
+			
+			b2DistanceOutput output;
+			b2Distance(&output, &cache, &input);
+			
+			COLLISION_STATS_COUNT(e_statsDistanceCalls, 1);
+			COLLISION_STATS_COUNT(e_statsDistanceIterations, (uint64_t)output.iterations);
+			
+			if( output.distance < nearest.distance )
+			{
+				nearest.distance = output.distance;
+				nearest.point = output.pointA;
+				nearest.fixturePoint = output.pointB;
+			}
+		}
+		
+		if( nearest.distance > GetBound() )
+			return;
+		
+		Keep(nearest);
+	}
+	
+	int Finish()
+	{
+		std::sort_heap(mResults, mResults + mResultCount, NearestResultLess());
+		return mResultCount;
+	}
+	
+private:
+	void Keep( const NearestResult& nearest )
+	{
+		// a chain is measured once for each of its children, keep the nearest
+		for( int resultIdx = 0; resultIdx < mResultCount; ++resultIdx )
+		{
+			if( mResults[resultIdx].fixture == nearest.fixture )
+			{
+				if( nearest.distance < mResults[resultIdx].distance )
+				{
+					mResults[resultIdx] = nearest;
+					std::make_heap(mResults, mResults + mResultCount, NearestResultLess());
+				}
+				
+				return;
+			}
+		}
+		
+		if( mResultCount == mMaxResults )
+		{
+			std::pop_heap(mResults, mResults + mResultCount, NearestResultLess());
+			mResultCount--;
+		}
+		
+		mResults[mResultCount] = nearest;
+		mResultCount++;
+		std::push_heap(mResults, mResults + mResultCount, NearestResultLess());
+	}
+	
+	const b2Shape* mShape;
+	b2Transform mXform;
+	b2Vec2 mPoint;
+	b2DistanceProxy mProxy;
+	b2AABB mAABB;
+	float32 mMaxDistance;
+	NearestResult* mResults;
+	int mResultCount;
+	int mMaxResults;
+};
+
+// a fixture proxy and how far its AABB is from the query's
+struct NearestCandidate
+{
+	b2FixtureProxy* proxy;
+	float32 distanceSquared;
+	
+	bool operator < ( const NearestCandidate& other ) const
+	{
+		return distanceSquared < other.distanceSquared;
+	}
+};
+
+// collects the accepted proxies within reach of the query, straight from the broadphase
+template <class Filter>
+class NearestBroadphaseQuery
+{
+public:
+	NearestBroadphaseQuery( const b2BroadPhase* broadPhase, const b2AABB& aabb, float32 maxDistance, const Filter& filter, QueryArray<NearestCandidate>* candidates )
+	: mBroadPhase(broadPhase)
+	, mAABB(aabb)
+	, mMaxDistanceSquared(maxDistance * maxDistance)
+	, mFilter(filter)
+	, mCandidates(candidates)
+	{
+	}
+	
+	bool QueryCallback( int32 proxyId )
+	{
+		b2FixtureProxy* proxy = (b2FixtureProxy*)mBroadPhase->GetUserData(proxyId);
+		
+		COLLISION_STATS_COUNT(e_statsCandidates, 1);
+		
+		if( !mFilter.Accept(proxy->fixture) )
+		{
+			COLLISION_STATS_COUNT(e_statsFixturesFiltered, 1);
+			return true;
+		}
+		
+		NearestCandidate candidate;
+		candidate.proxy = proxy;
+		candidate.distanceSquared = AABBDistanceSquared(proxy->aabb, mAABB);
+		
+		if( candidate.distanceSquared <= mMaxDistanceSquared )
+			mCandidates->Push(candidate);
+		
+		return true;
+	}
+	
+	const b2BroadPhase* mBroadPhase;
+	b2AABB mAABB;
+	float32 mMaxDistanceSquared;
+	Filter mFilter;
+	QueryArray<NearestCandidate>* mCandidates;
+};
+
+// hands the leaves a StaticBVH visits nearest first to the collector
+template <class Filter>
+class NearestBVHQuery
+{
+public:
+	NearestBVHQuery( const StaticBVH* statics, const Filter& filter, NearestCollector* collector )
+	: mStatics(statics)
+	, mFilter(filter)
+	, mCollector(collector)
+	{
+	}
+	
+	float32 NearestCallback( int32 proxyId )
+	{
+		b2FixtureProxy* proxy = (b2FixtureProxy*)mStatics->GetUserData(proxyId);
+		
+		COLLISION_STATS_COUNT(e_statsCandidates, 1);
+		
+		if( mFilter.Accept(proxy->fixture) )
+			mCollector->Test(proxy->fixture, proxy->childIndex);
+		else
+			COLLISION_STATS_COUNT(e_statsFixturesFiltered, 1);
+		
+		return mCollector->GetBound();
+	}
+	
+	const StaticBVH* mStatics;
+	Filter mFilter;
+	NearestCollector* mCollector;
+};
+
+template <class Filter>
+static void FindNearestInBroadphase( b2World* world, const Filter& filter, NearestCollector* collector )
+{
+	QueryContext* scratch = GetThreadQueryContext();
+	QueryContextScope scope(scratch);
+	
+	// b2BroadPhase only offers an AABB query, so the walk covers everything within reach, and the
+	// candidates it finds are measured nearest first
+	float32 bound = collector->GetBound();
+	
+	b2AABB aabb = collector->GetAABB();
+	aabb.lowerBound -= b2Vec2(bound, bound);
+	aabb.upperBound += b2Vec2(bound, bound);
+	
+	QueryArray<NearestCandidate> candidates(scratch);
+	
+	const b2BroadPhase* broadPhase = &world->GetContactManager().m_broadPhase;
+	NearestBroadphaseQuery<Filter> query(broadPhase, collector->GetAABB(), bound, filter, &candidates);
+	broadPhase->Query(&query, aabb);
+	
+	std::sort(candidates.GetData(), candidates.GetData() + candidates.GetCount());
+	
+	for( int candidateIdx = 0; candidateIdx < candidates.GetCount(); ++candidateIdx )
+	{
+		const NearestCandidate& candidate = candidates[candidateIdx];
+		
+		// everything from here on is farther away than what we have
+		bound = collector->GetBound();
+		
+		if( candidate.distanceSquared > bound * bound )
+			break;
+		
+		collector->Test(candidate.proxy->fixture, candidate.proxy->childIndex);
+	}
+}
+
+// static fixtures come from the BVH first, when there is one, so the world's walk starts with a tighter bound
+static int FindNearest( b2World* world, const StaticBVH* statics, const QueryFilter& filter, NearestCollector* collector )
+{
+	if( statics != NULL )
+	{
+		NearestBVHQuery<QueryFilterPolicy> staticQuery(statics, QueryFilterPolicy(filter), collector);
+		statics->QueryNearest(&staticQuery, collector->GetAABB(), collector->GetBound());
+		
+		FindNearestInBroadphase(world, SkipStaticPolicy<QueryFilterPolicy>(QueryFilterPolicy(filter)), collector);
+	}
+	else
+	{
+		FindNearestInBroadphase(world, QueryFilterPolicy(filter), collector);
+	}
+	
+	return collector->Finish();
+}
+
+bool QueryNearest( b2World* world, const b2Vec2& point, const QueryFilter& filter, float32 maxDistance, NearestResult* result )
+{
+	COLLISION_STATS_QUERY(e_statsQueryNearest);
+	
+	NearestCollector collector(point, maxDistance, result, 1);
+	int resultCount = FindNearest(world, NULL, filter, &collector);
+	
+	COLLISION_STATS_REPORTED(resultCount);
+	return resultCount > 0;
+}
+
+bool QueryNearest( b2World* world, const b2Shape* shape, const b2Transform& xform, const QueryFilter& filter, float32 maxDistance, NearestResult* result )
+{
+	COLLISION_STATS_QUERY(e_statsQueryNearest);
+	
+	NearestCollector collector(shape, xform, maxDistance, result, 1);
+	int resultCount = FindNearest(world, NULL, filter, &collector);
+	
+	COLLISION_STATS_REPORTED(resultCount);
+	return resultCount > 0;
+}
+
+int QueryKNearest( b2World* world, const b2Vec2& point, const QueryFilter& filter, float32 maxDistance, NearestResult* results, int k )
+{
+	COLLISION_STATS_QUERY(e_statsQueryKNearest);
+	
+	if( k <= 0 )
+		return 0;
+	
+	NearestCollector collector(point, maxDistance, results, k);
+	int resultCount = FindNearest(world, NULL, filter, &collector);
+	
+	COLLISION_STATS_REPORTED(resultCount);
+	return resultCount;
+}
+
+int QueryKNearest( b2World* world, const b2Shape* shape, const b2Transform& xform, const QueryFilter& filter, float32 maxDistance, NearestResult* results, int k )
+{
+	COLLISION_STATS_QUERY(e_statsQueryKNearest);
+	
+	if( k <= 0 )
+		return 0;
+	
+	NearestCollector collector(shape, xform, maxDistance, results, k);
+	int resultCount = FindNearest(world, NULL, filter, &collector);
+	
+	COLLISION_STATS_REPORTED(resultCount);
+	return resultCount;
+}
+
+
+////////////////////////////////////////////////////////////////////////////
+// shape casting (swept collision test)
+
+// a sweep for a body, or a shape attached to one, moving its center of mass by linear and turning by angular.
+// xform is the body transform and localCenter its center of mass in body coordinates, so the sweep
+// starts the shape at xform.  every swept query builds its sweeps here.
+static void BuildKinematicSweep( const b2Transform& xform, const b2Vec2& localCenter, const b2Vec2& linear, float32 angular, b2Sweep* sweep )
+{
+	sweep->localCenter = localCenter;
+	sweep->c0 = b2Mul(xform, localCenter);
+	sweep->c = sweep->c0 + linear;
+	sweep->a0 = xform.GetAngle();
+	sweep->a = sweep->a0 + angular;
+}
+
+// build the sweep structures for a shape moving by motion against another, stationary, shape.
+// the sweep starts the shape at xform, where the candidate AABBs are measured, so the entry culling
+// never gets ahead of the TOI.
+static void BuildSweeps( const b2Transform& xform, const b2Vec2& localCenter, const b2Transform& xformOther, const b2Vec2& localCenterOther, const b2Vec2& motion, b2Sweep* sweep, b2Sweep* otherSweep )
+{
+	BuildKinematicSweep(xform, localCenter, motion, 0.0f, sweep);
+	BuildKinematicSweep(xformOther, localCenterOther, b2Vec2(0.0f, 0.0f), 0.0f, otherSweep);
+}
+
+// returns true and the time of impact if the swept proxy touches the other proxy
+static bool ComputeSweptTOI( const b2DistanceProxy& proxy, const b2DistanceProxy& proxyOther, const b2Sweep& sweep, const b2Sweep& otherSweep, float32* t )
+{
+	b2TOIInput toiInput;
+	toiInput.proxyA = proxy;
+	toiInput.proxyB = proxyOther;
+	toiInput.sweepA = sweep;
+	toiInput.sweepB = otherSweep;
+	toiInput.tMax = 1.0f;
+	
+	b2TOIOutput toiOutput;
+	
+#if COLLISION_UTIL_STATS
+	int32 toiIterationsBefore = b2_toiIters;
+#endif
+	
+	b2TimeOfImpact(&toiOutput, &toiInput);		
+	
+	COLLISION_STATS_COUNT(e_statsTOICalls, 1);
+	COLLISION_STATS_COUNT(e_statsTOIIterations, (uint64_t)b2Max(b2_toiIters - toiIterationsBefore, 0));
+	
+	// i want to be aware of anything unexpected...
+	assert(toiOutput.state == b2TOIOutput::e_touching || toiOutput.state == b2TOIOutput::e_separated || toiOutput.state == b2TOIOutput::e_overlapped);
+	
+	*t = toiOutput.t;
+	return toiOutput.state == b2TOIOutput::e_touching;
+}
+
+// get the collision info at the time of impact to hand back to the caller
+static void ComputeSweptContact( const b2DistanceProxy& proxy, const b2DistanceProxy& proxyOther, const b2Sweep& sweep, float32 t, const b2Transform& xformOther, ShapeCastResult* result )
+{
+	b2DistanceInput distInput;
+	distInput.proxyA = proxy;
+	distInput.proxyB = proxyOther;
+	sweep.GetTransform(&distInput.transformA, t);				
+	distInput.transformB = xformOther;
+	distInput.useRadii = false;
+	
+	b2SimplexCache cache;
+	cache.count = 0;
+	
+	b2DistanceOutput distOutput;
+	b2Distance(&distOutput, &cache, &distInput);
+	
+	COLLISION_STATS_COUNT(e_statsDistanceCalls, 1);
+	COLLISION_STATS_COUNT(e_statsDistanceIterations, (uint64_t)distOutput.iterations);
+	
+	// calculate collision normal
+	b2Vec2 normal = distOutput.pointA - distOutput.pointB;
+	normal *= (1.f / distOutput.distance);
+	result->normal = normal;
+	
+	// hmm..guess i'll return the collision point on the other fixture.  we could average the points also.
+	// or some other third way that is the actual correct way to do it
+	result->contactPoint = distOutput.pointB;
+	//b2Vec2 intersection = distanceOutput.pointA + shape->m_radius * normal;			
+	
+	// reuse result from calculated b2DistanceInput
+	result->toi = distInput.transformA.position;
+}
+
+// TOI of the shape against one child of a stationary fixture, once the cache says they may touch
+static bool ComputeFixtureTOI( const b2Shape* shape, const b2DistanceProxy& proxy, const b2Transform& xform, const b2Vec2& localCenter, b2Fixture* otherFixture, int32 childIndex, const b2DistanceProxy& proxyOther, const b2Vec2& motion, SweepCache* cache, float32* t )
+{
+	b2Body* otherBody = otherFixture->GetBody();
+	
+	b2Sweep sweep;
+	b2Sweep otherSweep;
+	BuildSweeps(xform, localCenter, otherBody->GetTransform(), otherBody->GetLocalCenter(), motion, &sweep, &otherSweep);
+	
+	if( cache != NULL )
+	{
+		// the cache must see the shape where the TOI starts it
+		b2Transform start;
+		sweep.GetTransform(&start, 0.0f);
+		
+		if( !cache->MayCollide(shape, proxy, start, otherFixture, childIndex, proxyOther, otherBody->GetTransform(), motion) )
+			return false;
+	}
+	
+	return ComputeSweptTOI(proxy, proxyOther, sweep, otherSweep, t);
+}
+
+// the contact with a fixture child at a TOI found by ComputeFixtureTOI
+static void ComputeFixtureContact( const b2DistanceProxy& proxy, const b2Transform& xform, const b2Vec2& localCenter, b2Fixture* otherFixture, const b2DistanceProxy& proxyOther, const b2Vec2& motion, float32 t, ShapeCastResult* result )
+{
+	b2Body* otherBody = otherFixture->GetBody();
+	
+	b2Sweep sweep;
+	b2Sweep otherSweep;
+	BuildSweeps(xform, localCenter, otherBody->GetTransform(), otherBody->GetLocalCenter(), motion, &sweep, &otherSweep);
+	
+	ComputeSweptContact(proxy, proxyOther, sweep, t, otherBody->GetTransform(), result);
+	result->fixture = otherFixture;
+}
+
+// the earliest TOI against any child of a fixture, with the proxy of the child hit
+static bool ComputeFixtureChildrenTOI( const b2Shape* shape, const b2DistanceProxy& proxy, const b2Transform& xform, const b2Vec2& localCenter, b2Fixture* otherFixture, const b2Vec2& motion, SweepCache* cache, float32* toi, b2DistanceProxy* hitProxy )
+{
+	const b2Shape* otherShape = otherFixture->GetShape();
+	bool hit = false;
+	
+	for( int32 childIdx = 0; childIdx < otherShape->GetChildCount(); ++childIdx )
+	{
+		b2DistanceProxy proxyStorage;
+		const b2DistanceProxy& proxyOther = GetFixtureProxy(otherFixture, childIdx, cache, &proxyStorage);
+		
+		float32 t;
+		
+		if( ComputeFixtureTOI(shape, proxy, xform, localCenter, otherFixture, childIdx, proxyOther, motion, cache, &t) && (!hit || t < *toi) )
+		{
+			hit = true;
+			*toi = t;
+			CopyDistanceProxy(proxyOther, hitProxy);
+		}
+	}
+	
+	return hit;
+}
+
+// a fixture child along the path of a swept shape, and how far along the path the shape's AABB first touches it
+struct SweptCandidate
+{
+	b2Fixture* fixture;
+	int32 childIndex;
+	float32 entry;
+	
+	bool operator < ( const SweptCandidate& other ) const
+	{
+		return entry < other.entry;
+	}
+};
+
+// orders candidates by fixture child, then by entry, so the duplicates of a child can be dropped keeping the earliest
+struct SweptCandidateChildLess
+{
+	bool operator () ( const SweptCandidate& a, const SweptCandidate& b ) const
+	{
+		if( a.fixture != b.fixture )
+			return a.fixture < b.fixture;
+		
+		if( a.childIndex != b.childIndex )
+			return a.childIndex < b.childIndex;
+		
+		return a.entry < b.entry;
+	}
+};
+
+struct SweptCandidateSameChild
+{
+	bool operator () ( const SweptCandidate& a, const SweptCandidate& b ) const
+	{
+		return a.fixture == b.fixture && a.childIndex == b.childIndex;
+	}
+};
+
+// a child is found once per proxy, and again by each piece of a split query it falls in
+static void RemoveDuplicateCandidates( QueryArray<SweptCandidate>* candidates )
+{
+	SweptCandidate* begin = candidates->GetData();
+	SweptCandidate* end = begin + candidates->GetCount();
+	
+	std::sort(begin, end, SweptCandidateChildLess());
+	candidates->Truncate((int)(std::unique(begin, end, SweptCandidateSameChild()) - begin));
+}
+
+// slab test of the shape's AABB moving by motion against another AABB.  returns false if they never
+// overlap during the motion, otherwise the fraction of motion at which they start to.  the shape
+// can't touch the fixture before its AABB does, so this is a lower bound on the fixture's TOI.
+static bool ComputeSweptEntry( const b2AABB& shapeAABB, const b2Vec2& motion, const b2AABB& otherAABB, float32* entry )
+{
+	// b2TimeOfImpact reports a touch slightly before the surfaces meet, so leave it some room
+	b2Vec2 extents = shapeAABB.GetExtents() + b2Vec2(2.0f * b2_linearSlop, 2.0f * b2_linearSlop);
+	b2Vec2 center = shapeAABB.GetCenter();
+	
+	// sweep the center point against the other AABB grown by our extents
+	b2Vec2 lower = otherAABB.lowerBound - extents;
+	b2Vec2 upper = otherAABB.upperBound + extents;
+	
+	float32 tmin = 0.0f;
+	float32 tmax = 1.0f;
+	
+	for( int32 axis = 0; axis < 2; ++axis )
+	{
+		float32 c = center(axis);
+		float32 d = motion(axis);
+		
+		if( b2Abs(d) < b2_epsilon )
+		{
+			if( c < lower(axis) || c > upper(axis) )
+				return false;
+		}
+		else
+		{
+			float32 inv = 1.0f / d;
+			float32 t1 = (lower(axis) - c) * inv;
+			float32 t2 = (upper(axis) - c) * inv;
+			
+			if( t1 > t2 )
+				b2Swap(t1, t2);
+			
+			tmin = b2Max(tmin, t1);
+			tmax = b2Min(tmax, t2);
+			
+			if( tmin > tmax )
+				return false;
+		}
+	}
+	
+	*entry = tmin;
+	return true;
+}
+
+// most pieces a long diagonal sweep is split into for the broadphase query
+static const int kMaxSweptPieces = 8;
+
+// collects the fixtures whose own AABBs the swept shape's AABB actually passes through, straight from the
+// broadphase or a category index tree
+template <class Tree>
+class SweptBroadphaseQuery
+{
+public:
+	SweptBroadphaseQuery( const Tree* tree, const b2AABB& shapeAABB, const b2Vec2& motion, const QueryFilter& filter, QueryArray<SweptCandidate>* candidates )
+	: mTree(tree)
+	, mShapeAABB(shapeAABB)
+	, mMotion(motion)
+	, mFilter(filter)
+	, mCandidates(candidates)
+	{
+	}
+	
+	bool QueryCallback( int32 proxyId )
+	{
+		b2FixtureProxy* proxy = (b2FixtureProxy*)mTree->GetUserData(proxyId);
+		
+		COLLISION_STATS_COUNT(e_statsCandidates, 1);
+		
+		if( !mFilter.test(proxy->fixture->GetFilterData()) )
+		{
+			COLLISION_STATS_COUNT(e_statsFixturesFiltered, 1);
+			return true;
+		}
+		
+		// the query AABB is a box around part of the path, this checks the path itself
+		SweptCandidate candidate;
+		candidate.fixture = proxy->fixture;
+		candidate.childIndex = proxy->childIndex;
+		
+		if( ComputeSweptEntry(mShapeAABB, mMotion, proxy->aabb, &candidate.entry) )
+			mCandidates->Push(candidate);
+		
+		return true;
+	}
+	
+	const Tree* mTree;
+	b2AABB mShapeAABB;
+	b2Vec2 mMotion;
+	QueryFilter mFilter;
+	QueryArray<SweptCandidate>* mCandidates;
+};
+
+// where a swept query finds its candidates: the world's broadphase, or a category index instead of the world
+struct SweptSource
+{
+	SweptSource( b2World* w, const CategoryIndex* i = NULL )
+	: world(w)
+	, index(i)
+	{
+	}
+	
+	b2World* world;
+	const CategoryIndex* index;
+};
+
+// collect any fixture children along the path of the swept shape, each with the entry of its AABB.
+// a single AABB around the whole path of a diagonal sweep is mostly empty space, so the path is
+// covered with a staircase of smaller AABBs instead, and every proxy found is checked against the
+// path before it becomes a candidate.
+// with a category index, only the groups that can pass the filter are searched and the world isn't used.
+static void GatherSweptCandidates( const SweptSource& source, b2Shape* shape, const b2Transform& xform, const b2Vec2& motion, const QueryFilter& filter, QueryArray<SweptCandidate>* candidates )
+{
+	b2AABB shapeAABB;
+	shape->ComputeAABB(&shapeAABB, xform, 0);
+	
+	// the area of the combined AABB that isn't on the path is |motion.x| * |motion.y|, and it shrinks
+	// with each piece.  split until that is no more than a quarter of the path's own area.
+	b2Vec2 size = shapeAABB.upperBound - shapeAABB.lowerBound;
+	float32 pathArea = size.x * size.y + b2Abs(motion.x) * size.y + b2Abs(motion.y) * size.x;
+	float32 wastedArea = b2Abs(motion.x) * b2Abs(motion.y);
+	
+	int pieceCount = 1;
+	
+	if( pathArea > 0.0f )
+		pieceCount = b2Clamp((int)ceilf(wastedArea / (0.25f * pathArea)), 1, kMaxSweptPieces);
+	
+	float32 pieceScale = 1.0f / (float32)pieceCount;
+	
+	for( int pieceIdx = 0; pieceIdx < pieceCount; ++pieceIdx )
+	{
+		b2Vec2 pieceFrom = ((float32)pieceIdx * pieceScale) * motion;
+		b2Vec2 pieceTo = ((float32)(pieceIdx + 1) * pieceScale) * motion;
+		
+		b2AABB pieceAABB;
+		pieceAABB.lowerBound = shapeAABB.lowerBound + b2Min(pieceFrom, pieceTo);
+		pieceAABB.upperBound = shapeAABB.upperBound + b2Max(pieceFrom, pieceTo);
+		
+		if( source.index != NULL )
+		{
+			const CategoryIndex* index = source.index;
+			
+			for( int groupIdx = 0; groupIdx < index->GetGroupCount(); ++groupIdx )
+			{
+				if( !index->GroupPasses(groupIdx, filter) )
+					continue;
+				
+				const b2DynamicTree* tree = &index->GetGroupTree(groupIdx);
+				SweptBroadphaseQuery<b2DynamicTree> query(tree, shapeAABB, motion, filter, candidates);
+				tree->Query(&query, pieceAABB);
+			}
+		}
+		else
+		{
+			const b2BroadPhase* broadPhase = &source.world->GetContactManager().m_broadPhase;
+			SweptBroadphaseQuery<b2BroadPhase> query(broadPhase, shapeAABB, motion, filter, candidates);
+			broadPhase->Query(&query, pieceAABB);
+		}
+	}
+	
+	RemoveDuplicateCandidates(candidates);
+}
+
+// sweep a shape against another known shape in the world
+bool CollideSwept( b2Shape* shape, const b2Transform& xform, const b2Vec2& localCenter, b2Shape* shapeOther, const b2Transform& xformOther, const b2Vec2& localCenterOther, const b2Vec2& motion, ShapeCastResult* result )
+{
+	b2DistanceProxy proxy;
+	proxy.Set(shape, 0);
+	
+	b2DistanceProxy proxyOther;
+	proxyOther.Set(shapeOther, 0);
+	
+	return CollideSwept(proxy, xform, localCenter, proxyOther, xformOther, localCenterOther, motion, result);
+}
+
+bool CollideSwept( const b2DistanceProxy& proxy, const b2Transform& xform, const b2Vec2& localCenter, const b2DistanceProxy& proxyOther, const b2Transform& xformOther, const b2Vec2& localCenterOther, const b2Vec2& motion, ShapeCastResult* result )
+{
+	COLLISION_STATS_QUERY(e_statsCollideSweptPair);
+	
+	b2Sweep sweep;
+	b2Sweep otherSweep;
+	BuildSweeps(xform, localCenter, xformOther, localCenterOther, motion, &sweep, &otherSweep);
+	
+	// now let's get a TOI on the collision
+	float32 t;
+	
+	if( ComputeSweptTOI(proxy, proxyOther, sweep, otherSweep, &t) )
+	{
+		if( result != NULL )
+		{
+			ComputeSweptContact(proxy, proxyOther, sweep, t, xformOther, result);
+			
+			// no fixture
+			result->fixture = NULL;
+		}
+		
+		COLLISION_STATS_REPORTED(1);
+		return true;		
+	}		
+	
+	return false;	
+	
+}
+
+bool CollideSwept( b2Shape* shape, const b2Transform& xform, const b2Vec2& localCenter, b2Fixture* otherFixture, const b2Vec2& motion, ShapeCastResult* result, SweepCache* cache )
+{
+	COLLISION_STATS_QUERY(e_statsCollideSweptPair);
+	
+	b2DistanceProxy proxy;
+	proxy.Set(shape, 0);
+	
+	float32 t;
+	b2DistanceProxy proxyOther;
+	
+	if( !ComputeFixtureChildrenTOI(shape, proxy, xform, localCenter, otherFixture, motion, cache, &t, &proxyOther) )
+		return false;
+	
+	if( result != NULL )
+		ComputeFixtureContact(proxy, xform, localCenter, otherFixture, proxyOther, motion, t, result);
+	
+	COLLISION_STATS_REPORTED(1);
+	return true;
+}
+
+bool CollideSweptTOI( b2Shape* shape, const b2Transform& xform, const b2Vec2& localCenter, b2Fixture* otherFixture, const b2Vec2& motion, float32* toi, SweepCache* cache )
+{
+	COLLISION_STATS_QUERY(e_statsCollideSweptPair);
+	
+	b2DistanceProxy proxy;
+	proxy.Set(shape, 0);
+	
+	float32 t;
+	b2DistanceProxy proxyOther;
+	
+	if( !ComputeFixtureChildrenTOI(shape, proxy, xform, localCenter, otherFixture, motion, cache, &t, &proxyOther) )
+		return false;
+	
+	*toi = t;
+	
+	COLLISION_STATS_REPORTED(1);
+	return true;
+}
+
+bool CollideSwept( const b2Shape* shape, const b2DistanceProxy& proxy, const b2Transform& xform, const b2Vec2& localCenter, b2Fixture* otherFixture, int32 childIndex, const b2DistanceProxy& proxyOther, const b2Vec2& motion, ShapeCastResult* result, SweepCache* cache )
+{
+	COLLISION_STATS_QUERY(e_statsCollideSweptPair);
+	
+	float32 t;
+	
+	if( !ComputeFixtureTOI(shape, proxy, xform, localCenter, otherFixture, childIndex, proxyOther, motion, cache, &t) )
+		return false;
+	
+	if( result != NULL )
+		ComputeFixtureContact(proxy, xform, localCenter, otherFixture, proxyOther, motion, t, result);
+	
+	COLLISION_STATS_REPORTED(1);
+	return true;
+}
+
+bool CollideSweptTOI( const b2Shape* shape, const b2DistanceProxy& proxy, const b2Transform& xform, const b2Vec2& localCenter, b2Fixture* otherFixture, int32 childIndex, const b2DistanceProxy& proxyOther, const b2Vec2& motion, float32* toi, SweepCache* cache )
+{
+	COLLISION_STATS_QUERY(e_statsCollideSweptPair);
+	
+	float32 t;
+	
+	if( !ComputeFixtureTOI(shape, proxy, xform, localCenter, otherFixture, childIndex, proxyOther, motion, cache, &t) )
+		return false;
+	
+	*toi = t;
+	
+	COLLISION_STATS_REPORTED(1);
+	return true;
+}
+
+// copies collisions into a caller supplied buffer until it is full
+class ShapeCastBufferCollector : public ShapeCastCallback
+{
+public:
+	ShapeCastBufferCollector( ShapeCastResult* results, int maxResults )
+	: mResults(results)
+	, mResultCount(0)
+	, mMaxResults(maxResults)
+	{
+	}
+	
+	bool ReportShapeCast( const ShapeCastResult& result )
+	{
+		mResults[mResultCount] = result;
+		mResultCount++;
+		
+		if( mResultCount < mMaxResults )
+			return true;
+		
+		COLLISION_STATS_COUNT(e_statsResultBufferFull, 1);
+		return false;
+	}
+	
+	ShapeCastResult* mResults;
+	int mResultCount;
+	int mMaxResults;
+};
+
+// collects collisions into a growable array in a query context
+class ShapeCastArrayCollector : public ShapeCastCallback
+{
+public:
+	ShapeCastArrayCollector( QueryArray<ShapeCastResult>* results )
+	: mResults(results)
+	{
+	}
+	
+	bool ReportShapeCast( const ShapeCastResult& result )
+	{
+		mResults->Push(result);
+		return true;
+	}
+	
+	QueryArray<ShapeCastResult>* mResults;
+};
+
+static int CollideSweptStreaming( const SweptSource& source, b2Shape* shape, const b2Transform& xform, const b2Vec2& localCenter, const b2Vec2& motion, const QueryFilter& filter, ShapeCastCallback* callback, SweepCache* cache, QueryContext* context )
+{
+	COLLISION_STATS_QUERY(e_statsCollideSwept);
+	
+	// the thread's own context is handed back as soon as we're done with it
+	QueryContext* scratch = context != NULL ? context : GetThreadQueryContext();
+	QueryContextScope scope(scratch);
+	
+	if( context != NULL )
+		scope.Release();
+	
+	// first do the AABB query to collect any fixtures along our swept AABB
+	QueryArray<SweptCandidate> candidates(scratch);
+	GatherSweptCandidates(source, shape, xform, motion, filter, &candidates);
+	
+	b2AABB shapeAABB;
+	shape->ComputeAABB(&shapeAABB, xform, 0);
+	
+	b2DistanceProxy proxy;
+	proxy.Set(shape, 0);
+	
+	int resultCount = 0;
+	
+	for( int candidateIdx = 0; candidateIdx < candidates.GetCount(); ++candidateIdx )
+	{
+		b2Fixture* otherFixture = candidates[candidateIdx].fixture;
+		int32 childIndex = candidates[candidateIdx].childIndex;
+		b2Body* otherBody = otherFixture->GetBody();
+		
+		if( otherBody->GetUserData() != NULL && otherBody->GetUserData() == filter.ignored )
+		{
+			COLLISION_STATS_COUNT(e_statsFixturesFiltered, 1);
+			continue;
+		}
+		
+		// skip children the shape's AABB never reaches
+		b2AABB otherAABB;
+		otherFixture->GetShape()->ComputeAABB(&otherAABB, otherBody->GetTransform(), childIndex);
+		
+		float32 entry;
+		
+		if( !ComputeSweptEntry(shapeAABB, motion, otherAABB, &entry) )
+			continue;
+		
+		// looked up once here for the cache, the TOI and the contact
+		b2DistanceProxy proxyStorage;
+		const b2DistanceProxy& proxyOther = GetFixtureProxy(otherFixture, childIndex, cache, &proxyStorage);
+		
+		float32 t;
+		
+		if( ComputeFixtureTOI(shape, proxy, xform, localCenter, otherFixture, childIndex, proxyOther, motion, cache, &t) )
+		{
+			ShapeCastResult result;
+			ComputeFixtureContact(proxy, xform, localCenter, otherFixture, proxyOther, motion, t, &result);
+			
+			resultCount++;
+			
+			if( !callback->ReportShapeCast(result) )
+				break;
+		}
+	}
+	
+	COLLISION_STATS_REPORTED(resultCount);
+	return resultCount;
+}
+
+int CollideSwept( b2World* world, b2Shape* shape, const b2Transform& xform, const b2Vec2& localCenter, const b2Vec2& motion, const QueryFilter& filter, ShapeCastResult* results, int maxResults, SweepCache* cache )
+{
+	if( maxResults <= 0 )
+		return 0;
+	
+	ShapeCastBufferCollector collector(results, maxResults);
+	return CollideSweptStreaming(SweptSource(world), shape, xform, localCenter, motion, filter, &collector, cache, NULL);
+}
+
+int CollideSwept( b2World* world, b2Shape* shape, const b2Transform& xform, const b2Vec2& localCenter, const b2Vec2& motion, const QueryFilter& filter, QueryContext* context, ShapeCastResult** results, SweepCache* cache )
+{
+	QueryArray<ShapeCastResult> collisions(context);
+	ShapeCastArrayCollector collector(&collisions);
+	
+	int resultCount = CollideSweptStreaming(SweptSource(world), shape, xform, localCenter, motion, filter, &collector, cache, context);
+	
+	*results = collisions.GetData();
+	return resultCount;
+}
+
+int CollideSwept( b2World* world, b2Shape* shape, const b2Transform& xform, const b2Vec2& localCenter, const b2Vec2& motion, const QueryFilter& filter, ShapeCastCallback* callback, SweepCache* cache, QueryContext* context )
+{
+	return CollideSweptStreaming(SweptSource(world), shape, xform, localCenter, motion, filter, callback, cache, context);
+}
+
+int CollideSwept( const CategoryIndex* index, b2Shape* shape, const b2Transform& xform, const b2Vec2& localCenter, const b2Vec2& motion, const QueryFilter& filter, ShapeCastResult* results, int maxResults, SweepCache* cache )
+{
+	if( maxResults <= 0 )
+		return 0;
+	
+	ShapeCastBufferCollector collector(results, maxResults);
+	return CollideSweptStreaming(SweptSource(NULL, index), shape, xform, localCenter, motion, filter, &collector, cache, NULL);
+}
+
+// swept query policies for FindSweptHit
+struct ClosestSweptHitPolicy
+{
+	static const bool kStopAtFirstHit = false;
+};
+
+struct AnySweptHitPolicy
+{
+	static const bool kStopAtFirstHit = true;
+};
+
+// sweeps against the candidates nearest first, so any candidate whose AABB is reached after the
+// closest hit so far can be skipped, along with everything after it.  returns the fixture hit, its TOI
+// and the proxy of the child hit, and leaves the contact points to the caller since not every caller
+// wants them.
+template <class Policy>
+static b2Fixture* FindSweptHit( const SweptSource& source, b2Shape* shape, const b2DistanceProxy& proxy, const b2Transform& xform, const b2Vec2& localCenter, const b2Vec2& motion, const QueryFilter& filter, SweepCache* cache, QueryContext* scratch, float32* toi, b2DistanceProxy* hitProxy )
+{
+	// first do the broadphase query to collect any fixtures along our path
+	QueryArray<SweptCandidate> found(scratch);
+	GatherSweptCandidates(source, shape, xform, motion, filter, &found);
+	
+	b2AABB shapeAABB;
+	shape->ComputeAABB(&shapeAABB, xform, 0);
+	
+	// then work out where along the path each child is reached, dropping the ones that are never reached
+	QueryArray<SweptCandidate> candidates(scratch, found.GetCount());
+	
+	for( int foundIdx = 0; foundIdx < found.GetCount(); ++foundIdx )
+	{
+		SweptCandidate candidate = found[foundIdx];
+		b2Body* otherBody = candidate.fixture->GetBody();
+		
+		if( otherBody->GetUserData() != NULL && otherBody->GetUserData() == filter.ignored )
+		{
+			COLLISION_STATS_COUNT(e_statsFixturesFiltered, 1);
+			continue;
+		}
+		
+		b2AABB otherAABB;
+		candidate.fixture->GetShape()->ComputeAABB(&otherAABB, otherBody->GetTransform(), candidate.childIndex);
+		
+		if( ComputeSweptEntry(shapeAABB, motion, otherAABB, &candidate.entry) )
+			candidates.Push(candidate);
+	}
+	
+	std::sort(candidates.GetData(), candidates.GetData() + candidates.GetCount());
+	
+	b2Fixture* closest = NULL;
+	float smallestTOI = 1.0f;
+	
+	for( int candidateIdx = 0; candidateIdx < candidates.GetCount(); ++candidateIdx )
+	{
+		const SweptCandidate& candidate = candidates[candidateIdx];
+		
+		// everything from here on is reached after the closest hit
+		if( candidate.entry >= smallestTOI )
+			break;
+		
+		b2DistanceProxy proxyStorage;
+		const b2DistanceProxy& proxyOther = GetFixtureProxy(candidate.fixture, candidate.childIndex, cache, &proxyStorage);
+		
+		// now let's get a TOI on the collision
+		float32 t;
+		
+		if( ComputeFixtureTOI(shape, proxy, xform, localCenter, candidate.fixture, candidate.childIndex, proxyOther, motion, cache, &t) && t < smallestTOI )
+		{
+			closest = candidate.fixture;
+			smallestTOI = t;
+			CopyDistanceProxy(proxyOther, hitProxy);
+			
+			if( Policy::kStopAtFirstHit )
+				break;
+		}		
+	}
+	
+	*toi = smallestTOI;
+	return closest;
+}
+
+// runs FindSweptHit, then fills in whichever outputs the caller asked for
+template <class Policy>
+static bool CollideSweptHit( CollisionStatsQuery statsQuery, const SweptSource& source, b2Shape* shape, const b2Transform& xform, const b2Vec2& localCenter, const b2Vec2& motion, const QueryFilter& filter, ShapeCastResult* result, float32* toi, b2Fixture** fixture, SweepCache* cache, QueryContext* context )
+{
+	COLLISION_STATS_QUERY(statsQuery);
+	
+	QueryContext* scratch = context != NULL ? context : GetThreadQueryContext();
+	QueryContextScope scope(scratch);
+	
+	if( context != NULL )
+		scope.Release();
+	
+	// the query shape's proxy is built once, and the proxy of the child hit comes back for the contact
+	b2DistanceProxy proxy;
+	proxy.Set(shape, 0);
+	
+	float32 t;
+	b2DistanceProxy proxyOther;
+	b2Fixture* hit = FindSweptHit<Policy>(source, shape, proxy, xform, localCenter, motion, filter, cache, scratch, &t, &proxyOther);
+	
+	if( hit == NULL )
+		return false;
+	
+	if( result != NULL )
+		ComputeFixtureContact(proxy, xform, localCenter, hit, proxyOther, motion, t, result);
+	
+	if( toi != NULL )
+		*toi = t;
+	
+	if( fixture != NULL )
+		*fixture = hit;
+	
+	COLLISION_STATS_REPORTED(1);
+	return true;
+}
+
+bool CollideSweptClosest( b2World* world, b2Shape* shape, const b2Transform& xform, const b2Vec2& localCenter, const b2Vec2& motion, const QueryFilter& filter, ShapeCastResult* result, SweepCache* cache, QueryContext* context )
+{
+	return CollideSweptHit<ClosestSweptHitPolicy>(e_statsCollideSweptClosest, SweptSource(world), shape, xform, localCenter, motion, filter, result, NULL, NULL, cache, context);
+}
+
+bool CollideSweptAny( b2World* world, b2Shape* shape, const b2Transform& xform, const b2Vec2& localCenter, const b2Vec2& motion, const QueryFilter& filter, ShapeCastResult* result, SweepCache* cache, QueryContext* context )
+{
+	return CollideSweptHit<AnySweptHitPolicy>(e_statsCollideSweptAny, SweptSource(world), shape, xform, localCenter, motion, filter, result, NULL, NULL, cache, context);
+}
+
+bool CollideSweptTOI( b2World* world, b2Shape* shape, const b2Transform& xform, const b2Vec2& localCenter, const b2Vec2& motion, const QueryFilter& filter, float32* toi, b2Fixture** fixture, SweepCache* cache, QueryContext* context )
+{
+	return CollideSweptHit<ClosestSweptHitPolicy>(e_statsCollideSweptTOI, SweptSource(world), shape, xform, localCenter, motion, filter, NULL, toi, fixture, cache, context);
+}
+
+bool CollideSweptClosest( const CategoryIndex* index, b2Shape* shape, const b2Transform& xform, const b2Vec2& localCenter, const b2Vec2& motion, const QueryFilter& filter, ShapeCastResult* result, SweepCache* cache, QueryContext* context )
+{
+	return CollideSweptHit<ClosestSweptHitPolicy>(e_statsCollideSweptClosest, SweptSource(NULL, index), shape, xform, localCenter, motion, filter, result, NULL, NULL, cache, context);
+}
+
+bool CollideSweptAny( const CategoryIndex* index, b2Shape* shape, const b2Transform& xform, const b2Vec2& localCenter, const b2Vec2& motion, const QueryFilter& filter, ShapeCastResult* result, SweepCache* cache, QueryContext* context )
+{
+	return CollideSweptHit<AnySweptHitPolicy>(e_statsCollideSweptAny, SweptSource(NULL, index), shape, xform, localCenter, motion, filter, result, NULL, NULL, cache, context);
+}
+
+
+////////////////////////////////////////////////////////////////////////////
+// static BVH queries
+
+bool CollideRayClosest( b2World* world, const StaticBVH* statics, const b2Vec2& from, const b2Vec2& to, const QueryFilter& filter, RayCastResult* result )
+{
+	COLLISION_STATS_QUERY(e_statsCollideRayClosest);
+	
+	ClosestHitCollector collector(result);
+	CollideRayWith(world, statics, from, to, &collector, QueryFilterPolicy(filter));
+	
+	COLLISION_STATS_REPORTED(collector.mHit ? 1 : 0);
+	return collector.mHit;
+}
+
+bool CollideRayAny( b2World* world, const StaticBVH* statics, const b2Vec2& from, const b2Vec2& to, const QueryFilter& filter )
+{
+	COLLISION_STATS_QUERY(e_statsCollideRayAny);
+	
+	AnyHitCollector collector;
+	CollideRayWith(world, statics, from, to, &collector, QueryFilterPolicy(filter));
+	
+	COLLISION_STATS_REPORTED(collector.HasHit() ? 1 : 0);
+	return collector.HasHit();
+}
+
+int CollideRayNearest( b2World* world, const StaticBVH* statics, const b2Vec2& from, const b2Vec2& to, const QueryFilter& filter, RayCastResult* results, int maxResults )
+{
+	assert(results != NULL || maxResults <= 0);
+	
+	COLLISION_STATS_QUERY(e_statsCollideRayNearest);
+	
+	NearestHitsCollector collector(results, maxResults);
+	CollideRayWith(world, statics, from, to, &collector, QueryFilterPolicy(filter));
+	collector.Finish();
+	
+	COLLISION_STATS_REPORTED(collector.mResultCount);
+	return collector.mResultCount;
+}
+
+bool QueryNearest( b2World* world, const StaticBVH* statics, const b2Vec2& point, const QueryFilter& filter, float32 maxDistance, NearestResult* result )
+{
+	COLLISION_STATS_QUERY(e_statsQueryNearest);
+	
+	NearestCollector collector(point, maxDistance, result, 1);
+	int resultCount = FindNearest(world, statics, filter, &collector);
+	
+	COLLISION_STATS_REPORTED(resultCount);
+	return resultCount > 0;
+}
+
+bool QueryNearest( b2World* world, const StaticBVH* statics, const b2Shape* shape, const b2Transform& xform, const QueryFilter& filter, float32 maxDistance, NearestResult* result )
+{
+	COLLISION_STATS_QUERY(e_statsQueryNearest);
+	
+	NearestCollector collector(shape, xform, maxDistance, result, 1);
+	int resultCount = FindNearest(world, statics, filter, &collector);
+	
+	COLLISION_STATS_REPORTED(resultCount);
+	return resultCount > 0;
+}
+
+int QueryKNearest( b2World* world, const StaticBVH* statics, const b2Vec2& point, const QueryFilter& filter, float32 maxDistance, NearestResult* results, int k )
+{
+	COLLISION_STATS_QUERY(e_statsQueryKNearest);
+	
+	if( k <= 0 )
+		return 0;
+	
+	NearestCollector collector(point, maxDistance, results, k);
+	int resultCount = FindNearest(world, statics, filter, &collector);
+	
+	COLLISION_STATS_REPORTED(resultCount);
+	return resultCount;
+}
+
+int QueryKNearest( b2World* world, const StaticBVH* statics, const b2Shape* shape, const b2Transform& xform, const QueryFilter& filter, float32 maxDistance, NearestResult* results, int k )
+{
+	COLLISION_STATS_QUERY(e_statsQueryKNearest);
+	
+	if( k <= 0 )
+		return 0;
+	
+	NearestCollector collector(shape, xform, maxDistance, results, k);
+	int resultCount = FindNearest(world, statics, filter, &collector);
+	
+	COLLISION_STATS_REPORTED(resultCount);
+	return resultCount;
+}
+
+
+////////////////////////////////////////////////////////////////////////////
+// kinematic sweeps
+
+// the sweep of a body moving by its own velocities for dt
+static void BuildBodySweep( const b2Body* body, float32 dt, b2Sweep* sweep )
+{
+	BuildKinematicSweep(body->GetTransform(), body->GetLocalCenter(), dt * body->GetLinearVelocity(), dt * body->GetAngularVelocity(), sweep);
+}
+
+// the AABB of a shape at the start of its sweep.  a turning shape could be at any angle along the way,
+// so it gets a box around the circle it turns in instead.
+static b2AABB ComputeSweepStartAABB( const b2DistanceProxy& proxy, const b2AABB& startAABB, const b2Sweep& sweep )
+{
+	if( sweep.a == sweep.a0 )
+		return startAABB;
+	
+	float32 radiusSquared = 0.0f;
+	
+	for( int32 vertexIdx = 0; vertexIdx < proxy.GetVertexCount(); ++vertexIdx )
+		radiusSquared = b2Max(radiusSquared, (proxy.GetVertex(vertexIdx) - sweep.localCenter).LengthSquared());
+	
+	float32 radius = sqrtf(radiusSquared) + proxy.m_radius;
+	
+	b2AABB aabb;
+	aabb.lowerBound = sweep.c0 - b2Vec2(radius, radius);
+	aabb.upperBound = sweep.c0 + b2Vec2(radius, radius);
+	return aabb;
+}
+
+// collects the fixtures the swept shape's AABB passes through.  the path is tested relative to each
+// candidate's body, so a body moving across the path is found and one moving along with it isn't.
+class KinematicSweptQuery
+{
+public:
+	KinematicSweptQuery( const b2BroadPhase* broadPhase, const b2AABB& shapeAABB, const b2Vec2& linear, float32 dt, const QueryFilter& filter, SweepCache* cache, QueryArray<SweptCandidate>* candidates )
+	: mBroadPhase(broadPhase)
+	, mShapeAABB(shapeAABB)
+	, mLinear(linear)
+	, mDt(dt)
+	, mFilter(filter)
+	, mCache(cache)
+	, mCandidates(candidates)
+	{
+	}
+	
+	bool QueryCallback( int32 proxyId )
+	{
+		b2FixtureProxy* proxy = (b2FixtureProxy*)mBroadPhase->GetUserData(proxyId);
+		b2Fixture* fixture = proxy->fixture;
+		b2Body* body = fixture->GetBody();
+		
+		COLLISION_STATS_COUNT(e_statsCandidates, 1);
+		
+		if( !mFilter.test(fixture->GetFilterData()) || (body->GetUserData() != NULL && body->GetUserData() == mFilter.ignored) )
+		{
+			COLLISION_STATS_COUNT(e_statsFixturesFiltered, 1);
+			return true;
+		}
+		
+		b2Vec2 relativeMotion = mLinear;
+		b2AABB otherAABB = proxy->aabb;
+		
+		if( mDt > 0.0f && body->GetType() != b2_staticBody )
+		{
+			b2Sweep otherSweep;
+			BuildBodySweep(body, mDt, &otherSweep);
+			
+			relativeMotion -= otherSweep.c - otherSweep.c0;
+			
+			b2DistanceProxy proxyStorage;
+			const b2DistanceProxy& otherProxy = GetFixtureProxy(fixture, proxy->childIndex, mCache, &proxyStorage);
+			otherAABB = ComputeSweepStartAABB(otherProxy, otherAABB, otherSweep);
+		}
+		
+		SweptCandidate candidate;
+		candidate.fixture = fixture;
+		candidate.childIndex = proxy->childIndex;
+		
+		if( ComputeSweptEntry(mShapeAABB, relativeMotion, otherAABB, &candidate.entry) )
+			mCandidates->Push(candidate);
+		
+		return true;
+	}
+	
+	const b2BroadPhase* mBroadPhase;
+	b2AABB mShapeAABB;
+	b2Vec2 mLinear;
+	float32 mDt;
+	QueryFilter mFilter;
+	SweepCache* mCache;
+	QueryArray<SweptCandidate>* mCandidates;
+};
+
+// collect the fixture children the sweep may hit, nearest first
+static void GatherKinematicCandidates( b2World* world, b2Shape* shape, const b2Transform& xform, const b2DistanceProxy& proxy, const b2Sweep& sweep, const SweptMotion& motion, const QueryFilter& filter, SweepCache* cache, QueryArray<SweptCandidate>* candidates )
+{
+	b2AABB startAABB;
+	shape->ComputeAABB(&startAABB, xform, 0);
+	
+	b2AABB shapeAABB = ComputeSweepStartAABB(proxy, startAABB, sweep);
+	
+	// bodies moving into the path can start up to maxOtherSpeed * dt away from it
+	float32 margin = motion.dt > 0.0f ? motion.dt * motion.maxOtherSpeed : 0.0f;
+	
+	b2AABB queryAABB;
+	queryAABB.lowerBound = shapeAABB.lowerBound + b2Min(b2Vec2(0.0f, 0.0f), motion.linear) - b2Vec2(margin, margin);
+	queryAABB.upperBound = shapeAABB.upperBound + b2Max(b2Vec2(0.0f, 0.0f), motion.linear) + b2Vec2(margin, margin);
+	
+	const b2BroadPhase* broadPhase = &world->GetContactManager().m_broadPhase;
+	KinematicSweptQuery query(broadPhase, shapeAABB, motion.linear, motion.dt, filter, cache, candidates);
+	broadPhase->Query(&query, queryAABB);
+	
+	// each child has a single proxy in the broadphase, so there are no duplicates to remove
+	std::sort(candidates->GetData(), candidates->GetData() + candidates->GetCount());
+}
+
+// TOI of the sweep against a fixture whose body moves by its velocities for dt
+static bool ComputeKinematicTOI( const b2DistanceProxy& proxy, const b2Sweep& sweep, b2Fixture* otherFixture, const b2DistanceProxy& proxyOther, float32 dt, float32* t )
+{
+	b2Body* otherBody = otherFixture->GetBody();
+	
+	b2Sweep otherSweep;
+	BuildBodySweep(otherBody, dt, &otherSweep);
+	
+	return ComputeSweptTOI(proxy, proxyOther, sweep, otherSweep, t);
+}
+
+// the contact at time t, with the other body moved to where it is by then
+static void ComputeKinematicContact( const b2DistanceProxy& proxy, const b2Sweep& sweep, b2Fixture* otherFixture, const b2DistanceProxy& proxyOther, float32 dt, float32 t, ShapeCastResult* result )
+{
+	b2Sweep otherSweep;
+	BuildBodySweep(otherFixture->GetBody(), dt, &otherSweep);
+	
+	b2Transform xformOther;
+	otherSweep.GetTransform(&xformOther, t);
+	
+	ComputeSweptContact(proxy, proxyOther, sweep, t, xformOther, result);
+	result->fixture = otherFixture;
+}
+
+bool CollideSwept( b2Shape* shape, const b2Transform& xform, const b2Vec2& localCenter, b2Fixture* otherFixture, const SweptMotion& motion, ShapeCastResult* result, SweepCache* cache )
+{
+	COLLISION_STATS_QUERY(e_statsCollideSweptPair);
+	
+	b2Sweep sweep;
+	BuildKinematicSweep(xform, localCenter, motion.linear, motion.angular, &sweep);
+	
+	b2DistanceProxy proxy;
+	proxy.Set(shape, 0);
+	
+	float32 dt = b2Max(motion.dt, 0.0f);
+	const b2Shape* otherShape = otherFixture->GetShape();
+	
+	// the earliest hit against any child of the fixture
+	float32 smallestTOI = 1.0f;
+	b2DistanceProxy hitProxy;
+	bool hit = false;
+	
+	for( int32 childIdx = 0; childIdx < otherShape->GetChildCount(); ++childIdx )
+	{
+		b2DistanceProxy proxyStorage;
+		const b2DistanceProxy& proxyOther = GetFixtureProxy(otherFixture, childIdx, cache, &proxyStorage);
+		
+		float32 t;
+		
+		if( ComputeKinematicTOI(proxy, sweep, otherFixture, proxyOther, dt, &t) && (!hit || t < smallestTOI) )
+		{
+			smallestTOI = t;
+			CopyDistanceProxy(proxyOther, &hitProxy);
+			hit = true;
+		}
+	}
+	
+	if( !hit )
+		return false;
+	
+	if( result != NULL )
+		ComputeKinematicContact(proxy, sweep, otherFixture, hitProxy, dt, smallestTOI, result);
+	
+	COLLISION_STATS_REPORTED(1);
+	return true;
+}
+
+int CollideSwept( b2World* world, b2Shape* shape, const b2Transform& xform, const b2Vec2& localCenter, const SweptMotion& motion, const QueryFilter& filter, ShapeCastResult* results, int maxResults, SweepCache* cache, QueryContext* context )
+{
+	COLLISION_STATS_QUERY(e_statsCollideSwept);
+	
+	if( maxResults <= 0 )
+		return 0;
+	
+	QueryContext* scratch = context != NULL ? context : GetThreadQueryContext();
+	QueryContextScope scope(scratch);
+	
+	if( context != NULL )
+		scope.Release();
+	
+	b2Sweep sweep;
+	BuildKinematicSweep(xform, localCenter, motion.linear, motion.angular, &sweep);
+	
+	b2DistanceProxy proxy;
+	proxy.Set(shape, 0);
+	
+	QueryArray<SweptCandidate> candidates(scratch);
+	GatherKinematicCandidates(world, shape, xform, proxy, sweep, motion, filter, cache, &candidates);
+	
+	// the hits reuse the candidate struct with their TOI as the entry, so they sort the same way
+	float32 dt = b2Max(motion.dt, 0.0f);
+	QueryArray<SweptCandidate> hits(scratch);
+	
+	for( int candidateIdx = 0; candidateIdx < candidates.GetCount(); ++candidateIdx )
+	{
+		SweptCandidate hit = candidates[candidateIdx];
+		
+		b2DistanceProxy proxyStorage;
+		const b2DistanceProxy& proxyOther = GetFixtureProxy(hit.fixture, hit.childIndex, cache, &proxyStorage);
+		
+		if( ComputeKinematicTOI(proxy, sweep, hit.fixture, proxyOther, dt, &hit.entry) )
+			hits.Push(hit);
+	}
+	
+	std::sort(hits.GetData(), hits.GetData() + hits.GetCount());
+	
+	if( hits.GetCount() > maxResults )
+	{
+		COLLISION_STATS_COUNT(e_statsResultBufferFull, 1);
+		hits.Truncate(maxResults);
+	}
+	
+	// only the hits kept get their proxy again for the contact
+	for( int hitIdx = 0; hitIdx < hits.GetCount(); ++hitIdx )
+	{
+		b2DistanceProxy proxyStorage;
+		const b2DistanceProxy& proxyOther = GetFixtureProxy(hits[hitIdx].fixture, hits[hitIdx].childIndex, cache, &proxyStorage);
+		
+		ComputeKinematicContact(proxy, sweep, hits[hitIdx].fixture, proxyOther, dt, hits[hitIdx].entry, &results[hitIdx]);
+	}
+	
+	COLLISION_STATS_REPORTED(hits.GetCount());
+	return hits.GetCount();
+}
+
+// like FindSweptHit, nearest candidates first, skipping those reached after the closest hit so far
+template <class Policy>
+static bool CollideKinematicHit( CollisionStatsQuery statsQuery, b2World* world, b2Shape* shape, const b2Transform& xform, const b2Vec2& localCenter, const SweptMotion& motion, const QueryFilter& filter, ShapeCastResult* result, SweepCache* cache, QueryContext* context )
+{
+	COLLISION_STATS_QUERY(statsQuery);
+	
+	QueryContext* scratch = context != NULL ? context : GetThreadQueryContext();
+	QueryContextScope scope(scratch);
+	
+	if( context != NULL )
+		scope.Release();
+	
+	b2Sweep sweep;
+	BuildKinematicSweep(xform, localCenter, motion.linear, motion.angular, &sweep);
+	
+	b2DistanceProxy proxy;
+	proxy.Set(shape, 0);
+	
+	QueryArray<SweptCandidate> candidates(scratch);
+	GatherKinematicCandidates(world, shape, xform, proxy, sweep, motion, filter, cache, &candidates);
+	
+	float32 dt = b2Max(motion.dt, 0.0f);
+	b2Fixture* closest = NULL;
+	float32 smallestTOI = 1.0f;
+	b2DistanceProxy hitProxy;
+	
+	for( int candidateIdx = 0; candidateIdx < candidates.GetCount(); ++candidateIdx )
+	{
+		const SweptCandidate& candidate = candidates[candidateIdx];
+		
+		if( candidate.entry >= smallestTOI )
+			break;
+		
+		b2DistanceProxy proxyStorage;
+		const b2DistanceProxy& proxyOther = GetFixtureProxy(candidate.fixture, candidate.childIndex, cache, &proxyStorage);
+		
+		float32 t;
+		
+		if( ComputeKinematicTOI(proxy, sweep, candidate.fixture, proxyOther, dt, &t) && t < smallestTOI )
+		{
+			closest = candidate.fixture;
+			smallestTOI = t;
+			CopyDistanceProxy(proxyOther, &hitProxy);
+			
+			if( Policy::kStopAtFirstHit )
+				break;
+		}
+	}
+	
+	if( closest == NULL )
+		return false;
+	
+	if( result != NULL )
+		ComputeKinematicContact(proxy, sweep, closest, hitProxy, dt, smallestTOI, result);
+	
+	COLLISION_STATS_REPORTED(1);
+	return true;
+}
+
+bool CollideSweptClosest( b2World* world, b2Shape* shape, const b2Transform& xform, const b2Vec2& localCenter, const SweptMotion& motion, const QueryFilter& filter, ShapeCastResult* result, SweepCache* cache, QueryContext* context )
+{
+	return CollideKinematicHit<ClosestSweptHitPolicy>(e_statsCollideSweptClosest, world, shape, xform, localCenter, motion, filter, result, cache, context);
+}
+
+bool CollideSweptAny( b2World* world, b2Shape* shape, const b2Transform& xform, const b2Vec2& localCenter, const SweptMotion& motion, const QueryFilter& filter, ShapeCastResult* result, SweepCache* cache, QueryContext* context )
+{
+	return CollideKinematicHit<AnySweptHitPolicy>(e_statsCollideSweptAny, world, shape, xform, localCenter, motion, filter, result, cache, context);
+}
@@ -28,8 +28,13 @@
 #define _COLLISIONUTIL_H_INCLUDED_
 
 #include "Box2D.h"
+#include "QueryContext.h"
 
 
+class CategoryIndex;
+class SweepCache;
+class StaticBVH;
+
 // filter data for collision util queries.
 struct QueryFilter
 {
@@ -42,12 +47,12 @@ struct QueryFilter
 	{
 	}
 	
-	inline bool test(unsigned short maskBits, unsigned short categoryBits = 0)
+	inline bool test(unsigned short maskBits, unsigned short categoryBits = 0) const
 	{
 		return (maskBits & maskFilter) != 0 || (categoryBits & categoryFilter) != 0 ;
 	}
 	
-	inline bool test(const b2Filter& filter)
+	inline bool test(const b2Filter& filter) const
 	{
 		return test( filter.maskBits, filter.categoryBits );
 	}
@@ -64,6 +69,56 @@ struct QueryFilter
 // collects all fixtures that match the filter category intersecting the specified AABB
 int QueryAABB(b2World* world, const b2AABB& aabb, const QueryFilter& filter, b2Fixture** results, int maxResults );
 
+// collects all fixtures that match the filter category intersecting the specified AABB, with no limit on the count.
+// *results points into the context and stays valid until the context is reset.
+int QueryAABB(b2World* world, const b2AABB& aabb, const QueryFilter& filter, QueryContext* context, b2Fixture*** results );
+
+
+////////////////////////////////////////////////////////////////////////////
+// shape overlap query
+
+// collects the fixtures whose shapes actually overlap the shape at xform, not just their AABBs, up to maxResults.
+// fixtures on the filter's ignored body are skipped.  each fixture is returned once, in no particular order.
+int QueryShape( b2World* world, const b2Shape* shape, const b2Transform& xform, const QueryFilter& filter, b2Fixture** results, int maxResults );
+
+// same, with no limit on the count.  *results points into the context and stays valid until the context is reset.
+int QueryShape( b2World* world, const b2Shape* shape, const b2Transform& xform, const QueryFilter& filter, QueryContext* context, b2Fixture*** results );
+
+struct ShapeProbe
+{
+	const b2Shape* shape;
+	b2Transform xform;
+};
+
+// runs QueryShape for each probe.  the fixtures overlapping probes[i] are (*results)[resultStarts[i]] up to,
+// but not including, (*results)[resultStarts[i + 1]], so resultStarts must hold probeCount + 1 entries.
+// consecutive probes that are close together share one broadphase walk, like the rays of CollideRayBatch.
+// *results points into the context and stays valid until the context is reset.  returns the total result count.
+int QueryShapeBatch( b2World* world, const ShapeProbe* probes, int probeCount, const QueryFilter& filter, QueryContext* context, b2Fixture*** results, int* resultStarts );
+
+
+////////////////////////////////////////////////////////////////////////////
+// nearest fixture queries
+
+struct NearestResult
+{
+	b2Fixture* fixture;
+	float32 distance;		// between the surfaces, 0 if they overlap
+	b2Vec2 point;			// nearest point on the query point or shape
+	b2Vec2 fixturePoint;	// nearest point on the fixture
+};
+
+// finds the fixture nearest a point, or a shape at xform, no farther away than maxDistance.
+// candidates are measured nearest AABB first, and the search stops at the first AABB farther away
+// than the nearest fixture measured so far, so most candidates never get a b2Distance call.
+// fixtures on the filter's ignored body are skipped.
+bool QueryNearest( b2World* world, const b2Vec2& point, const QueryFilter& filter, float32 maxDistance, NearestResult* result );
+bool QueryNearest( b2World* world, const b2Shape* shape, const b2Transform& xform, const QueryFilter& filter, float32 maxDistance, NearestResult* result );
+
+// finds up to k fixtures nearest a point or shape, nearest first.  returns the number found.
+int QueryKNearest( b2World* world, const b2Vec2& point, const QueryFilter& filter, float32 maxDistance, NearestResult* results, int k );
+int QueryKNearest( b2World* world, const b2Shape* shape, const b2Transform& xform, const QueryFilter& filter, float32 maxDistance, NearestResult* results, int k );
+
 
 
 
@@ -85,6 +140,29 @@ int CollideRay( b2World* world, const b2Vec2& from, const b2Vec2& to, const Quer
 // returns the closest collision along specified ray
 bool CollideRayClosest( b2World* world, const b2Vec2& from, const b2Vec2& to, const QueryFilter& filter, RayCastResult* result);
 
+// returns true if anything along the ray matches the filter.  stops at the first hit, so it is the
+// cheapest way to check line of sight.  see QueryPolicies.h to build other kinds of ray query.
+bool CollideRayAny( b2World* world, const b2Vec2& from, const b2Vec2& to, const QueryFilter& filter );
+
+// returns up to maxResults of the collisions nearest the start of the ray, sorted nearest first.
+// once maxResults hits are held the ray is clipped at the farthest of them, so the rest of the
+// world past it is never visited.  use this rather than CollideRay when only the first few surfaces
+// matter, e.g. for a projectile that passes through a few walls.
+int CollideRayNearest( b2World* world, const b2Vec2& from, const b2Vec2& to, const QueryFilter& filter, RayCastResult* results, int maxResults );
+
+
+struct RaySegment
+{
+	b2Vec2 from;
+	b2Vec2 to;
+};
+
+// returns the closest collision along each of the specified rays, same as calling CollideRayClosest once per ray.
+// results must hold rayCount entries; results[i] belongs to rays[i] and has a NULL fixture if that ray hit nothing.
+// consecutive rays that are close together (fans, bundles, grids) are grouped and share one broadphase walk,
+// so submit rays in a spatially coherent order to get the most out of it.  returns the number of rays that hit.
+int CollideRayBatch( b2World* world, const RaySegment* rays, int rayCount, const QueryFilter& filter, RayCastResult* results );
+
 
 
 ////////////////////////////////////////////////////////////////////////////
@@ -98,17 +176,160 @@ struct ShapeCastResult
 	b2Fixture* fixture;
 };
 
+// receives the collisions of a swept shape one at a time, see the streaming CollideSwept below
+class ShapeCastCallback
+{
+public:
+	virtual ~ShapeCastCallback() {}
+	
+	// return false to stop the query
+	virtual bool ReportShapeCast( const ShapeCastResult& result ) = 0;
+};
+
+// in every swept query xform is the shape's body transform and localCenter the body's center of mass
+// in body coordinates, as b2Body::GetTransform and b2Body::GetLocalCenter give them.  the shape starts
+// the sweep at xform, and ShapeCastResult::toi is where xform's position is at the time of impact.
+// the same goes for xformOther and localCenterOther, and for the kinematic sweeps below.
 
 // sweep a shape against another known shape
 bool CollideSwept( b2Shape* shape, const b2Transform& xform, const b2Vec2& localCenter, b2Shape* shapeOther, const b2Transform& xformOther, const b2Vec2& localCenterOther, const b2Vec2& motion, ShapeCastResult* result );
 
-// sweep a shape against another known shape in the world
-bool CollideSwept( b2Shape* shape, const b2Transform& xform, const b2Vec2& localCenter, b2Fixture* otherFixture, const b2Vec2& motion, ShapeCastResult* result );
+// same, with distance proxies the caller has already built
+bool CollideSwept( const b2DistanceProxy& proxy, const b2Transform& xform, const b2Vec2& localCenter, const b2DistanceProxy& proxyOther, const b2Transform& xformOther, const b2Vec2& localCenterOther, const b2Vec2& motion, ShapeCastResult* result );
+
+// the queries below optionally take a SweepCache (see SweepCache.h), which remembers
+// separating axes and simplices between frames to skip TOI work against fixtures the shape can't reach,
+// and keeps the proxies of the fixture children swept against so they aren't rebuilt by every query.
+
+// sweep a shape against another known shape in the world.  every child of a chain fixture is tested,
+// and the earliest hit is returned.
+bool CollideSwept( b2Shape* shape, const b2Transform& xform, const b2Vec2& localCenter, b2Fixture* otherFixture, const b2Vec2& motion, ShapeCastResult* result, SweepCache* cache = NULL );
+
+// same, but only returns the fraction of motion at which the shape touches the fixture
+bool CollideSweptTOI( b2Shape* shape, const b2Transform& xform, const b2Vec2& localCenter, b2Fixture* otherFixture, const b2Vec2& motion, float32* toi, SweepCache* cache = NULL );
+
+// same as the two above, against one child of the fixture, with distance proxies the caller has already built.
+// proxyOther must have been built from child childIndex of the fixture's shape, and shape is only used
+// to key the SweepCache, so it may be NULL when cache is.  for callers that sweep against the same
+// fixtures several times, like MoveAndSlide, which builds its proxies once per move.
+bool CollideSwept( const b2Shape* shape, const b2DistanceProxy& proxy, const b2Transform& xform, const b2Vec2& localCenter, b2Fixture* otherFixture, int32 childIndex, const b2DistanceProxy& proxyOther, const b2Vec2& motion, ShapeCastResult* result, SweepCache* cache = NULL );
+bool CollideSweptTOI( const b2Shape* shape, const b2DistanceProxy& proxy, const b2Transform& xform, const b2Vec2& localCenter, b2Fixture* otherFixture, int32 childIndex, const b2DistanceProxy& proxyOther, const b2Vec2& motion, float32* toi, SweepCache* cache = NULL );
+
+// the queries below that take a b2World* consider every fixture along the path, however many there are.
+// they keep their candidate lists in a QueryContext; if none is given they use the calling thread's own.
+
+// return all collisions along the path of a swept shape, up to maxResults
+int CollideSwept( b2World* world, b2Shape* shape, const b2Transform& xform, const b2Vec2& localCenter, const b2Vec2& motion, const QueryFilter& filter, ShapeCastResult* results, int maxResults, SweepCache* cache = NULL );
 
-// return all collisions along the path of a swept shape
-int CollideSwept( b2World* world, b2Shape* shape, const b2Transform& xform, const b2Vec2& localCenter, const b2Vec2& motion, const QueryFilter& filter, ShapeCastResult* results, int maxResults );
+// return all collisions along the path of a swept shape.
+// *results points into the context and stays valid until the context is reset.
+int CollideSwept( b2World* world, b2Shape* shape, const b2Transform& xform, const b2Vec2& localCenter, const b2Vec2& motion, const QueryFilter& filter, QueryContext* context, ShapeCastResult** results, SweepCache* cache = NULL );
+
+// report collisions along the path of a swept shape to the callback as they are found, in no particular order.
+// returns the number of collisions reported.
+int CollideSwept( b2World* world, b2Shape* shape, const b2Transform& xform, const b2Vec2& localCenter, const b2Vec2& motion, const QueryFilter& filter, ShapeCastCallback* callback, SweepCache* cache = NULL, QueryContext* context = NULL );
 
 // returns the closest collision along the path of a swept shape
-bool CollideSweptClosest( b2World* world, b2Shape* shape, const b2Transform& xform, const b2Vec2& localCenter, const b2Vec2& motion, const QueryFilter& filter, ShapeCastResult* result );
+// candidates are tested nearest first, so fixtures beyond the closest hit found so far cost no TOI.
+bool CollideSweptClosest( b2World* world, b2Shape* shape, const b2Transform& xform, const b2Vec2& localCenter, const b2Vec2& motion, const QueryFilter& filter, ShapeCastResult* result, SweepCache* cache = NULL, QueryContext* context = NULL );
+
+// returns true if the swept shape hits anything at all.  stops at the first hit, and since candidates
+// are tested nearest first that's usually, but not necessarily, the closest one.  result may be NULL.
+bool CollideSweptAny( b2World* world, b2Shape* shape, const b2Transform& xform, const b2Vec2& localCenter, const b2Vec2& motion, const QueryFilter& filter, ShapeCastResult* result = NULL, SweepCache* cache = NULL, QueryContext* context = NULL );
+
+// finds the closest collision like CollideSweptClosest, but only returns the fraction of motion at which it
+// happens and the fixture hit, skipping the distance query that works out the contact point and normal.
+bool CollideSweptTOI( b2World* world, b2Shape* shape, const b2Transform& xform, const b2Vec2& localCenter, const b2Vec2& motion, const QueryFilter& filter, float32* toi, b2Fixture** fixture = NULL, SweepCache* cache = NULL, QueryContext* context = NULL );
+
+
+
+////////////////////////////////////////////////////////////////////////////
+// category index queries
+//
+// same as the queries above, but searching a CategoryIndex (see CategoryIndex.h) instead of the
+// world's broadphase, so only fixtures with filter data that can pass the filter are visited.
+
+int QueryAABB( const CategoryIndex* index, const b2AABB& aabb, const QueryFilter& filter, b2Fixture** results, int maxResults );
+
+int CollideRay( const CategoryIndex* index, const b2Vec2& from, const b2Vec2& to, const QueryFilter& filter, RayCastResult* results, int maxResults );
+bool CollideRayClosest( const CategoryIndex* index, const b2Vec2& from, const b2Vec2& to, const QueryFilter& filter, RayCastResult* result );
+bool CollideRayAny( const CategoryIndex* index, const b2Vec2& from, const b2Vec2& to, const QueryFilter& filter );
+int CollideRayNearest( const CategoryIndex* index, const b2Vec2& from, const b2Vec2& to, const QueryFilter& filter, RayCastResult* results, int maxResults );
+
+int CollideSwept( const CategoryIndex* index, b2Shape* shape, const b2Transform& xform, const b2Vec2& localCenter, const b2Vec2& motion, const QueryFilter& filter, ShapeCastResult* results, int maxResults, SweepCache* cache = NULL );
+bool CollideSweptClosest( const CategoryIndex* index, b2Shape* shape, const b2Transform& xform, const b2Vec2& localCenter, const b2Vec2& motion, const QueryFilter& filter, ShapeCastResult* result, SweepCache* cache = NULL, QueryContext* context = NULL );
+bool CollideSweptAny( const CategoryIndex* index, b2Shape* shape, const b2Transform& xform, const b2Vec2& localCenter, const b2Vec2& motion, const QueryFilter& filter, ShapeCastResult* result = NULL, SweepCache* cache = NULL, QueryContext* context = NULL );
+
+
+////////////////////////////////////////////////////////////////////////////
+// static BVH queries
+//
+// same as the world queries above, but static fixtures are found through a StaticBVH (see StaticBVH.h)
+// built from the world first, and what it finds bounds the walk of the world's broadphase for the rest:
+// rays are clipped at the static hit and nearest queries start from the static distance.  the world's
+// broadphase still holds the static proxies, so queries that can't be bounded that way (all hits along
+// a ray, AABB and swept queries) have no overloads here, they'd only walk more than the world queries.
+
+bool CollideRayClosest( b2World* world, const StaticBVH* statics, const b2Vec2& from, const b2Vec2& to, const QueryFilter& filter, RayCastResult* result );
+bool CollideRayAny( b2World* world, const StaticBVH* statics, const b2Vec2& from, const b2Vec2& to, const QueryFilter& filter );
+int CollideRayNearest( b2World* world, const StaticBVH* statics, const b2Vec2& from, const b2Vec2& to, const QueryFilter& filter, RayCastResult* results, int maxResults );
+
+bool QueryNearest( b2World* world, const StaticBVH* statics, const b2Vec2& point, const QueryFilter& filter, float32 maxDistance, NearestResult* result );
+bool QueryNearest( b2World* world, const StaticBVH* statics, const b2Shape* shape, const b2Transform& xform, const QueryFilter& filter, float32 maxDistance, NearestResult* result );
+int QueryKNearest( b2World* world, const StaticBVH* statics, const b2Vec2& point, const QueryFilter& filter, float32 maxDistance, NearestResult* results, int k );
+int QueryKNearest( b2World* world, const StaticBVH* statics, const b2Shape* shape, const b2Transform& xform, const QueryFilter& filter, float32 maxDistance, NearestResult* results, int k );
+
+
+////////////////////////////////////////////////////////////////////////////
+// kinematic sweeps
+//
+// the swept queries above move the shape in a straight line without turning it, against fixtures that
+// stay where they are.  these ones rotate the shape as it moves and, given a time step, move every
+// body found along the way by its own velocities, all in a single TOI per fixture.
+
+struct SweptMotion
+{
+	SweptMotion()
+	: linear(0.0f, 0.0f)
+	, angular(0.0f)
+	, dt(0.0f)
+	, maxOtherSpeed(0.0f)
+	{
+	}
+	
+	explicit SweptMotion( const b2Vec2& l, float32 a = 0.0f, float32 t = 0.0f )
+	: linear(l)
+	, angular(a)
+	, dt(t)
+	, maxOtherSpeed(0.0f)
+	{
+	}
+	
+	// motion of the shape's center of mass, and how far it turns, over the sweep
+	b2Vec2 linear;
+	float32 angular;
+	
+	// if greater than 0, other bodies move by their linear and angular velocities times dt over the
+	// sweep.  0 treats them as stationary.
+	float32 dt;
+	
+	// the broadphase bounds are grown by maxOtherSpeed * dt to find bodies that move into the path.
+	// box2d already stretches a moving body's AABB along its last step, so 0 is enough for a dt of
+	// about one step.
+	float32 maxOtherSpeed;
+};
+
+// xform and localCenter mean the same as in the swept queries above, at the start of the sweep.
+// a SweepCache given to these only supplies the fixture proxies; its separating axes assume a shape
+// that doesn't turn, so they aren't used.
+
+// sweep a rotating shape against a fixture, moving the fixture's body by its velocities if motion.dt > 0
+bool CollideSwept( b2Shape* shape, const b2Transform& xform, const b2Vec2& localCenter, b2Fixture* otherFixture, const SweptMotion& motion, ShapeCastResult* result, SweepCache* cache = NULL );
+
+// return all collisions along the sweep, nearest first, up to maxResults
+int CollideSwept( b2World* world, b2Shape* shape, const b2Transform& xform, const b2Vec2& localCenter, const SweptMotion& motion, const QueryFilter& filter, ShapeCastResult* results, int maxResults, SweepCache* cache = NULL, QueryContext* context = NULL );
+
+bool CollideSweptClosest( b2World* world, b2Shape* shape, const b2Transform& xform, const b2Vec2& localCenter, const SweptMotion& motion, const QueryFilter& filter, ShapeCastResult* result, SweepCache* cache = NULL, QueryContext* context = NULL );
+bool CollideSweptAny( b2World* world, b2Shape* shape, const b2Transform& xform, const b2Vec2& localCenter, const SweptMotion& motion, const QueryFilter& filter, ShapeCastResult* result = NULL, SweepCache* cache = NULL, QueryContext* context = NULL );
 
 #endif
\ No newline at end of file
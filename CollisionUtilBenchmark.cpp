@@ -0,0 +1,896 @@
+//
+//	CollisionUtilBenchmark.cpp
+//
+//	Created by Aaron Pendley on 4/9/10.
+//	Copyright 2010 Aaron Pendley.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+// 
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+// 
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+
+//  Benchmarks for the CollisionUtil queries against synthetic worlds.
+//
+//  Build it with the rest of the CollisionUtil sources and Box2D, e.g.
+//    c++ -O2 -std=c++11 -I<box2d> *.cpp <libBox2D> -o CollisionUtilBenchmark
+//  (leave out any other file with a main, and add -mavx2 for the 8 wide ray kernels)
+//
+//  usage: CollisionUtilBenchmark [output.json] [maxFixtures] [queriesPerRun]
+//
+//  every world generator is run at 100, 1k, 10k and 100k fixtures (up to maxFixtures), and every
+//  query type is timed against each world.  before that, the RayKernels are timed per shape type
+//  against b2Shape::RayCast.  the results go to output.json, or stdout.  worlds and queries come
+//  from a fixed seed, so runs of different versions can be compared directly.
+
+#include "CollisionUtil.h"
+#include "QueryContext.h"
+#include "QueryPolicies.h"
+#include "RayKernels.h"
+#include "RenderExtract.h"
+#include "StaticBVH.h"
+#include "SweepCache.h"
+
+#include <chrono>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+
+////////////////////////////////////////////////////////////////////////////
+// allocation counting
+
+static unsigned long long sAllocationCount = 0;
+
+void* operator new( size_t size )
+{
+	sAllocationCount++;
+	
+	void* memory = malloc(size > 0 ? size : 1);
+	
+	if( memory == NULL )
+		throw std::bad_alloc();
+	
+	return memory;
+}
+
+void operator delete( void* memory ) noexcept
+{
+	free(memory);
+}
+
+// heap allocations made through operator new and by the thread's query context.
+// b2Alloc goes straight to malloc and isn't counted.
+static unsigned long long GetAllocationCount()
+{
+	return sAllocationCount + (unsigned long long)GetThreadQueryContext()->GetHeapAllocationCount();
+}
+
+
+////////////////////////////////////////////////////////////////////////////
+// random numbers, fixed so every run builds the same worlds and queries
+
+class Random
+{
+public:
+	explicit Random( unsigned int seed ) : mState(seed * 2654435761u + 1) {}
+	
+	unsigned int Next()
+	{
+		// xorshift32
+		mState ^= mState << 13;
+		mState ^= mState >> 17;
+		mState ^= mState << 5;
+		return mState;
+	}
+	
+	float32 Range( float32 low, float32 high )
+	{
+		return low + (high - low) * ((float32)(Next() & 0xFFFFFF) / (float32)0xFFFFFF);
+	}
+	
+	b2Vec2 Point( const b2AABB& bounds )
+	{
+		return b2Vec2(Range(bounds.lowerBound.x, bounds.upperBound.x), Range(bounds.lowerBound.y, bounds.upperBound.y));
+	}
+	
+private:
+	unsigned int mState;
+};
+
+
+////////////////////////////////////////////////////////////////////////////
+// world generators
+
+// categories fixtures are spread over, so filtered queries have something to filter
+static const uint16 kCategoryTerrain = 0x0001;
+static const uint16 kCategoryProps = 0x0002;
+static const uint16 kCategoryEnemies = 0x0004;
+static const uint16 kCategoryPickups = 0x0008;
+
+struct BenchmarkWorld
+{
+	BenchmarkWorld()
+	: world(NULL)
+	, fixtureCount(0)
+	{
+	}
+	
+	~BenchmarkWorld()
+	{
+		delete world;
+	}
+	
+	const char* name;
+	b2World* world;
+	b2AABB bounds;
+	int fixtureCount;
+};
+
+static uint16 RandomCategory( Random& random )
+{
+	static const uint16 categories[] = { kCategoryTerrain, kCategoryProps, kCategoryEnemies, kCategoryPickups };
+	return categories[random.Next() % 4];
+}
+
+static void AddShape( b2Body* body, Random& random, uint16 category, float32 size )
+{
+	b2FixtureDef fixtureDef;
+	fixtureDef.density = 1.0f;
+	fixtureDef.filter.categoryBits = category;
+	fixtureDef.filter.maskBits = 0xFFFF;
+	
+	b2PolygonShape polygon;
+	b2CircleShape circle;
+	
+	switch( random.Next() % 3 )
+	{
+		case 0:
+			polygon.SetAsBox(size * random.Range(0.3f, 1.0f), size * random.Range(0.3f, 1.0f));
+			fixtureDef.shape = &polygon;
+			break;
+			
+		case 1:
+		{
+			b2Vec2 vertices[5];
+			
+			for( int vertexIdx = 0; vertexIdx < 5; ++vertexIdx )
+			{
+				float32 angle = 2.0f * b2_pi * (float32)vertexIdx / 5.0f;
+				float32 radius = size * random.Range(0.6f, 1.0f);
+				vertices[vertexIdx].Set(radius * cosf(angle), radius * sinf(angle));
+			}
+			
+			polygon.Set(vertices, 5);
+			fixtureDef.shape = &polygon;
+			break;
+		}
+			
+		default:
+			circle.m_radius = size * random.Range(0.3f, 1.0f);
+			fixtureDef.shape = &circle;
+			break;
+	}
+	
+	body->CreateFixture(&fixtureDef);
+}
+
+static b2Body* AddBody( b2World* world, const b2Vec2& position, float32 angle, b2BodyType type )
+{
+	b2BodyDef bodyDef;
+	bodyDef.type = type;
+	bodyDef.position = position;
+	bodyDef.angle = angle;
+	return world->CreateBody(&bodyDef);
+}
+
+static void BeginWorld( BenchmarkWorld* out, const char* name, int fixtureCount )
+{
+	out->name = name;
+	out->world = new b2World(b2Vec2(0.0f, 0.0f));
+	out->fixtureCount = fixtureCount;
+	
+	// keep the density the same at every size, about one fixture per 4 square meters
+	float32 halfSize = 0.5f * sqrtf(4.0f * (float32)fixtureCount);
+	out->bounds.lowerBound.Set(-halfSize, -halfSize);
+	out->bounds.upperBound.Set(halfSize, halfSize);
+}
+
+// static fixtures scattered evenly over the world
+static void BuildUniformWorld( BenchmarkWorld* out, int fixtureCount, Random& random )
+{
+	BeginWorld(out, "uniform", fixtureCount);
+	
+	for( int fixtureIdx = 0; fixtureIdx < fixtureCount; ++fixtureIdx )
+	{
+		b2Body* body = AddBody(out->world, random.Point(out->bounds), random.Range(-b2_pi, b2_pi), b2_staticBody);
+		AddShape(body, random, RandomCategory(random), 0.5f);
+	}
+}
+
+// static fixtures bunched up in tight clusters with empty space between them
+static void BuildClusteredWorld( BenchmarkWorld* out, int fixtureCount, Random& random )
+{
+	BeginWorld(out, "clustered", fixtureCount);
+	
+	int clusterCount = b2Max(1, fixtureCount / 50);
+	std::vector<b2Vec2> centers(clusterCount);
+	
+	for( int clusterIdx = 0; clusterIdx < clusterCount; ++clusterIdx )
+		centers[clusterIdx] = random.Point(out->bounds);
+	
+	for( int fixtureIdx = 0; fixtureIdx < fixtureCount; ++fixtureIdx )
+	{
+		const b2Vec2& center = centers[random.Next() % clusterCount];
+		b2Vec2 offset(random.Range(-4.0f, 4.0f), random.Range(-4.0f, 4.0f));
+		
+		b2Body* body = AddBody(out->world, center + offset, random.Range(-b2_pi, b2_pi), b2_staticBody);
+		AddShape(body, random, RandomCategory(random), 0.4f);
+	}
+}
+
+// long horizontal corridors walled with static boxes, with props along the floors
+static void BuildCorridorWorld( BenchmarkWorld* out, int fixtureCount, Random& random )
+{
+	BeginWorld(out, "corridors", fixtureCount);
+	
+	float32 width = out->bounds.upperBound.x - out->bounds.lowerBound.x;
+	float32 corridorHeight = 6.0f;
+	int corridorCount = b2Max(1, (int)((out->bounds.upperBound.y - out->bounds.lowerBound.y) / corridorHeight));
+	
+	// half the fixtures are wall segments, the rest are props
+	int segmentsPerWall = b2Max(1, fixtureCount / (2 * corridorCount));
+	float32 segmentLength = width / (float32)segmentsPerWall;
+	int created = 0;
+	
+	for( int corridorIdx = 0; corridorIdx < corridorCount && created < fixtureCount; ++corridorIdx )
+	{
+		float32 y = out->bounds.lowerBound.y + corridorHeight * (float32)corridorIdx;
+		
+		for( int segmentIdx = 0; segmentIdx < segmentsPerWall && created < fixtureCount; ++segmentIdx )
+		{
+			b2Vec2 position(out->bounds.lowerBound.x + segmentLength * ((float32)segmentIdx + 0.5f), y);
+			b2Body* body = AddBody(out->world, position, 0.0f, b2_staticBody);
+			
+			b2PolygonShape wall;
+			wall.SetAsBox(0.5f * segmentLength, 0.25f);
+			
+			b2FixtureDef fixtureDef;
+			fixtureDef.shape = &wall;
+			fixtureDef.filter.categoryBits = kCategoryTerrain;
+			body->CreateFixture(&fixtureDef);
+			
+			created++;
+		}
+	}
+	
+	while( created < fixtureCount )
+	{
+		int corridorIdx = (int)(random.Next() % corridorCount);
+		float32 floor = out->bounds.lowerBound.y + corridorHeight * (float32)corridorIdx;
+		b2Vec2 position(random.Range(out->bounds.lowerBound.x, out->bounds.upperBound.x), floor + random.Range(0.75f, corridorHeight - 0.75f));
+		
+		b2Body* body = AddBody(out->world, position, random.Range(-b2_pi, b2_pi), b2_staticBody);
+		AddShape(body, random, RandomCategory(random), 0.3f);
+		created++;
+	}
+}
+
+// static terrain with dynamic bodies, some with several fixtures, stepped a few times so they settle into the broadphase
+static void BuildMixedWorld( BenchmarkWorld* out, int fixtureCount, Random& random )
+{
+	BeginWorld(out, "mixed", fixtureCount);
+	
+	int created = 0;
+	
+	while( created < fixtureCount )
+	{
+		bool isStatic = (random.Next() % 3) == 0;
+		b2Body* body = AddBody(out->world, random.Point(out->bounds), random.Range(-b2_pi, b2_pi), isStatic ? b2_staticBody : b2_dynamicBody);
+		
+		int shapeCount = isStatic ? 1 : 1 + (int)(random.Next() % 3);
+		
+		for( int shapeIdx = 0; shapeIdx < shapeCount && created < fixtureCount; ++shapeIdx )
+		{
+			AddShape(body, random, isStatic ? kCategoryTerrain : RandomCategory(random), 0.5f);
+			created++;
+		}
+		
+		if( !isStatic )
+		{
+			body->SetLinearVelocity(b2Vec2(random.Range(-2.0f, 2.0f), random.Range(-2.0f, 2.0f)));
+			body->SetAngularVelocity(random.Range(-1.0f, 1.0f));
+		}
+	}
+	
+	for( int stepIdx = 0; stepIdx < 4; ++stepIdx )
+		out->world->Step(1.0f / 60.0f, 8, 3);
+}
+
+
+////////////////////////////////////////////////////////////////////////////
+// benchmarks
+
+typedef std::chrono::high_resolution_clock Clock;
+
+struct BenchmarkResult
+{
+	const char* worldName;
+	int fixtureCount;
+	const char* queryName;
+	int queryCount;
+	double nsPerQuery;
+	double candidatesPerQuery;
+	double allocationsPerQuery;
+	double hitsPerQuery;
+};
+
+// counts the proxies overlapping an AABB, the broadphase fan-out a query over that region starts from
+class CandidateCounter : public b2QueryCallback
+{
+public:
+	CandidateCounter() : mCount(0) {}
+	
+	bool ReportFixture( b2Fixture* )
+	{
+		mCount++;
+		return true;
+	}
+	
+	int mCount;
+};
+
+static int CountCandidates( b2World* world, const b2AABB& aabb )
+{
+	CandidateCounter counter;
+	world->QueryAABB(&counter, aabb);
+	return counter.mCount;
+}
+
+static b2AABB SegmentAABB( const b2Vec2& from, const b2Vec2& to )
+{
+	b2AABB aabb;
+	aabb.lowerBound = b2Min(from, to);
+	aabb.upperBound = b2Max(from, to);
+	return aabb;
+}
+
+// pre-generated inputs for every query in a run
+struct QueryInputs
+{
+	std::vector<b2AABB> boxes;
+	std::vector<RaySegment> rays;
+	std::vector<RaySegment> fans;		// 32 ray fans, coherent for the batch path
+	std::vector<b2Transform> sweepStarts;
+	std::vector<b2Vec2> sweepMotions;
+	std::vector<b2Vec2> diagonalMotions;
+	std::vector<b2AABB> viewports;		// 30 by 20 meter screens, in points
+};
+
+static void BuildQueryInputs( const BenchmarkWorld& world, int queryCount, Random& random, QueryInputs* inputs )
+{
+	for( int queryIdx = 0; queryIdx < queryCount; ++queryIdx )
+	{
+		b2Vec2 center = random.Point(world.bounds);
+		b2Vec2 extents(random.Range(1.0f, 4.0f), random.Range(1.0f, 4.0f));
+		
+		b2AABB box;
+		box.lowerBound = center - extents;
+		box.upperBound = center + extents;
+		inputs->boxes.push_back(box);
+		
+		b2AABB viewport;
+		viewport.lowerBound = fromb2(center - b2Vec2(15.0f, 10.0f));
+		viewport.upperBound = fromb2(center + b2Vec2(15.0f, 10.0f));
+		inputs->viewports.push_back(viewport);
+		
+		// sight lines and bullets, 5 to 40 meters
+		float32 angle = random.Range(-b2_pi, b2_pi);
+		float32 length = random.Range(5.0f, 40.0f);
+		RaySegment ray;
+		ray.from = random.Point(world.bounds);
+		ray.to = ray.from + length * b2Vec2(cosf(angle), sinf(angle));
+		inputs->rays.push_back(ray);
+		
+		b2Transform xform;
+		xform.Set(random.Point(world.bounds), random.Range(-b2_pi, b2_pi));
+		inputs->sweepStarts.push_back(xform);
+		
+		float32 sweepAngle = random.Range(-b2_pi, b2_pi);
+		inputs->sweepMotions.push_back(random.Range(1.0f, 10.0f) * b2Vec2(cosf(sweepAngle), sinf(sweepAngle)));
+		
+		// long sweeps along a diagonal, the worst case for a single swept AABB
+		float32 diagonal = random.Range(20.0f, 40.0f);
+		inputs->diagonalMotions.push_back(b2Vec2(diagonal * (random.Next() & 1 ? 1.0f : -1.0f), diagonal));
+	}
+	
+	for( int fanIdx = 0; fanIdx * 32 < queryCount; ++fanIdx )
+	{
+		b2Vec2 origin = random.Point(world.bounds);
+		float32 start = random.Range(-b2_pi, b2_pi);
+		
+		for( int rayIdx = 0; rayIdx < 32; ++rayIdx )
+		{
+			float32 angle = start + 0.5f * b2_pi * (float32)rayIdx / 32.0f;
+			RaySegment ray;
+			ray.from = origin;
+			ray.to = origin + 20.0f * b2Vec2(cosf(angle), sinf(angle));
+			inputs->fans.push_back(ray);
+		}
+	}
+	
+	inputs->fans.resize(queryCount);
+}
+
+// times body(i) for every query i, and fills in the per query averages
+template <typename Body>
+static BenchmarkResult RunBenchmark( const BenchmarkWorld& world, const char* queryName, int queryCount, double candidates, Body body )
+{
+	unsigned long long allocationsBefore = GetAllocationCount();
+	long long hits = 0;
+	
+	Clock::time_point start = Clock::now();
+	
+	for( int queryIdx = 0; queryIdx < queryCount; ++queryIdx )
+		hits += body(queryIdx);
+	
+	Clock::time_point end = Clock::now();
+	
+	BenchmarkResult result;
+	result.worldName = world.name;
+	result.fixtureCount = world.fixtureCount;
+	result.queryName = queryName;
+	result.queryCount = queryCount;
+	result.nsPerQuery = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / (double)queryCount;
+	result.candidatesPerQuery = candidates / (double)queryCount;
+	result.allocationsPerQuery = (double)(GetAllocationCount() - allocationsBefore) / (double)queryCount;
+	result.hitsPerQuery = (double)hits / (double)queryCount;
+	
+	fprintf(stderr, "%-10s %7d  %-28s %10.1f ns  %8.2f candidates  %6.3f allocs\n", result.worldName, result.fixtureCount, result.queryName, result.nsPerQuery, result.candidatesPerQuery, result.allocationsPerQuery);
+	
+	return result;
+}
+
+static void RunWorldBenchmarks( const BenchmarkWorld& world, int queryCount, std::vector<BenchmarkResult>* results )
+{
+	b2World* w = world.world;
+	
+	Random random(1234);
+	QueryInputs inputs;
+	BuildQueryInputs(world, queryCount, random, &inputs);
+	
+	QueryFilter all;
+	QueryFilter terrainOnly(0, kCategoryTerrain);
+	
+	b2PolygonShape box;
+	box.SetAsBox(0.4f, 0.4f);
+	
+	// broadphase fan-out for each query shape, counted outside the timed loops
+	double boxCandidates = 0;
+	double shapeCandidates = 0;
+	double rayCandidates = 0;
+	double fanCandidates = 0;
+	double sweepCandidates = 0;
+	double diagonalCandidates = 0;
+	double viewportCandidates = 0;
+	
+	for( int queryIdx = 0; queryIdx < queryCount; ++queryIdx )
+	{
+		boxCandidates += CountCandidates(w, inputs.boxes[queryIdx]);
+		viewportCandidates += CountCandidates(w, SegmentAABB(tob2(inputs.viewports[queryIdx].lowerBound), tob2(inputs.viewports[queryIdx].upperBound)));
+		rayCandidates += CountCandidates(w, SegmentAABB(inputs.rays[queryIdx].from, inputs.rays[queryIdx].to));
+		fanCandidates += CountCandidates(w, SegmentAABB(inputs.fans[queryIdx].from, inputs.fans[queryIdx].to));
+		
+		b2AABB startAABB;
+		box.ComputeAABB(&startAABB, inputs.sweepStarts[queryIdx], 0);
+		shapeCandidates += CountCandidates(w, startAABB);
+		
+		b2AABB sweptAABB = startAABB;
+		sweptAABB.lowerBound = startAABB.lowerBound + b2Min(b2Vec2(0.0f, 0.0f), inputs.sweepMotions[queryIdx]);
+		sweptAABB.upperBound = startAABB.upperBound + b2Max(b2Vec2(0.0f, 0.0f), inputs.sweepMotions[queryIdx]);
+		sweepCandidates += CountCandidates(w, sweptAABB);
+		
+		sweptAABB.lowerBound = startAABB.lowerBound + b2Min(b2Vec2(0.0f, 0.0f), inputs.diagonalMotions[queryIdx]);
+		sweptAABB.upperBound = startAABB.upperBound + b2Max(b2Vec2(0.0f, 0.0f), inputs.diagonalMotions[queryIdx]);
+		diagonalCandidates += CountCandidates(w, sweptAABB);
+	}
+	
+	static const int kMaxResults = 64;
+	b2Fixture* fixtures[kMaxResults];
+	RayCastResult rayResults[kMaxResults];
+	ShapeCastResult shapeResults[kMaxResults];
+	
+	results->push_back(RunBenchmark(world, "QueryAABB", queryCount, boxCandidates, [&]( int i ) {
+		return QueryAABB(w, inputs.boxes[i], all, fixtures, kMaxResults);
+	}));
+	
+	results->push_back(RunBenchmark(world, "QueryAABB/terrain", queryCount, boxCandidates, [&]( int i ) {
+		return QueryAABB(w, inputs.boxes[i], terrainOnly, fixtures, kMaxResults);
+	}));
+	
+	results->push_back(RunBenchmark(world, "QueryShape", queryCount, shapeCandidates, [&]( int i ) {
+		return QueryShape(w, &box, inputs.sweepStarts[i], all, fixtures, kMaxResults);
+	}));
+	
+	results->push_back(RunBenchmark(world, "CollideRay", queryCount, rayCandidates, [&]( int i ) {
+		return CollideRay(w, inputs.rays[i].from, inputs.rays[i].to, all, rayResults, kMaxResults);
+	}));
+	
+	results->push_back(RunBenchmark(world, "CollideRayClosest", queryCount, rayCandidates, [&]( int i ) {
+		return CollideRayClosest(w, inputs.rays[i].from, inputs.rays[i].to, all, rayResults) ? 1 : 0;
+	}));
+	
+	results->push_back(RunBenchmark(world, "CollideRayClosest/terrain", queryCount, rayCandidates, [&]( int i ) {
+		return CollideRayClosest(w, inputs.rays[i].from, inputs.rays[i].to, terrainOnly, rayResults) ? 1 : 0;
+	}));
+	
+	results->push_back(RunBenchmark(world, "CollideRayAny", queryCount, rayCandidates, [&]( int i ) {
+		return CollideRayAny(w, inputs.rays[i].from, inputs.rays[i].to, all) ? 1 : 0;
+	}));
+	
+	results->push_back(RunBenchmark(world, "CollideRayNearest/4", queryCount, rayCandidates, [&]( int i ) {
+		return CollideRayNearest(w, inputs.rays[i].from, inputs.rays[i].to, all, rayResults, 4);
+	}));
+	
+	results->push_back(RunBenchmark(world, "CollideRayClosest/fans", queryCount, fanCandidates, [&]( int i ) {
+		return CollideRayClosest(w, inputs.fans[i].from, inputs.fans[i].to, all, rayResults) ? 1 : 0;
+	}));
+	
+	// the batch runs whole fans at a time, so time it per fan and report per ray
+	{
+		std::vector<RayCastResult> batchResults(32);
+		int fanCount = queryCount / 32;
+		
+		if( fanCount > 0 )
+		{
+			BenchmarkResult result = RunBenchmark(world, "CollideRayBatch/fans", fanCount, fanCandidates * fanCount / queryCount, [&]( int i ) {
+				return CollideRayBatch(w, &inputs.fans[i * 32], 32, all, &batchResults[0]);
+			});
+			
+			result.nsPerQuery /= 32.0;
+			result.candidatesPerQuery /= 32.0;
+			result.allocationsPerQuery /= 32.0;
+			result.hitsPerQuery /= 32.0;
+			result.queryCount *= 32;
+			results->push_back(result);
+		}
+	}
+	
+	// sweep against whatever fixture is nearest the start, the single pair overload
+	{
+		std::vector<b2Fixture*> targets(queryCount, (b2Fixture*)NULL);
+		
+		for( int queryIdx = 0; queryIdx < queryCount; ++queryIdx )
+		{
+			b2AABB around;
+			around.lowerBound = inputs.sweepStarts[queryIdx].position - b2Vec2(5.0f, 5.0f);
+			around.upperBound = inputs.sweepStarts[queryIdx].position + b2Vec2(5.0f, 5.0f);
+			
+			if( QueryAABB(w, around, all, fixtures, 1) > 0 )
+				targets[queryIdx] = fixtures[0];
+		}
+		
+		results->push_back(RunBenchmark(world, "CollideSwept/pair", queryCount, (double)queryCount, [&]( int i ) {
+			if( targets[i] == NULL )
+				return 0;
+			
+			b2Body* body = targets[i]->GetBody();
+			return CollideSwept(&box, inputs.sweepStarts[i], b2Vec2(0.0f, 0.0f), targets[i]->GetShape(), body->GetTransform(), body->GetLocalCenter(), inputs.sweepMotions[i], shapeResults) ? 1 : 0;
+		}));
+		
+		// the same sweeps with every proxy built up front, as a caller sweeping the same pairs repeatedly would.
+		// built in place, since a chain child's proxy points into itself.
+		b2DistanceProxy boxProxy;
+		boxProxy.Set(&box, 0);
+		
+		std::vector<b2DistanceProxy> targetProxies(queryCount);
+		
+		for( int queryIdx = 0; queryIdx < queryCount; ++queryIdx )
+		{
+			if( targets[queryIdx] != NULL )
+				targetProxies[queryIdx].Set(targets[queryIdx]->GetShape(), 0);
+		}
+		
+		results->push_back(RunBenchmark(world, "CollideSwept/pair/proxies", queryCount, (double)queryCount, [&]( int i ) {
+			if( targets[i] == NULL )
+				return 0;
+			
+			return CollideSwept(&box, boxProxy, inputs.sweepStarts[i], b2Vec2(0.0f, 0.0f), targets[i], 0, targetProxies[i], inputs.sweepMotions[i], shapeResults) ? 1 : 0;
+		}));
+	}
+	
+	results->push_back(RunBenchmark(world, "CollideSwept", queryCount, sweepCandidates, [&]( int i ) {
+		return CollideSwept(w, &box, inputs.sweepStarts[i], b2Vec2(0.0f, 0.0f), inputs.sweepMotions[i], all, shapeResults, kMaxResults);
+	}));
+	
+	results->push_back(RunBenchmark(world, "CollideSweptClosest", queryCount, sweepCandidates, [&]( int i ) {
+		return CollideSweptClosest(w, &box, inputs.sweepStarts[i], b2Vec2(0.0f, 0.0f), inputs.sweepMotions[i], all, shapeResults) ? 1 : 0;
+	}));
+	
+	results->push_back(RunBenchmark(world, "CollideSweptClosest/diagonal", queryCount, diagonalCandidates, [&]( int i ) {
+		return CollideSweptClosest(w, &box, inputs.sweepStarts[i], b2Vec2(0.0f, 0.0f), inputs.diagonalMotions[i], all, shapeResults) ? 1 : 0;
+	}));
+	
+	results->push_back(RunBenchmark(world, "CollideSweptAny/diagonal", queryCount, diagonalCandidates, [&]( int i ) {
+		return CollideSweptAny(w, &box, inputs.sweepStarts[i], b2Vec2(0.0f, 0.0f), inputs.diagonalMotions[i], all) ? 1 : 0;
+	}));
+	
+	// a quarter turn over the sweep, against bodies moving by their velocities over one step
+	results->push_back(RunBenchmark(world, "CollideSweptClosest/diagonal/spinning", queryCount, diagonalCandidates, [&]( int i ) {
+		return CollideSweptClosest(w, &box, inputs.sweepStarts[i], b2Vec2(0.0f, 0.0f), SweptMotion(inputs.diagonalMotions[i], 0.5f * b2_pi, 1.0f / 60.0f), all, shapeResults) ? 1 : 0;
+	}));
+	
+	// the same sweeps through a SweepCache warmed by one untimed pass, as a game querying the same area
+	// every frame would see it: candidate proxies come out of the cache instead of being built per query
+	{
+		SweepCache sweepCache;
+		
+		for( int queryIdx = 0; queryIdx < queryCount; ++queryIdx )
+			CollideSweptClosest(w, &box, inputs.sweepStarts[queryIdx], b2Vec2(0.0f, 0.0f), inputs.diagonalMotions[queryIdx], all, shapeResults, &sweepCache);
+		
+		results->push_back(RunBenchmark(world, "CollideSweptClosest/diagonal/cache", queryCount, diagonalCandidates, [&]( int i ) {
+			return CollideSweptClosest(w, &box, inputs.sweepStarts[i], b2Vec2(0.0f, 0.0f), inputs.diagonalMotions[i], all, shapeResults, &sweepCache) ? 1 : 0;
+		}));
+		
+		results->push_back(RunBenchmark(world, "CollideSweptClosest/spinning/cache", queryCount, diagonalCandidates, [&]( int i ) {
+			return CollideSweptClosest(w, &box, inputs.sweepStarts[i], b2Vec2(0.0f, 0.0f), SweptMotion(inputs.diagonalMotions[i], 0.5f * b2_pi, 1.0f / 60.0f), all, shapeResults, &sweepCache) ? 1 : 0;
+		}));
+	}
+	
+	// render sync: every body's position, angle and user data walked off the body list, against
+	// ExtractVisibleBodies for a screen's worth of the world
+	{
+		std::vector<float32> x(w->GetBodyCount());
+		std::vector<float32> y(w->GetBodyCount());
+		std::vector<float32> angle(w->GetBodyCount());
+		std::vector<void*> userData(w->GetBodyCount());
+		
+		results->push_back(RunBenchmark(world, "RenderSync/bodyList", queryCount, (double)w->GetBodyCount() * queryCount, [&]( int ) {
+			int count = 0;
+			
+			for( b2Body* body = w->GetBodyList(); body != NULL; body = body->GetNext() )
+			{
+				b2Vec2 position = fromb2(body->GetPosition());
+				x[count] = position.x;
+				y[count] = position.y;
+				angle[count] = body->GetAngle();
+				userData[count] = body->GetUserData();
+				count++;
+			}
+			
+			return count;
+		}));
+		
+		QueryContext context;
+		RenderBodies bodies;
+		
+		results->push_back(RunBenchmark(world, "ExtractVisibleBodies", queryCount, viewportCandidates, [&]( int i ) {
+			context.Reset();
+			return ExtractVisibleBodies(w, inputs.viewports[i], &context, &bodies);
+		}));
+	}
+	
+	// the same queries with static fixtures in a StaticBVH, to compare against the world runs above
+	StaticBVH statics;
+	statics.Build(w);
+	
+	results->push_back(RunBenchmark(world, "CollideRayClosest/bvh", queryCount, rayCandidates, [&]( int i ) {
+		return CollideRayClosest(w, &statics, inputs.rays[i].from, inputs.rays[i].to, all, rayResults) ? 1 : 0;
+	}));
+	
+	results->push_back(RunBenchmark(world, "CollideRayAny/bvh", queryCount, rayCandidates, [&]( int i ) {
+		return CollideRayAny(w, &statics, inputs.rays[i].from, inputs.rays[i].to, all) ? 1 : 0;
+	}));
+	
+	results->push_back(RunBenchmark(world, "CollideRayNearest/4/bvh", queryCount, rayCandidates, [&]( int i ) {
+		return CollideRayNearest(w, &statics, inputs.rays[i].from, inputs.rays[i].to, all, rayResults, 4);
+	}));
+}
+
+
+// the RayKernels against b2Shape::RayCast, per shape type, on rays scattered around a single shape
+static void RunKernelBenchmarks( int queryCount, std::vector<BenchmarkResult>* results )
+{
+	BenchmarkWorld kernels;
+	kernels.name = "kernels";
+	kernels.fixtureCount = 1;
+	
+	Random random(99);
+	
+	b2AABB around;
+	around.lowerBound.Set(-2.0f, -2.0f);
+	around.upperBound.Set(2.0f, 2.0f);
+	
+	std::vector<b2RayCastInput> inputs(queryCount);
+	
+	for( int queryIdx = 0; queryIdx < queryCount; ++queryIdx )
+	{
+		inputs[queryIdx].p1 = random.Point(around);
+		inputs[queryIdx].p2 = random.Point(around);
+		inputs[queryIdx].maxFraction = 1.0f;
+	}
+	
+	b2Transform xf;
+	xf.Set(b2Vec2(0.1f, -0.2f), 0.3f);
+	
+	b2RayCastOutput output;
+	
+	// polygons of 4, 5 and 8 sides
+	static const char* const names[3][3] = {
+		{ "RayCast/box/b2Shape", "RayCast/box/kernel", "RayCast/box/kernel/packet" },
+		{ "RayCast/pentagon/b2Shape", "RayCast/pentagon/kernel", "RayCast/pentagon/kernel/packet" },
+		{ "RayCast/octagon/b2Shape", "RayCast/octagon/kernel", "RayCast/octagon/kernel/packet" },
+	};
+	static const int sides[3] = { 4, 5, 8 };
+	
+	for( int polygonIdx = 0; polygonIdx < 3; ++polygonIdx )
+	{
+		b2Vec2 vertices[b2_maxPolygonVertices];
+		
+		for( int vertexIdx = 0; vertexIdx < sides[polygonIdx]; ++vertexIdx )
+		{
+			float32 angle = 2.0f * b2_pi * (float32)vertexIdx / (float32)sides[polygonIdx];
+			vertices[vertexIdx].Set(cosf(angle), sinf(angle));
+		}
+		
+		b2PolygonShape polygon;
+		polygon.Set(vertices, sides[polygonIdx]);
+		
+		RayPolygonSoA soa;
+		soa.Set(&polygon);
+		
+		const b2Shape* shape = &polygon;
+		
+		results->push_back(RunBenchmark(kernels, names[polygonIdx][0], queryCount, (double)queryCount, [&]( int i ) {
+			return shape->RayCast(&output, inputs[i], xf, 0) ? 1 : 0;
+		}));
+		
+		results->push_back(RunBenchmark(kernels, names[polygonIdx][1], queryCount, (double)queryCount, [&]( int i ) {
+			return RayCastPolygon(soa, xf, inputs[i], &output) ? 1 : 0;
+		}));
+		
+		// 16 rays per call, timed per call and reported per ray
+		int packetCount = queryCount / 16;
+		
+		if( packetCount > 0 )
+		{
+			b2RayCastOutput outputs[16];
+			bool hits[16];
+			
+			BenchmarkResult result = RunBenchmark(kernels, names[polygonIdx][2], packetCount, (double)packetCount * 16.0, [&]( int i ) {
+				return RayCastPolygon(soa, xf, &inputs[i * 16], 16, outputs, hits);
+			});
+			
+			result.nsPerQuery /= 16.0;
+			result.candidatesPerQuery /= 16.0;
+			result.allocationsPerQuery /= 16.0;
+			result.hitsPerQuery /= 16.0;
+			result.queryCount *= 16;
+			results->push_back(result);
+		}
+	}
+	
+	// each ray against 16 circles, closest hit
+	static const int kCircleCount = 16;
+	b2CircleShape circleShapes[kCircleCount];
+	float32 centerX[kCircleCount];
+	float32 centerY[kCircleCount];
+	float32 radius[kCircleCount];
+	
+	for( int circleIdx = 0; circleIdx < kCircleCount; ++circleIdx )
+	{
+		circleShapes[circleIdx].m_p = random.Point(around);
+		circleShapes[circleIdx].m_radius = random.Range(0.1f, 0.5f);
+		
+		b2Vec2 center = b2Mul(xf, circleShapes[circleIdx].m_p);
+		centerX[circleIdx] = center.x;
+		centerY[circleIdx] = center.y;
+		radius[circleIdx] = circleShapes[circleIdx].m_radius;
+	}
+	
+	RayCircleSoA circles;
+	circles.centerX = centerX;
+	circles.centerY = centerY;
+	circles.radius = radius;
+	circles.count = kCircleCount;
+	
+	results->push_back(RunBenchmark(kernels, "RayCast/circle16/b2Shape", queryCount, (double)queryCount * kCircleCount, [&]( int i ) {
+		b2RayCastInput input = inputs[i];
+		int hit = 0;
+		
+		for( int circleIdx = 0; circleIdx < kCircleCount; ++circleIdx )
+		{
+			if( circleShapes[circleIdx].RayCast(&output, input, xf, 0) )
+			{
+				input.maxFraction = output.fraction;
+				hit = 1;
+			}
+		}
+		
+		return hit;
+	}));
+	
+	results->push_back(RunBenchmark(kernels, "RayCast/circle16/kernel", queryCount, (double)queryCount * kCircleCount, [&]( int i ) {
+		return RayCastCircles(circles, inputs[i], &output) >= 0 ? 1 : 0;
+	}));
+}
+
+
+////////////////////////////////////////////////////////////////////////////
+// output
+
+static void WriteResults( FILE* file, const std::vector<BenchmarkResult>& results )
+{
+	fprintf(file, "{\n\t\"benchmark\": \"CollisionUtil\",\n\t\"version\": 1,\n\t\"results\": [\n");
+	
+	for( size_t resultIdx = 0; resultIdx < results.size(); ++resultIdx )
+	{
+		const BenchmarkResult& result = results[resultIdx];
+		
+		fprintf(file, "\t\t{ \"world\": \"%s\", \"fixtures\": %d, \"query\": \"%s\", \"queries\": %d, "
+				"\"ns_per_query\": %.2f, \"candidates_per_query\": %.3f, \"allocations_per_query\": %.4f, \"hits_per_query\": %.3f }%s\n",
+				result.worldName, result.fixtureCount, result.queryName, result.queryCount,
+				result.nsPerQuery, result.candidatesPerQuery, result.allocationsPerQuery, result.hitsPerQuery,
+				resultIdx + 1 < results.size() ? "," : "");
+	}
+	
+	fprintf(file, "\t]\n}\n");
+}
+
+int main( int argc, char** argv )
+{
+	const char* outputPath = argc > 1 ? argv[1] : NULL;
+	int maxFixtures = argc > 2 ? atoi(argv[2]) : 100000;
+	int queryCount = argc > 3 ? atoi(argv[3]) : 4096;
+	
+	typedef void (*WorldBuilder)( BenchmarkWorld*, int, Random& );
+	static const WorldBuilder builders[] = { BuildUniformWorld, BuildClusteredWorld, BuildCorridorWorld, BuildMixedWorld };
+	static const int sizes[] = { 100, 1000, 10000, 100000 };
+	
+	std::vector<BenchmarkResult> results;
+	
+	RunKernelBenchmarks(queryCount, &results);
+	
+	for( size_t builderIdx = 0; builderIdx < sizeof(builders) / sizeof(builders[0]); ++builderIdx )
+	{
+		for( size_t sizeIdx = 0; sizeIdx < sizeof(sizes) / sizeof(sizes[0]) && sizes[sizeIdx] <= maxFixtures; ++sizeIdx )
+		{
+			Random random(42 + (unsigned int)sizeIdx);
+			BenchmarkWorld world;
+			builders[builderIdx](&world, sizes[sizeIdx], random);
+			
+			RunWorldBenchmarks(world, queryCount, &results);
+		}
+	}
+	
+	FILE* file = outputPath != NULL ? fopen(outputPath, "w") : stdout;
+	
+	if( file == NULL )
+	{
+		fprintf(stderr, "couldn't open %s\n", outputPath);
+		return 1;
+	}
+	
+	WriteResults(file, results);
+	
+	if( file != stdout )
+		fclose(file);
+	
+	return 0;
+}
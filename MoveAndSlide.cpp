@@ -0,0 +1,318 @@
+//
+//	MoveAndSlide.cpp
+//
+//	Created by Aaron Pendley on 4/9/10.
+//	Copyright 2010 Aaron Pendley.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+// 
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+// 
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+
+#include "MoveAndSlide.h"
+#include "QueryContext.h"
+#include "QueryPolicies.h"
+
+#include <algorithm>
+#include <math.h>
+
+
+namespace
+{
+	// moves shorter than this aren't worth a sweep
+	const float32 kMinMoveSquared = 0.01f * b2_linearSlop * b2_linearSlop;
+	
+	// b2TimeOfImpact reports a touch straight away for shapes already about as close as it leaves them,
+	// so after a hit the shape is lifted this far off the surface, or sliding along it would hit it again
+	const float32 kSkinWidth = b2_linearSlop;
+	
+	// a fixture child found up front, with its distance proxy built once for the whole move
+	struct MoveCandidate
+	{
+		b2Fixture* fixture;
+		int32 childIndex;
+		b2DistanceProxy proxy;
+	};
+	
+	// sweeps the shape, at any position, against the fixture children found up front
+	class CandidateSweeper
+	{
+	public:
+		CandidateSweeper( b2Shape* shape, const b2Transform& xform, const b2Vec2& localCenter, const QueryArray<MoveCandidate>* candidates, SweepCache* cache )
+		: mShape(shape)
+		, mXform(xform)
+		, mLocalCenter(localCenter)
+		, mCandidates(candidates)
+		, mCache(cache)
+		{
+			mProxy.Set(shape, 0);
+		}
+		
+		// returns the first candidate hit moving from position by motion and the fraction of motion
+		// at which it's hit, or NULL and 1 if nothing is
+		const MoveCandidate* Sweep( const b2Vec2& position, const b2Vec2& motion, float32* toi ) const
+		{
+			b2Transform xform = mXform;
+			xform.position = position;
+			
+			b2AABB sweptAABB;
+			mShape->ComputeAABB(&sweptAABB, xform, 0);
+			sweptAABB.lowerBound += b2Min(b2Vec2(0.0f, 0.0f), motion);
+			sweptAABB.upperBound += b2Max(b2Vec2(0.0f, 0.0f), motion);
+			
+			const MoveCandidate* closest = NULL;
+			float32 smallestTOI = 1.0f;
+			
+			for( int candidateIdx = 0; candidateIdx < mCandidates->GetCount(); ++candidateIdx )
+			{
+				const MoveCandidate& candidate = (*mCandidates)[candidateIdx];
+				
+				if( !b2TestOverlap(sweptAABB, candidate.fixture->GetAABB(candidate.childIndex)) )
+					continue;
+				
+				float32 t;
+				
+				if( CollideSweptTOI(mShape, mProxy, xform, mLocalCenter, candidate.fixture, candidate.childIndex, candidate.proxy, motion, &t, mCache) && t < smallestTOI )
+				{
+					closest = &candidate;
+					smallestTOI = t;
+				}
+			}
+			
+			*toi = smallestTOI;
+			return closest;
+		}
+		
+		// the contact with a candidate Sweep returned
+		void GetContact( const b2Vec2& position, const b2Vec2& motion, const MoveCandidate* candidate, ShapeCastResult* contact ) const
+		{
+			b2Transform xform = mXform;
+			xform.position = position;
+			
+			b2Fixture* fixture = candidate->fixture;
+			
+			if( !CollideSwept(NULL, mProxy, xform, mLocalCenter, fixture, candidate->childIndex, candidate->proxy, motion, contact) )
+			{
+				// TOI found a touch the distance query can't see, so face the contact back along the motion
+				b2Vec2 normal = -motion;
+				normal.Normalize();
+				
+				contact->normal = normal;
+				contact->contactPoint = position;
+				contact->toi = position;
+				contact->fixture = fixture;
+			}
+		}
+		
+		b2Shape* mShape;
+		b2DistanceProxy mProxy;
+		b2Transform mXform;
+		b2Vec2 mLocalCenter;
+		const QueryArray<MoveCandidate>* mCandidates;
+		SweepCache* mCache;
+	};
+	
+	// lifts the shape by the step height, carries on with the horizontal part of motion, then sets it back
+	// down.  succeeds if it lands on ground and gets somewhere.
+	bool TryStepUp( const CandidateSweeper& sweeper, const b2Vec2& position, const b2Vec2& motion, const MoveAndSlideSettings& settings, float32 groundCos, b2Vec2* landed, b2Vec2* remaining )
+	{
+		b2Vec2 forward = motion - b2Dot(motion, settings.up) * settings.up;
+		
+		if( forward.LengthSquared() < kMinMoveSquared )
+			return false;
+		
+		float32 t;
+		
+		b2Vec2 lift = settings.stepHeight * settings.up;
+		sweeper.Sweep(position, lift, &t);
+		lift *= t;
+		
+		b2Vec2 raised = position + lift;
+		
+		float32 forwardTOI;
+		sweeper.Sweep(raised, forward, &forwardTOI);
+		
+		if( (forwardTOI * forward).LengthSquared() < kMinMoveSquared )
+			return false;
+		
+		b2Vec2 moved = raised + forwardTOI * forward;
+		
+		// nothing to stand on within the step means this is a ledge to walk off, not a step
+		b2Vec2 drop = -settings.stepHeight * settings.up;
+		const MoveCandidate* ground = sweeper.Sweep(moved, drop, &t);
+		
+		if( ground == NULL )
+			return false;
+		
+		ShapeCastResult contact;
+		sweeper.GetContact(moved, drop, ground, &contact);
+		
+		if( b2Dot(contact.normal, settings.up) < groundCos )
+			return false;
+		
+		*landed = moved + t * drop + kSkinWidth * contact.normal;
+		*remaining = (1.0f - forwardTOI) * forward;
+		return true;
+	}
+	
+	void AddContact( const ShapeCastResult& contact, ShapeCastResult* contacts, int maxContacts, MoveAndSlideResult* result )
+	{
+		for( int contactIdx = 0; contactIdx < result->contactCount; ++contactIdx )
+		{
+			if( contacts[contactIdx].fixture == contact.fixture )
+				return;
+		}
+		
+		if( result->contactCount < maxContacts )
+		{
+			contacts[result->contactCount] = contact;
+			result->contactCount++;
+		}
+	}
+}
+
+void MoveAndSlide( b2World* world, b2Shape* shape, const b2Transform& xform, const b2Vec2& localCenter, const b2Vec2& motion, const QueryFilter& filter, const MoveAndSlideSettings& settings, MoveAndSlideResult* result, ShapeCastResult* contacts, int maxContacts, SweepCache* cache, QueryContext* context )
+{
+	assert(result != NULL);
+	
+	result->position = xform.position;
+	result->iterations = 0;
+	result->contactCount = 0;
+	result->grounded = false;
+	result->steppedUp = false;
+	
+	if( contacts == NULL )
+		maxContacts = 0;
+	
+	QueryContext* scratch = context != NULL ? context : GetThreadQueryContext();
+	QueryContextScope scope(scratch);
+	
+	if( context != NULL )
+		scope.Release();
+	
+	// sliding never makes the move longer, and stepping adds at most the step height, so everything the
+	// move can reach is within that distance of where it starts
+	float32 reach = motion.Length() + b2Max(settings.stepHeight, 0.0f) + b2_linearSlop;
+	
+	b2AABB bounds;
+	shape->ComputeAABB(&bounds, xform, 0);
+	bounds.lowerBound -= b2Vec2(reach, reach);
+	bounds.upperBound += b2Vec2(reach, reach);
+	
+	QueryArray<b2Fixture*> fixtures(scratch);
+	AllFixturesCollector collector(&fixtures);
+	QueryAABBWith(world, bounds, &collector, QueryFilterPolicy(filter));
+	
+	// chain fixtures are found once per child
+	b2Fixture** begin = fixtures.GetData();
+	b2Fixture** end = begin + fixtures.GetCount();
+	
+	std::sort(begin, end);
+	fixtures.Truncate((int)(std::unique(begin, end) - begin));
+	
+	int childCount = 0;
+	
+	for( int fixtureIdx = 0; fixtureIdx < fixtures.GetCount(); ++fixtureIdx )
+		childCount += fixtures[fixtureIdx]->GetShape()->GetChildCount();
+	
+	// every sweep of the move reuses these proxies, so they're built once here.  the array is sized up
+	// front and the proxies built in place, since a chain child's proxy points into itself and can't be moved.
+	QueryArray<MoveCandidate> candidates(scratch, b2Max(childCount, 1));
+	
+	for( int fixtureIdx = 0; fixtureIdx < fixtures.GetCount(); ++fixtureIdx )
+	{
+		b2Fixture* fixture = fixtures[fixtureIdx];
+		
+		for( int32 childIdx = 0; childIdx < fixture->GetShape()->GetChildCount(); ++childIdx )
+		{
+			if( !b2TestOverlap(bounds, fixture->GetAABB(childIdx)) )
+				continue;
+			
+			MoveCandidate candidate;
+			candidate.fixture = fixture;
+			candidate.childIndex = childIdx;
+			candidates.Push(candidate);
+			
+			candidates[candidates.GetCount() - 1].proxy.Set(fixture->GetShape(), childIdx);
+		}
+	}
+	
+	CandidateSweeper sweeper(shape, xform, localCenter, &candidates, cache);
+	
+	float32 groundCos = cosf(settings.maxSlopeAngle);
+	
+	b2Vec2 position = xform.position;
+	b2Vec2 remaining = motion;
+	b2Vec2 previousNormal(0.0f, 0.0f);
+	
+	while( result->iterations < settings.maxIterations && remaining.LengthSquared() >= kMinMoveSquared )
+	{
+		result->iterations++;
+		
+		float32 t;
+		const MoveCandidate* hit = sweeper.Sweep(position, remaining, &t);
+		
+		if( hit == NULL )
+		{
+			position += remaining;
+			break;
+		}
+		
+		ShapeCastResult contact;
+		sweeper.GetContact(position, remaining, hit, &contact);
+		AddContact(contact, contacts, maxContacts, result);
+		
+		position += t * remaining + kSkinWidth * contact.normal;
+		remaining *= 1.0f - t;
+		
+		bool ground = b2Dot(contact.normal, settings.up) >= groundCos;
+		result->grounded |= ground;
+		
+		// a wall might be a step, only climb one per move
+		if( !ground && settings.stepHeight > 0.0f && !result->steppedUp )
+		{
+			b2Vec2 landed;
+			b2Vec2 stepRemaining;
+			
+			if( TryStepUp(sweeper, position, remaining, settings, groundCos, &landed, &stepRemaining) )
+			{
+				position = landed;
+				remaining = stepRemaining;
+				previousNormal.SetZero();
+				
+				result->grounded = true;
+				result->steppedUp = true;
+				continue;
+			}
+		}
+		
+		// keep the part of the motion along the surface
+		float32 into = b2Dot(remaining, contact.normal);
+		
+		if( into < 0.0f )
+			remaining -= into * contact.normal;
+		
+		// sliding along this surface runs back into the last one, so we're wedged in a corner
+		if( b2Dot(remaining, previousNormal) < 0.0f )
+			break;
+		
+		previousNormal = contact.normal;
+	}
+	
+	result->position = position;
+}
@@ -0,0 +1,72 @@
+//
+//	MoveAndSlide.h
+//
+//	Created by Aaron Pendley on 4/9/10.
+//	Copyright 2010 Aaron Pendley.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+// 
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+// 
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+
+#ifndef _MOVEANDSLIDE_H_INCLUDED_
+#define _MOVEANDSLIDE_H_INCLUDED_
+
+#include "CollisionUtil.h"
+
+
+struct MoveAndSlideSettings
+{
+	MoveAndSlideSettings()
+	: maxIterations(4)
+	, stepHeight(0.0f)
+	, maxSlopeAngle(0.25f * b2_pi)
+	, up(0.0f, 1.0f)
+	{
+	}
+	
+	// sweeps per move.  each one after the first carries on along whatever the last one hit.
+	int maxIterations;
+	
+	// walls up to this high are climbed instead of slid along.  0 turns stepping off.
+	float32 stepHeight;
+	
+	// the steepest surface, as an angle from up, that counts as ground
+	float32 maxSlopeAngle;
+	
+	b2Vec2 up;
+};
+
+struct MoveAndSlideResult
+{
+	b2Vec2 position;		// where the shape's transform ends up
+	int iterations;			// sweeps used, not counting the ones spent stepping up
+	int contactCount;		// contacts written to the caller's buffer
+	bool grounded;			// touched ground, as defined by maxSlopeAngle, during the move
+	bool steppedUp;
+};
+
+// moves a shape by motion, sliding along whatever it runs into rather than stopping there, for kinematic
+// characters.  the fixtures near the whole move are found with one broadphase query up front, and each
+// sweep after that only looks at them.  other bodies are treated as stationary.
+//
+// contacts gets the first contact with each fixture touched, up to maxContacts, and may be NULL.
+// cache is passed on to the sweeps, see SweepCache.h.
+void MoveAndSlide( b2World* world, b2Shape* shape, const b2Transform& xform, const b2Vec2& localCenter, const b2Vec2& motion, const QueryFilter& filter, const MoveAndSlideSettings& settings, MoveAndSlideResult* result, ShapeCastResult* contacts = NULL, int maxContacts = 0, SweepCache* cache = NULL, QueryContext* context = NULL );
+
+#endif
@@ -0,0 +1,130 @@
+//
+//	QueryContext.cpp
+//
+//	Created by Aaron Pendley on 4/9/10.
+//	Copyright 2010 Aaron Pendley.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+// 
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+// 
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+
+#include "QueryContext.h"
+
+
+static const int kAlignment = 16;
+
+static inline int AlignSize( int size )
+{
+	return (size + kAlignment - 1) & ~(kAlignment - 1);
+}
+
+QueryContext::QueryContext( int blockSize )
+: mHead(NULL)
+, mCurrent(NULL)
+, mOffset(0)
+, mBlockSize(AlignSize(blockSize))
+, mHeapAllocationCount(0)
+, mBytesReserved(0)
+, mPeakBytesUsed(0)
+{
+}
+
+QueryContext::~QueryContext()
+{
+	Block* block = mHead;
+	
+	while( block != NULL )
+	{
+		Block* next = block->next;
+		b2Free(block);
+		block = next;
+	}
+}
+
+char* QueryContext::GetBlockData( Block* block ) const
+{
+	return (char*)block + AlignSize(sizeof(Block));
+}
+
+void* QueryContext::Allocate( int size )
+{
+	size = AlignSize(b2Max(size, 1));
+	
+	if( mCurrent == NULL || mOffset + size > mCurrent->size )
+	{
+		int usedBefore = mCurrent != NULL ? mCurrent->usedBefore + mOffset : 0;
+		Block* next = mCurrent != NULL ? mCurrent->next : mHead;
+		
+		// reuse the next block in the chain if it is big enough, otherwise put a new one in front of it
+		if( next == NULL || next->size < size )
+		{
+			int blockSize = b2Max(size, mBlockSize);
+			Block* block = (Block*)b2Alloc(AlignSize(sizeof(Block)) + blockSize);
+			block->size = blockSize;
+			block->next = next;
+			
+			if( mCurrent != NULL )
+				mCurrent->next = block;
+			else
+				mHead = block;
+			
+			mHeapAllocationCount++;
+			mBytesReserved += blockSize;
+			
+			next = block;
+		}
+		
+		next->usedBefore = usedBefore;
+		mCurrent = next;
+		mOffset = 0;
+	}
+	
+	void* memory = GetBlockData(mCurrent) + mOffset;
+	mOffset += size;
+	
+	mPeakBytesUsed = b2Max(mPeakBytesUsed, mCurrent->usedBefore + mOffset);
+	
+	return memory;
+}
+
+void QueryContext::Reset()
+{
+	mCurrent = NULL;
+	mOffset = 0;
+}
+
+QueryContext::Marker QueryContext::GetMarker() const
+{
+	Marker marker;
+	marker.block = mCurrent;
+	marker.offset = mOffset;
+	return marker;
+}
+
+void QueryContext::Rewind( const Marker& marker )
+{
+	mCurrent = (Block*)marker.block;
+	mOffset = marker.offset;
+}
+
+QueryContext* GetThreadQueryContext()
+{
+	static thread_local QueryContext context;
+	return &context;
+}
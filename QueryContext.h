@@ -0,0 +1,213 @@
+//
+//	QueryContext.h
+//
+//	Created by Aaron Pendley on 4/9/10.
+//	Copyright 2010 Aaron Pendley.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+// 
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+// 
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+
+
+#ifndef _QUERYCONTEXT_H_INCLUDED_
+#define _QUERYCONTEXT_H_INCLUDED_
+
+#include "Box2D.h"
+
+#include <string.h>
+
+
+// arena of scratch memory for collision queries.  memory is handed out by bumping a pointer
+// through a chain of blocks, and Reset gives it all back at once while keeping the blocks, so
+// after the first few frames a context that is reset every frame stops touching the heap.
+//
+// a context is not thread safe, use one per thread.
+class QueryContext
+{
+public:
+	static const int kDefaultBlockSize = 16 * 1024;
+	
+	explicit QueryContext( int blockSize = kDefaultBlockSize );
+	~QueryContext();
+	
+	// returns 16 byte aligned memory that stays valid until the context is reset or rewound past it
+	void* Allocate( int size );
+	
+	// releases everything allocated from the context, call once per frame
+	void Reset();
+	
+	// a position in the arena, everything allocated after it can be released with Rewind
+	struct Marker
+	{
+		void* block;
+		int offset;
+	};
+	
+	Marker GetMarker() const;
+	void Rewind( const Marker& marker );
+	
+	// number of blocks allocated from the heap over the lifetime of the context
+	int GetHeapAllocationCount() const { return mHeapAllocationCount; }
+	
+	// total size of the blocks, and the most ever used at once
+	int GetBytesReserved() const { return mBytesReserved; }
+	int GetPeakBytesUsed() const { return mPeakBytesUsed; }
+	
+private:
+	QueryContext( const QueryContext& );
+	QueryContext& operator = ( const QueryContext& );
+	
+	struct Block
+	{
+		Block* next;
+		int size;
+		int usedBefore;		// bytes used in the blocks before this one when it was entered
+	};
+	
+	char* GetBlockData( Block* block ) const;
+	
+	Block* mHead;
+	Block* mCurrent;
+	int mOffset;
+	int mBlockSize;
+	
+	int mHeapAllocationCount;
+	int mBytesReserved;
+	int mPeakBytesUsed;
+};
+
+
+// rewinds a context to where it was when the scope was entered, unless released
+class QueryContextScope
+{
+public:
+	explicit QueryContextScope( QueryContext* context )
+	: mContext(context)
+	, mMarker(context->GetMarker())
+	{
+	}
+	
+	~QueryContextScope()
+	{
+		if( mContext != NULL )
+			mContext->Rewind(mMarker);
+	}
+	
+	// keep everything allocated in the scope, e.g. when the caller owns the context and resets it itself
+	void Release() { mContext = NULL; }
+	
+private:
+	QueryContext* mContext;
+	QueryContext::Marker mMarker;
+};
+
+
+// scratch context for the calling thread, used by queries that aren't handed one.
+// queries rewind it before returning, so it only ever holds one query's worth of memory.
+QueryContext* GetThreadQueryContext();
+
+
+// growable array stored in a QueryContext.  only for plain data, elements are moved with memcpy.
+// when it grows the old storage is abandoned in the arena until the context is reset.
+template <typename T>
+class QueryArray
+{
+public:
+	explicit QueryArray( QueryContext* context, int initialCapacity = 32 )
+	: mContext(context)
+	, mData(NULL)
+	, mCount(0)
+	, mCapacity(0)
+	{
+		Reserve(initialCapacity);
+	}
+	
+	void Reserve( int capacity )
+	{
+		if( capacity <= mCapacity )
+			return;
+		
+		T* data = (T*)mContext->Allocate(capacity * (int)sizeof(T));
+		
+		if( mCount > 0 )
+			memcpy(data, mData, mCount * sizeof(T));
+		
+		mData = data;
+		mCapacity = capacity;
+	}
+	
+	void Push( const T& value )
+	{
+		if( mCount == mCapacity )
+			Reserve(mCapacity > 0 ? mCapacity * 2 : 32);
+		
+		mData[mCount] = value;
+		mCount++;
+	}
+	
+	void Truncate( int count ) { assert(count >= 0 && count <= mCount); mCount = count; }
+	void Clear() { mCount = 0; }
+	
+	T& operator [] ( int index ) { assert(index >= 0 && index < mCount); return mData[index]; }
+	const T& operator [] ( int index ) const { assert(index >= 0 && index < mCount); return mData[index]; }
+	
+	T* GetData() { return mData; }
+	const T* GetData() const { return mData; }
+	int GetCount() const { return mCount; }
+	
+private:
+	QueryContext* mContext;
+	T* mData;
+	int mCount;
+	int mCapacity;
+};
+
+
+// allocator for standard containers that need more than QueryArray, like an ordered set.  memory comes
+// from the context and deallocate does nothing, so it's only given back when the context is rewound or reset.
+template <typename T>
+class QueryAllocator
+{
+public:
+	typedef T value_type;
+	
+	explicit QueryAllocator( QueryContext* context )
+	: mContext(context)
+	{
+	}
+	
+	template <typename U>
+	QueryAllocator( const QueryAllocator<U>& other )
+	: mContext(other.mContext)
+	{
+	}
+	
+	T* allocate( size_t count ) { return (T*)mContext->Allocate((int)(count * sizeof(T))); }
+	void deallocate( T*, size_t ) {}
+	
+	template <typename U>
+	bool operator == ( const QueryAllocator<U>& other ) const { return mContext == other.mContext; }
+	
+	template <typename U>
+	bool operator != ( const QueryAllocator<U>& other ) const { return mContext != other.mContext; }
+	
+	QueryContext* mContext;
+};
+
+#endif
@@ -0,0 +1,264 @@
+//
+//	QueryDispatcher.cpp
+//
+//	Created by Aaron Pendley on 4/9/10.
+//	Copyright 2010 Aaron Pendley.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+// 
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+// 
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#include "QueryDispatcher.h"
+
+
+void ExecuteQuery( b2World* world, CollisionQuery* query )
+{
+	switch( query->type )
+	{
+		case CollisionQuery::e_aabb:
+			query->resultCount = QueryAABB(world, query->aabb, query->filter, query->fixtures, query->maxResults);
+			break;
+			
+		case CollisionQuery::e_ray:
+			query->resultCount = CollideRay(world, query->from, query->to, query->filter, query->rayResults, query->maxResults);
+			break;
+			
+		case CollisionQuery::e_rayClosest:
+			query->resultCount = CollideRayClosest(world, query->from, query->to, query->filter, query->rayResults) ? 1 : 0;
+			break;
+			
+		case CollisionQuery::e_rayAny:
+			query->resultCount = CollideRayAny(world, query->from, query->to, query->filter) ? 1 : 0;
+			break;
+			
+		case CollisionQuery::e_swept:
+			query->resultCount = CollideSwept(world, query->shape, query->xform, query->localCenter, query->motion, query->filter, query->shapeCastResults, query->maxResults);
+			break;
+			
+		case CollisionQuery::e_sweptClosest:
+			query->resultCount = CollideSweptClosest(world, query->shape, query->xform, query->localCenter, query->motion, query->filter, query->shapeCastResults) ? 1 : 0;
+			break;
+			
+		case CollisionQuery::e_sweptAny:
+			query->resultCount = CollideSweptAny(world, query->shape, query->xform, query->localCenter, query->motion, query->filter, query->shapeCastResults) ? 1 : 0;
+			break;
+	}
+}
+
+
+
+////////////////////////////////////////////////////////////////////////////
+// parallel dispatch
+
+// number of queries a worker takes from its own range at a time
+static const int kWorkerChunkSize = 16;
+
+static inline unsigned long long PackRange( int begin, int end )
+{
+	return ((unsigned long long)(unsigned int)begin << 32) | (unsigned int)end;
+}
+
+static inline void UnpackRange( unsigned long long range, int* begin, int* end )
+{
+	*begin = (int)(range >> 32);
+	*end = (int)(range & 0xFFFFFFFFull);
+}
+
+QueryDispatcher::QueryDispatcher( int workerCount )
+: mWorkers(NULL)
+, mWorkerCount(workerCount)
+, mWorld(NULL)
+, mQueries(NULL)
+, mGeneration(0)
+, mBusyThreads(0)
+, mShutdown(false)
+{
+	if( mWorkerCount <= 0 )
+	{
+		mWorkerCount = (int)std::thread::hardware_concurrency();
+		
+		if( mWorkerCount <= 0 )
+			mWorkerCount = 1;
+	}
+	
+	mWorkers = new Worker[mWorkerCount];
+	
+	for( int workerIdx = 0; workerIdx < mWorkerCount; ++workerIdx )
+		mWorkers[workerIdx].range.store(PackRange(0, 0));
+	
+	// the last worker is whoever calls Execute
+	for( int workerIdx = 0; workerIdx < mWorkerCount - 1; ++workerIdx )
+		mWorkers[workerIdx].thread = std::thread(&QueryDispatcher::ThreadMain, this, workerIdx);
+}
+
+QueryDispatcher::~QueryDispatcher()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mShutdown = true;
+	}
+	
+	mStartCondition.notify_all();
+	
+	for( int workerIdx = 0; workerIdx < mWorkerCount - 1; ++workerIdx )
+		mWorkers[workerIdx].thread.join();
+	
+	delete [] mWorkers;
+}
+
+void QueryDispatcher::Execute( b2World* world, CollisionQuery* queries, int queryCount )
+{
+	if( queryCount <= 0 )
+		return;
+	
+	mWorld = world;
+	mQueries = queries;
+	
+	// hand out contiguous ranges so neighbouring queries, which are often spatially close, run on the same worker
+	for( int workerIdx = 0; workerIdx < mWorkerCount; ++workerIdx )
+	{
+		int begin = (int)((long long)queryCount * workerIdx / mWorkerCount);
+		int end = (int)((long long)queryCount * (workerIdx + 1) / mWorkerCount);
+		mWorkers[workerIdx].range.store(PackRange(begin, end));
+	}
+	
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mBusyThreads = mWorkerCount - 1;
+		mGeneration++;
+	}
+	
+	mStartCondition.notify_all();
+	
+	RunWorker(mWorkerCount - 1);
+	
+	std::unique_lock<std::mutex> lock(mMutex);
+	
+	while( mBusyThreads > 0 )
+		mDoneCondition.wait(lock);
+	
+	mWorld = NULL;
+	mQueries = NULL;
+}
+
+void QueryDispatcher::ThreadMain( int workerIndex )
+{
+	unsigned int generation = 0;
+	
+	for( ;; )
+	{
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			
+			while( !mShutdown && generation == mGeneration )
+				mStartCondition.wait(lock);
+			
+			if( mShutdown )
+				return;
+			
+			generation = mGeneration;
+		}
+		
+		RunWorker(workerIndex);
+		
+		bool done;
+		
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mBusyThreads--;
+			done = mBusyThreads == 0;
+		}
+		
+		if( done )
+			mDoneCondition.notify_one();
+	}
+}
+
+void QueryDispatcher::RunWorker( int workerIndex )
+{
+	int begin, end;
+	
+	for( ;; )
+	{
+		if( TakeWork(workerIndex, &begin, &end) )
+		{
+			for( int queryIdx = begin; queryIdx < end; ++queryIdx )
+				ExecuteQuery(mWorld, &mQueries[queryIdx]);
+		}
+		else if( !StealWork(workerIndex) )
+		{
+			return;
+		}
+	}
+}
+
+// takes a chunk from the front of the worker's own range
+bool QueryDispatcher::TakeWork( int workerIndex, int* begin, int* end )
+{
+	std::atomic<unsigned long long>& range = mWorkers[workerIndex].range;
+	unsigned long long current = range.load();
+	
+	for( ;; )
+	{
+		int rangeBegin, rangeEnd;
+		UnpackRange(current, &rangeBegin, &rangeEnd);
+		
+		if( rangeBegin >= rangeEnd )
+			return false;
+		
+		int chunkEnd = b2Min(rangeBegin + kWorkerChunkSize, rangeEnd);
+		
+		if( range.compare_exchange_weak(current, PackRange(chunkEnd, rangeEnd)) )
+		{
+			*begin = rangeBegin;
+			*end = chunkEnd;
+			return true;
+		}
+	}
+}
+
+// takes the back half of another worker's remaining range.  the stolen queries become this
+// worker's own range, so they can in turn be stolen from it.
+bool QueryDispatcher::StealWork( int workerIndex )
+{
+	for( int offset = 1; offset < mWorkerCount; ++offset )
+	{
+		std::atomic<unsigned long long>& victim = mWorkers[(workerIndex + offset) % mWorkerCount].range;
+		unsigned long long current = victim.load();
+		
+		for( ;; )
+		{
+			int rangeBegin, rangeEnd;
+			UnpackRange(current, &rangeBegin, &rangeEnd);
+			
+			if( rangeBegin >= rangeEnd )
+				break;
+			
+			int stealBegin = rangeBegin + (rangeEnd - rangeBegin) / 2;
+			
+			if( victim.compare_exchange_weak(current, PackRange(rangeBegin, stealBegin)) )
+			{
+				// our own range is empty, nobody else will write to it until we publish this
+				mWorkers[workerIndex].range.store(PackRange(stealBegin, rangeEnd));
+				return true;
+			}
+		}
+	}
+	
+	return false;
+}
@@ -0,0 +1,153 @@
+//
+//	QueryDispatcher.h
+//
+//	Created by Aaron Pendley on 4/9/10.
+//	Copyright 2010 Aaron Pendley.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+// 
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+// 
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+
+#ifndef _QUERYDISPATCHER_H_INCLUDED_
+#define _QUERYDISPATCHER_H_INCLUDED_
+
+#include "CollisionUtil.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+
+////////////////////////////////////////////////////////////////////////////
+// query description
+
+// one collision util query, described as data so it can be run later or on another thread.
+// fill in the inputs for the query type; results go to the caller owned buffers, and
+// resultCount is set once the query has run.
+struct CollisionQuery
+{
+	enum Type
+	{
+		e_aabb,				// QueryAABB: aabb -> fixtures
+		e_ray,				// CollideRay: from, to -> rayResults
+		e_rayClosest,		// CollideRayClosest: from, to -> rayResults[0]
+		e_rayAny,			// CollideRayAny: from, to -> resultCount only
+		e_swept,			// CollideSwept: shape, xform, localCenter, motion -> shapeCastResults
+		e_sweptClosest,		// CollideSweptClosest: shape, xform, localCenter, motion -> shapeCastResults[0]
+		e_sweptAny			// CollideSweptAny: shape, xform, localCenter, motion -> shapeCastResults[0]
+	};
+	
+	CollisionQuery()
+	: type(e_rayClosest)
+	, shape(NULL)
+	, fixtures(NULL)
+	, rayResults(NULL)
+	, shapeCastResults(NULL)
+	, maxResults(1)
+	, resultCount(0)
+	{
+	}
+	
+	Type type;
+	QueryFilter filter;
+	
+	// e_aabb
+	b2AABB aabb;
+	
+	// e_ray, e_rayClosest, e_rayAny
+	b2Vec2 from;
+	b2Vec2 to;
+	
+	// e_swept, e_sweptClosest, e_sweptAny
+	b2Shape* shape;
+	b2Transform xform;
+	b2Vec2 localCenter;
+	b2Vec2 motion;
+	
+	// results, only the buffer for the query type needs to be set
+	b2Fixture** fixtures;
+	RayCastResult* rayResults;
+	ShapeCastResult* shapeCastResults;
+	int maxResults;
+	
+	// number of results written
+	int resultCount;
+};
+
+// runs a single query on the calling thread
+void ExecuteQuery( b2World* world, CollisionQuery* query );
+
+
+////////////////////////////////////////////////////////////////////////////
+// parallel dispatch
+
+// runs batches of queries on a fixed pool of worker threads.
+// queries only read the world, so a batch can run any time the world isn't being stepped
+// or modified.  each query writes only to its own result buffers, so results are the same
+// no matter which worker picked it up.  callbacks are created per query, and scratch memory
+// comes from each worker thread's own QueryContext (see GetThreadQueryContext).
+// note that Box2D's b2_gjk*/b2_toi* profiling globals are not atomic and will be miscounted
+// while a batch with swept queries runs.
+class QueryDispatcher
+{
+public:
+	// creates workerCount - 1 threads, the thread calling Execute acts as the last worker.
+	// pass 0 to use one worker per hardware thread.
+	explicit QueryDispatcher( int workerCount = 0 );
+	~QueryDispatcher();
+	
+	// runs all queries and blocks until they are finished
+	void Execute( b2World* world, CollisionQuery* queries, int queryCount );
+	
+	int GetWorkerCount() const { return mWorkerCount; }
+	
+private:
+	QueryDispatcher( const QueryDispatcher& );
+	QueryDispatcher& operator = ( const QueryDispatcher& );
+	
+	// each worker owns a range of query indices, packed as (begin << 32 | end) so that the
+	// owner taking work from the front and thieves taking work from the back can both use a
+	// single compare and swap.
+	struct Worker
+	{
+		std::atomic<unsigned long long> range;
+		std::thread thread;
+	};
+	
+	void ThreadMain( int workerIndex );
+	void RunWorker( int workerIndex );
+	bool TakeWork( int workerIndex, int* begin, int* end );
+	bool StealWork( int workerIndex );
+	
+	Worker* mWorkers;
+	int mWorkerCount;
+	
+	b2World* mWorld;
+	CollisionQuery* mQueries;
+	
+	std::mutex mMutex;
+	std::condition_variable mStartCondition;
+	std::condition_variable mDoneCondition;
+	unsigned int mGeneration;
+	int mBusyThreads;
+	bool mShutdown;
+};
+
+#endif
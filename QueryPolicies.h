@@ -0,0 +1,593 @@
+//
+//	QueryPolicies.h
+//
+//	Created by Aaron Pendley on 4/9/10.
+//	Copyright 2010 Aaron Pendley.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+// 
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+// 
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+
+
+#ifndef _QUERYPOLICIES_H_INCLUDED_
+#define _QUERYPOLICIES_H_INCLUDED_
+
+#include "CategoryIndex.h"
+#include "CollisionStats.h"
+#include "CollisionUtil.h"
+#include "QueryContext.h"
+#include "StaticBVH.h"
+
+#include <algorithm>
+
+
+// building blocks for custom broadphase queries.  a query is a template over a filter policy,
+// which decides which fixtures are considered, and a collector, which decides what to keep and
+// when to stop.  everything is resolved at compile time, so a query only pays for the features
+// it uses.  the queries talk to the broadphase directly, which means the filter runs before
+// the narrowphase ray cast rather than after it.
+//
+// CollideRay, CollideRayClosest, CollideRayAny, QueryAABB and QueryShape are all built from these.
+
+
+////////////////////////////////////////////////////////////////////////////
+// filter policies, Accept returns false to skip a fixture
+
+// mask and category test only, which is what QueryAABB has always done
+struct CategoryFilterPolicy
+{
+	explicit CategoryFilterPolicy( const QueryFilter& filter ) : mFilter(filter) {}
+	
+	bool Accept( b2Fixture* fixture ) const
+	{
+		return mFilter.test(fixture->GetFilterData());
+	}
+	
+	QueryFilter mFilter;
+};
+
+// mask and category test, and fixtures on the ignored body are skipped
+struct QueryFilterPolicy
+{
+	explicit QueryFilterPolicy( const QueryFilter& filter ) : mFilter(filter) {}
+	
+	bool Accept( b2Fixture* fixture ) const
+	{
+		if( mFilter.ignored != NULL && mFilter.ignored == fixture->GetBody()->GetUserData() )
+			return false;
+		
+		return mFilter.test(fixture->GetFilterData());
+	}
+	
+	QueryFilter mFilter;
+};
+
+// only skips fixtures on the ignored body, for trees where mask and category are already taken care of
+struct IgnoredBodyFilterPolicy
+{
+	explicit IgnoredBodyFilterPolicy( const QueryFilter& filter ) : mIgnored(filter.ignored) {}
+	
+	bool Accept( b2Fixture* fixture ) const
+	{
+		return mIgnored == NULL || mIgnored != fixture->GetBody()->GetUserData();
+	}
+	
+	void* mIgnored;
+};
+
+struct AcceptAllPolicy
+{
+	bool Accept( b2Fixture* ) const { return true; }
+};
+
+// skips fixtures on static bodies, for walking the world's broadphase after a StaticBVH that holds them
+template <class Filter>
+struct SkipStaticPolicy
+{
+	explicit SkipStaticPolicy( const Filter& filter ) : mFilter(filter) {}
+	
+	bool Accept( b2Fixture* fixture ) const
+	{
+		return fixture->GetBody()->GetType() != b2_staticBody && mFilter.Accept(fixture);
+	}
+	
+	Filter mFilter;
+};
+
+
+////////////////////////////////////////////////////////////////////////////
+// ray collectors.  Report returns what a b2RayCastCallback would:
+// 0 to stop, a fraction to clip the ray there, 1 to carry on unclipped.
+
+// stops at the first hit, for line of sight checks
+struct AnyHitCollector
+{
+	AnyHitCollector() : mFixture(NULL) {}
+	
+	float32 Report( b2Fixture* fixture, const b2Vec2&, const b2Vec2&, float32 )
+	{
+		mFixture = fixture;
+		return 0.0f;
+	}
+	
+	bool HasHit() const { return mFixture != NULL; }
+	
+	b2Fixture* mFixture;
+};
+
+// keeps the closest hit, clipping the ray at each one.  result may be NULL if only the hit matters.
+struct ClosestHitCollector
+{
+	explicit ClosestHitCollector( RayCastResult* result ) : mResult(result), mHit(false) {}
+	
+	float32 Report( b2Fixture* fixture, const b2Vec2& point, const b2Vec2& normal, float32 fraction )
+	{
+		mHit = true;
+		
+		if( mResult != NULL )
+		{
+			mResult->fixture = fixture;
+			mResult->point = point;
+			mResult->normal = normal;
+			mResult->fraction = fraction;
+		}
+		
+		return fraction;
+	}
+	
+	RayCastResult* mResult;
+	bool mHit;
+};
+
+// keeps hits in the order they are reported until the buffer is full
+struct FirstNHitsCollector
+{
+	FirstNHitsCollector( RayCastResult* results, int maxResults ) : mResults(results), mResultCount(0), mMaxResults(maxResults) {}
+	
+	float32 Report( b2Fixture* fixture, const b2Vec2& point, const b2Vec2& normal, float32 fraction )
+	{
+		if( mResultCount >= mMaxResults )
+			return 0.0f;
+		
+		RayCastResult& result = mResults[mResultCount];
+		result.fixture = fixture;
+		result.point = point;
+		result.normal = normal;
+		result.fraction = fraction;
+		
+		mResultCount++;
+		
+		if( mResultCount < mMaxResults )
+			return 1.0f;
+		
+		COLLISION_STATS_COUNT(e_statsResultBufferFull, 1);
+		return 0.0f;
+	}
+	
+	RayCastResult* mResults;
+	int mResultCount;
+	int mMaxResults;
+};
+
+// keeps the maxResults hits nearest the start of the ray.  the buffer is kept as a max heap on
+// fraction while the query runs, and the ray is clipped at the farthest hit held once it is full,
+// so only nearer hits get reported after that.  call Finish once the query is done to sort the
+// hits nearest first.
+struct NearestHitsCollector
+{
+	NearestHitsCollector( RayCastResult* results, int maxResults ) : mResults(results), mResultCount(0), mMaxResults(maxResults) {}
+	
+	static bool FractionLess( const RayCastResult& a, const RayCastResult& b ) { return a.fraction < b.fraction; }
+	
+	float32 Report( b2Fixture* fixture, const b2Vec2& point, const b2Vec2& normal, float32 fraction )
+	{
+		if( mMaxResults <= 0 )
+			return 0.0f;
+		
+		if( mResultCount == mMaxResults )
+		{
+			// a hit on the clip point itself doesn't displace anything
+			if( fraction >= mResults[0].fraction )
+				return mResults[0].fraction;
+			
+			std::pop_heap(mResults, mResults + mResultCount, FractionLess);
+			mResultCount--;
+		}
+		
+		RayCastResult& result = mResults[mResultCount];
+		result.fixture = fixture;
+		result.point = point;
+		result.normal = normal;
+		result.fraction = fraction;
+		
+		mResultCount++;
+		std::push_heap(mResults, mResults + mResultCount, FractionLess);
+		
+		return mResultCount == mMaxResults ? mResults[0].fraction : 1.0f;
+	}
+	
+	void Finish()
+	{
+		std::sort_heap(mResults, mResults + mResultCount, FractionLess);
+	}
+	
+	RayCastResult* mResults;
+	int mResultCount;
+	int mMaxResults;
+};
+
+// keeps every hit, in the order they are reported
+struct AllHitsCollector
+{
+	explicit AllHitsCollector( QueryArray<RayCastResult>* results ) : mResults(results) {}
+	
+	float32 Report( b2Fixture* fixture, const b2Vec2& point, const b2Vec2& normal, float32 fraction )
+	{
+		RayCastResult result;
+		result.fixture = fixture;
+		result.point = point;
+		result.normal = normal;
+		result.fraction = fraction;
+		
+		mResults->Push(result);
+		return 1.0f;
+	}
+	
+	QueryArray<RayCastResult>* mResults;
+};
+
+
+////////////////////////////////////////////////////////////////////////////
+// AABB collectors.  Report returns false to stop the query.
+
+struct AnyFixtureCollector
+{
+	AnyFixtureCollector() : mFixture(NULL) {}
+	
+	bool Report( b2Fixture* fixture )
+	{
+		mFixture = fixture;
+		return false;
+	}
+	
+	b2Fixture* mFixture;
+};
+
+struct FirstNFixturesCollector
+{
+	FirstNFixturesCollector( b2Fixture** results, int maxResults ) : mResults(results), mResultCount(0), mMaxResults(maxResults) {}
+	
+	bool Report( b2Fixture* fixture )
+	{
+		if( mResultCount >= mMaxResults )
+			return false;
+		
+		mResults[mResultCount] = fixture;
+		mResultCount++;
+		
+		if( mResultCount < mMaxResults )
+			return true;
+		
+		COLLISION_STATS_COUNT(e_statsResultBufferFull, 1);
+		return false;
+	}
+	
+	b2Fixture** mResults;
+	int mResultCount;
+	int mMaxResults;
+};
+
+// same as FirstNFixturesCollector, but a fixture reported again (e.g. through another pair of children)
+// is skipped, so the buffer only fills with distinct fixtures.  the check is linear in the results
+// so far, which is fine for the small buffers this is meant for.
+struct FirstNUniqueFixturesCollector
+{
+	FirstNUniqueFixturesCollector( b2Fixture** results, int maxResults ) : mResults(results), mResultCount(0), mMaxResults(maxResults) {}
+	
+	bool Report( b2Fixture* fixture )
+	{
+		if( mResultCount >= mMaxResults )
+			return false;
+		
+		for( int resultIdx = 0; resultIdx < mResultCount; ++resultIdx )
+		{
+			if( mResults[resultIdx] == fixture )
+				return true;
+		}
+		
+		mResults[mResultCount] = fixture;
+		mResultCount++;
+		
+		if( mResultCount < mMaxResults )
+			return true;
+		
+		COLLISION_STATS_COUNT(e_statsResultBufferFull, 1);
+		return false;
+	}
+	
+	b2Fixture** mResults;
+	int mResultCount;
+	int mMaxResults;
+};
+
+struct AllFixturesCollector
+{
+	explicit AllFixturesCollector( QueryArray<b2Fixture*>* results ) : mResults(results) {}
+	
+	bool Report( b2Fixture* fixture )
+	{
+		mResults->Push(fixture);
+		return true;
+	}
+	
+	QueryArray<b2Fixture*>* mResults;
+};
+
+
+////////////////////////////////////////////////////////////////////////////
+// queries
+
+// ray cast callback for a b2BroadPhase, or any b2DynamicTree whose user data are b2FixtureProxy pointers.
+// it remembers how far the ray has been clipped and whether the collector stopped it, so a ray
+// can be carried on through another tree.
+template <class Collector, class Filter, class Tree = b2BroadPhase>
+class RayCastQuery
+{
+public:
+	RayCastQuery( const Tree* tree, Collector* collector, const Filter& filter )
+	: mTree(tree)
+	, mCollector(collector)
+	, mFilter(filter)
+	, mMaxFraction(1.0f)
+	, mTerminated(false)
+	{
+	}
+	
+	float32 RayCastCallback( const b2RayCastInput& input, int32 proxyId )
+	{
+		b2FixtureProxy* proxy = (b2FixtureProxy*)mTree->GetUserData(proxyId);
+		b2Fixture* fixture = proxy->fixture;
+		
+		COLLISION_STATS_COUNT(e_statsCandidates, 1);
+		
+		// returning the current max fraction leaves the ray as it is
+		if( !mFilter.Accept(fixture) )
+		{
+			COLLISION_STATS_COUNT(e_statsFixturesFiltered, 1);
+			return input.maxFraction;
+		}
+		
+		b2RayCastOutput output;
+		
+		if( !fixture->RayCast(&output, input, proxy->childIndex) )
+			return input.maxFraction;
+		
+		// same math b2World::RayCast uses
+		float32 fraction = output.fraction;
+		b2Vec2 point = (1.0f - fraction) * input.p1 + fraction * input.p2;
+		
+		float32 value = mCollector->Report(fixture, point, output.normal, fraction);
+		
+		if( value == 0.0f )
+			mTerminated = true;
+		else if( value > 0.0f )
+			mMaxFraction = value;
+		
+		return value;
+	}
+	
+	const Tree* mTree;
+	Collector* mCollector;
+	Filter mFilter;
+	float32 mMaxFraction;
+	bool mTerminated;
+};
+
+// AABB query callback for a b2BroadPhase, or any b2DynamicTree whose user data are b2FixtureProxy pointers
+template <class Collector, class Filter, class Tree = b2BroadPhase>
+class AABBQuery
+{
+public:
+	AABBQuery( const Tree* tree, Collector* collector, const Filter& filter )
+	: mTree(tree)
+	, mCollector(collector)
+	, mFilter(filter)
+	, mTerminated(false)
+	{
+	}
+	
+	bool QueryCallback( int32 proxyId )
+	{
+		b2FixtureProxy* proxy = (b2FixtureProxy*)mTree->GetUserData(proxyId);
+		
+		COLLISION_STATS_COUNT(e_statsCandidates, 1);
+		
+		if( !mFilter.Accept(proxy->fixture) )
+		{
+			COLLISION_STATS_COUNT(e_statsFixturesFiltered, 1);
+			return true;
+		}
+		
+		if( !mCollector->Report(proxy->fixture) )
+			mTerminated = true;
+		
+		return !mTerminated;
+	}
+	
+	const Tree* mTree;
+	Collector* mCollector;
+	Filter mFilter;
+	bool mTerminated;
+};
+
+// AABB query callback that only hands on the fixtures whose shapes overlap one child of a query shape.
+// the filter runs first, so rejected fixtures never get to the narrowphase.
+template <class Collector, class Filter, class Tree = b2BroadPhase>
+class ShapeOverlapQuery
+{
+public:
+	ShapeOverlapQuery( const Tree* tree, const b2Shape* shape, int32 childIndex, const b2Transform& xform, Collector* collector, const Filter& filter )
+	: mTree(tree)
+	, mShape(shape)
+	, mChildIndex(childIndex)
+	, mXform(xform)
+	, mCollector(collector)
+	, mFilter(filter)
+	, mTerminated(false)
+	{
+	}
+	
+	bool QueryCallback( int32 proxyId )
+	{
+		b2FixtureProxy* proxy = (b2FixtureProxy*)mTree->GetUserData(proxyId);
+		b2Fixture* fixture = proxy->fixture;
+		
+		COLLISION_STATS_COUNT(e_statsCandidates, 1);
+		
+		if( !mFilter.Accept(fixture) )
+		{
+			COLLISION_STATS_COUNT(e_statsFixturesFiltered, 1);
+			return true;
+		}
+		
+		if( !b2TestOverlap(mShape, mChildIndex, fixture->GetShape(), proxy->childIndex, mXform, fixture->GetBody()->GetTransform()) )
+			return true;
+		
+		if( !mCollector->Report(fixture) )
+			mTerminated = true;
+		
+		return !mTerminated;
+	}
+	
+	const Tree* mTree;
+	const b2Shape* mShape;
+	int32 mChildIndex;
+	b2Transform mXform;
+	Collector* mCollector;
+	Filter mFilter;
+	bool mTerminated;
+};
+
+// casts a ray through the world, handing the accepted hits to the collector
+template <class Collector, class Filter>
+inline void CollideRayWith( b2World* world, const b2Vec2& from, const b2Vec2& to, Collector* collector, const Filter& filter )
+{
+	const b2BroadPhase* broadPhase = &world->GetContactManager().m_broadPhase;
+	
+	b2RayCastInput input;
+	input.p1 = from;
+	input.p2 = to;
+	input.maxFraction = 1.0f;
+	
+	RayCastQuery<Collector, Filter> query(broadPhase, collector, filter);
+	broadPhase->RayCast(&query, input);
+}
+
+// hands the accepted fixtures overlapping the AABB to the collector
+template <class Collector, class Filter>
+inline void QueryAABBWith( b2World* world, const b2AABB& aabb, Collector* collector, const Filter& filter )
+{
+	const b2BroadPhase* broadPhase = &world->GetContactManager().m_broadPhase;
+	
+	AABBQuery<Collector, Filter> query(broadPhase, collector, filter);
+	broadPhase->Query(&query, aabb);
+}
+
+// hands the accepted fixtures overlapping the shape to the collector, one broadphase query per child
+// of the shape.  a fixture is reported once for each pair of children that overlap.
+template <class Collector, class Filter>
+inline void QueryShapeWith( b2World* world, const b2Shape* shape, const b2Transform& xform, Collector* collector, const Filter& filter )
+{
+	const b2BroadPhase* broadPhase = &world->GetContactManager().m_broadPhase;
+	
+	for( int32 childIdx = 0; childIdx < shape->GetChildCount(); ++childIdx )
+	{
+		b2AABB aabb;
+		shape->ComputeAABB(&aabb, xform, childIdx);
+		
+		ShapeOverlapQuery<Collector, Filter> query(broadPhase, shape, childIdx, xform, collector, filter);
+		broadPhase->Query(&query, aabb);
+		
+		if( query.mTerminated )
+			break;
+	}
+}
+
+// casts a ray through the groups of a category index that can pass groupFilter.  the ray stays
+// clipped from one group to the next, so a closest hit query only looks past its best hit so far.
+template <class Collector, class Filter>
+inline void CollideRayWith( const CategoryIndex* index, const b2Vec2& from, const b2Vec2& to, const QueryFilter& groupFilter, Collector* collector, const Filter& filter )
+{
+	RayCastQuery<Collector, Filter, b2DynamicTree> query(NULL, collector, filter);
+	
+	b2RayCastInput input;
+	input.p1 = from;
+	input.p2 = to;
+	
+	for( int groupIdx = 0; groupIdx < index->GetGroupCount() && !query.mTerminated; ++groupIdx )
+	{
+		if( !index->GroupPasses(groupIdx, groupFilter) )
+			continue;
+		
+		query.mTree = &index->GetGroupTree(groupIdx);
+		input.maxFraction = query.mMaxFraction;
+		query.mTree->RayCast(&query, input);
+	}
+}
+
+// hands the fixtures overlapping the AABB, in the groups of a category index that can pass groupFilter, to the collector
+template <class Collector, class Filter>
+inline void QueryAABBWith( const CategoryIndex* index, const b2AABB& aabb, const QueryFilter& groupFilter, Collector* collector, const Filter& filter )
+{
+	AABBQuery<Collector, Filter, b2DynamicTree> query(NULL, collector, filter);
+	
+	for( int groupIdx = 0; groupIdx < index->GetGroupCount() && !query.mTerminated; ++groupIdx )
+	{
+		if( !index->GroupPasses(groupIdx, groupFilter) )
+			continue;
+		
+		query.mTree = &index->GetGroupTree(groupIdx);
+		query.mTree->Query(&query, aabb);
+	}
+}
+
+// casts a ray through the static BVH, then through the world's broadphase for everything else.
+// the ray goes into the world clipped wherever the collector left it in the BVH.
+template <class Collector, class Filter>
+inline void CollideRayWith( b2World* world, const StaticBVH* statics, const b2Vec2& from, const b2Vec2& to, Collector* collector, const Filter& filter )
+{
+	b2RayCastInput input;
+	input.p1 = from;
+	input.p2 = to;
+	input.maxFraction = 1.0f;
+	
+	RayCastQuery<Collector, Filter, StaticBVH> staticQuery(statics, collector, filter);
+	statics->RayCast(&staticQuery, input);
+	
+	if( staticQuery.mTerminated )
+		return;
+	
+	const b2BroadPhase* broadPhase = &world->GetContactManager().m_broadPhase;
+	input.maxFraction = staticQuery.mMaxFraction;
+	
+	RayCastQuery<Collector, SkipStaticPolicy<Filter> > query(broadPhase, collector, SkipStaticPolicy<Filter>(filter));
+	broadPhase->RayCast(&query, input);
+}
+
+#endif
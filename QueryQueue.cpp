@@ -0,0 +1,306 @@
+//
+//	QueryQueue.cpp
+//
+//	Created by Aaron Pendley on 4/9/10.
+//	Copyright 2010 Aaron Pendley.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+// 
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+// 
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+
+#include "QueryQueue.h"
+
+#include <algorithm>
+#include <chrono>
+
+
+namespace
+{
+	// queries of equal priority are executed in chunks of up to this many, sorted along a Morton curve
+	// within each chunk.  bounded so the sort stays cheap and a chunk is usually finished within the budget.
+	const int kChunkSize = 64;
+	
+	b2Vec2 GetQueryPosition( const CollisionQuery& query )
+	{
+		switch( query.type )
+		{
+			case CollisionQuery::e_aabb:
+				return 0.5f * (query.aabb.lowerBound + query.aabb.upperBound);
+				
+			case CollisionQuery::e_ray:
+			case CollisionQuery::e_rayClosest:
+			case CollisionQuery::e_rayAny:
+				return 0.5f * (query.from + query.to);
+				
+			case CollisionQuery::e_swept:
+			case CollisionQuery::e_sweptClosest:
+			case CollisionQuery::e_sweptAny:
+				return b2Mul(query.xform, query.localCenter) + 0.5f * query.motion;
+		}
+		
+		return b2Vec2(0.0f, 0.0f);
+	}
+	
+	// spreads the low 16 bits of x out to the even bits
+	uint32 SpreadBits( uint32 x )
+	{
+		x &= 0x0000ffff;
+		x = (x | (x << 8)) & 0x00ff00ff;
+		x = (x | (x << 4)) & 0x0f0f0f0f;
+		x = (x | (x << 2)) & 0x33333333;
+		x = (x | (x << 1)) & 0x55555555;
+		return x;
+	}
+	
+	struct PriorityGreater
+	{
+		template <typename T>
+		bool operator () ( const T& a, const T& b ) const
+		{
+			return a.effectivePriority > b.effectivePriority;
+		}
+	};
+	
+	struct MortonLess
+	{
+		template <typename T>
+		bool operator () ( const T& a, const T& b ) const
+		{
+			return a.mortonCode < b.mortonCode;
+		}
+	};
+	
+	float32 MillisecondsSince( std::chrono::steady_clock::time_point start )
+	{
+		std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - start;
+		return (float32)std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count() / 1000.0f;
+	}
+}
+
+QueryQueue::QueryQueue()
+: mNextHandle(1)
+, mFrame(0)
+, mSubmittedThisFrame(0)
+, mCancelledThisFrame(0)
+{
+}
+
+QueryHandle QueryQueue::Submit( const CollisionQuery& query, int priority, QueryCompletionCallback* callback )
+{
+	QueryHandle handle = mNextHandle++;
+	
+	if( mNextHandle == kInvalidQueryHandle )
+		mNextHandle = 1;
+	
+	Item item;
+	item.query = query;
+	item.query.resultCount = 0;
+	item.callback = callback;
+	item.handle = handle;
+	item.priority = priority;
+	item.submitFrame = mFrame;
+	item.effectivePriority = priority;
+	item.mortonCode = 0;
+	
+	mPending.push_back(item);
+	
+	mSubmittedThisFrame++;
+	mTotalStats.submitted++;
+	
+	return handle;
+}
+
+bool QueryQueue::Cancel( QueryHandle handle )
+{
+	if( handle == kInvalidQueryHandle )
+		return false;
+	
+	for( std::vector<Item>::iterator it = mPending.begin(); it != mPending.end(); ++it )
+	{
+		if( it->handle == handle )
+		{
+			mPending.erase(it);
+			mCancelledThisFrame++;
+			mTotalStats.cancelled++;
+			return true;
+		}
+	}
+	
+	// cancelled from a completion callback while the batch is running, skip it when its turn comes
+	for( std::vector<Item>::iterator it = mRunning.begin(); it != mRunning.end(); ++it )
+	{
+		if( it->handle == handle )
+		{
+			it->handle = kInvalidQueryHandle;
+			mCancelledThisFrame++;
+			mTotalStats.cancelled++;
+			return true;
+		}
+	}
+	
+	return mCompleted.erase(handle) > 0;
+}
+
+bool QueryQueue::IsComplete( QueryHandle handle ) const
+{
+	return mCompleted.find(handle) != mCompleted.end();
+}
+
+bool QueryQueue::GetResult( QueryHandle handle, CollisionQuery* query )
+{
+	std::unordered_map<QueryHandle, CollisionQuery>::iterator it = mCompleted.find(handle);
+	
+	if( it == mCompleted.end() )
+		return false;
+	
+	*query = it->second;
+	mCompleted.erase(it);
+	
+	return true;
+}
+
+void QueryQueue::ComputeMortonCodes( Item* items, int count )
+{
+	b2Vec2 lower(b2_maxFloat, b2_maxFloat);
+	b2Vec2 upper(-b2_maxFloat, -b2_maxFloat);
+	
+	for( int itemIdx = 0; itemIdx < count; ++itemIdx )
+	{
+		b2Vec2 p = GetQueryPosition(items[itemIdx].query);
+		lower = b2Min(lower, p);
+		upper = b2Max(upper, p);
+	}
+	
+	b2Vec2 extent = upper - lower;
+	float32 scaleX = extent.x > 0.0f ? 65535.0f / extent.x : 0.0f;
+	float32 scaleY = extent.y > 0.0f ? 65535.0f / extent.y : 0.0f;
+	
+	for( int itemIdx = 0; itemIdx < count; ++itemIdx )
+	{
+		b2Vec2 p = GetQueryPosition(items[itemIdx].query);
+		uint32 x = (uint32)((p.x - lower.x) * scaleX);
+		uint32 y = (uint32)((p.y - lower.y) * scaleY);
+		items[itemIdx].mortonCode = SpreadBits(x) | (SpreadBits(y) << 1);
+	}
+}
+
+int QueryQueue::Execute( b2World* world, float32 budgetMilliseconds )
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	
+	mFrameStats.Reset();
+	
+	// queries submitted from completion callbacks go to mPending and wait for the next frame
+	mRunning.swap(mPending);
+	
+	// every frame waited is worth one step of priority, so nothing waits forever
+	for( std::vector<Item>::iterator it = mRunning.begin(); it != mRunning.end(); ++it )
+		it->effectivePriority = it->priority + (int)(mFrame - it->submitFrame);
+	
+	// stable so that equal priorities keep submission order
+	std::stable_sort(mRunning.begin(), mRunning.end(), PriorityGreater());
+	
+	int runningCount = (int)mRunning.size();
+	int next = 0;
+	bool outOfTime = false;
+	
+	while( next < runningCount && !outOfTime )
+	{
+		// a chunk never mixes priorities, so reordering it for locality can't run a query ahead of a more important one
+		int chunkEnd = next + 1;
+		
+		while( chunkEnd < runningCount && chunkEnd - next < kChunkSize && mRunning[chunkEnd].effectivePriority == mRunning[next].effectivePriority )
+			chunkEnd++;
+		
+		ComputeMortonCodes(&mRunning[next], chunkEnd - next);
+		std::sort(mRunning.begin() + next, mRunning.begin() + chunkEnd, MortonLess());
+		
+		for( ; next < chunkEnd; ++next )
+		{
+			// the budget is checked before each query, so at least one query runs every frame
+			if( mFrameStats.executed > 0 && MillisecondsSince(start) >= budgetMilliseconds )
+			{
+				outOfTime = true;
+				break;
+			}
+			
+			Item& item = mRunning[next];
+			
+			if( item.handle == kInvalidQueryHandle )
+				continue;
+			
+			ExecuteQuery(world, &item.query);
+			
+			// it has run, so a callback cancelling it from here on must not find it in mRunning
+			QueryHandle handle = item.handle;
+			item.handle = kInvalidQueryHandle;
+			
+			int waitFrames = (int)(mFrame - item.submitFrame);
+			
+			mFrameStats.executed++;
+			mFrameStats.totalWaitFrames += waitFrames;
+			mFrameStats.maxWaitFrames = b2Max(mFrameStats.maxWaitFrames, waitFrames);
+			
+			if( waitFrames >= kStarvationFrames )
+				mFrameStats.starved++;
+			
+			if( item.callback )
+				item.callback->QueryCompleted(handle, item.query);
+			else
+				mCompleted[handle] = item.query;
+		}
+	}
+	
+	// whatever didn't fit goes back in front of the queries submitted during the batch
+	for( int itemIdx = next; itemIdx < runningCount; ++itemIdx )
+	{
+		if( mRunning[itemIdx].handle != kInvalidQueryHandle )
+			mFrameStats.carriedOver++;
+	}
+	
+	if( next < runningCount )
+	{
+		mPending.insert(mPending.begin(), mRunning.begin() + next, mRunning.end());
+		
+		// drop anything cancelled from a callback
+		for( std::vector<Item>::iterator it = mPending.begin(); it != mPending.end(); )
+			it = it->handle == kInvalidQueryHandle ? mPending.erase(it) : it + 1;
+	}
+	
+	mRunning.clear();
+	
+	mFrameStats.executeMilliseconds = MillisecondsSince(start);
+	
+	mTotalStats.executed += mFrameStats.executed;
+	mTotalStats.carriedOver += mFrameStats.carriedOver;
+	mTotalStats.starved += mFrameStats.starved;
+	mTotalStats.totalWaitFrames += mFrameStats.totalWaitFrames;
+	mTotalStats.maxWaitFrames = b2Max(mTotalStats.maxWaitFrames, mFrameStats.maxWaitFrames);
+	mTotalStats.executeMilliseconds += mFrameStats.executeMilliseconds;
+	
+	// submissions and cancels made since the last Execute, including from callbacks, count toward this frame
+	mFrameStats.submitted = mSubmittedThisFrame;
+	mFrameStats.cancelled = mCancelledThisFrame;
+	mSubmittedThisFrame = 0;
+	mCancelledThisFrame = 0;
+	
+	mFrame++;
+	
+	return mFrameStats.executed;
+}
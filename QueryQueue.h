@@ -0,0 +1,147 @@
+//
+//	QueryQueue.h
+//
+//	Created by Aaron Pendley on 4/9/10.
+//	Copyright 2010 Aaron Pendley.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+// 
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+// 
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+
+#ifndef _QUERYQUEUE_H_INCLUDED_
+#define _QUERYQUEUE_H_INCLUDED_
+
+#include "QueryDispatcher.h"
+
+#include <unordered_map>
+#include <vector>
+
+
+typedef unsigned int QueryHandle;
+
+static const QueryHandle kInvalidQueryHandle = 0;
+
+// told when a queued query has run.  the query's result buffers hold the results.
+class QueryCompletionCallback
+{
+public:
+	virtual ~QueryCompletionCallback() {}
+	virtual void QueryCompleted( QueryHandle handle, const CollisionQuery& query ) = 0;
+};
+
+struct QueryQueueStats
+{
+	QueryQueueStats() { Reset(); }
+	
+	void Reset()
+	{
+		submitted = 0;
+		executed = 0;
+		cancelled = 0;
+		carriedOver = 0;
+		starved = 0;
+		totalWaitFrames = 0;
+		maxWaitFrames = 0;
+		executeMilliseconds = 0.0f;
+	}
+	
+	float32 GetAverageWaitFrames() const { return executed > 0 ? (float32)totalWaitFrames / (float32)executed : 0.0f; }
+	
+	int submitted;
+	int executed;
+	int cancelled;
+	int carriedOver;			// queries left for a later frame when the budget ran out
+	int starved;				// queries that ran kStarvationFrames or more frames after they were submitted
+	int totalWaitFrames;		// frames between submitting and running, summed over executed queries
+	int maxWaitFrames;
+	float32 executeMilliseconds;
+};
+
+// collects queries from gameplay through the frame and runs them as one batch, right after
+// b2World::Step, within a time budget.
+//
+// queries run highest priority first.  a query's priority goes up by one for each frame it waits,
+// so low priority queries that don't fit in the budget still run eventually.  queries of equal priority
+// are taken in chunks, and each chunk is sorted along a Morton curve so that queries near each other run one
+// after another and find the broadphase and fixtures they need still in the cache.
+//
+// when a query has run, its callback is called, or, without a callback, IsComplete turns true and
+// GetResult hands the query back.  the query's result buffers belong to the caller and must stay
+// valid until then.  not thread safe.
+class QueryQueue
+{
+public:
+	// queries waiting this many frames or more count as starved in the stats
+	static const int kStarvationFrames = 10;
+	
+	QueryQueue();
+	
+	// queues a query to run in a later Execute.  callback may be NULL, then poll IsComplete.
+	QueryHandle Submit( const CollisionQuery& query, int priority = 0, QueryCompletionCallback* callback = NULL );
+	
+	// removes a query that hasn't run yet, or drops the result of one that has.  returns false if
+	// the handle isn't known.
+	bool Cancel( QueryHandle handle );
+	
+	// true once a query submitted without a callback has run
+	bool IsComplete( QueryHandle handle ) const;
+	
+	// copies out a completed query, with resultCount set, and forgets the handle
+	bool GetResult( QueryHandle handle, CollisionQuery* query );
+	
+	// runs queued queries until they are all done or budgetMilliseconds has passed, and starts a new frame.
+	// call it once per frame, right after stepping the world.  returns the number of queries run.
+	int Execute( b2World* world, float32 budgetMilliseconds );
+	
+	int GetPendingCount() const { return (int)mPending.size(); }
+	
+	// stats for the last Execute, and accumulated since the queue was created
+	const QueryQueueStats& GetFrameStats() const { return mFrameStats; }
+	const QueryQueueStats& GetTotalStats() const { return mTotalStats; }
+	
+private:
+	struct Item
+	{
+		CollisionQuery query;
+		QueryCompletionCallback* callback;
+		QueryHandle handle;
+		int priority;
+		unsigned int submitFrame;
+		
+		// filled in by Execute
+		int effectivePriority;
+		uint32 mortonCode;
+	};
+	
+	void ComputeMortonCodes( Item* items, int count );
+	
+	std::vector<Item> mPending;
+	std::vector<Item> mRunning;
+	std::unordered_map<QueryHandle, CollisionQuery> mCompleted;
+	
+	QueryHandle mNextHandle;
+	unsigned int mFrame;
+	int mSubmittedThisFrame;
+	int mCancelledThisFrame;
+	
+	QueryQueueStats mFrameStats;
+	QueryQueueStats mTotalStats;
+};
+
+#endif
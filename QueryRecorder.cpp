@@ -0,0 +1,843 @@
+//
+//	QueryRecorder.cpp
+//
+//	Created by Aaron Pendley on 4/9/10.
+//	Copyright 2010 Aaron Pendley.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+// 
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+// 
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+
+#include "QueryRecorder.h"
+
+#include <algorithm>
+#include <string.h>
+
+
+static const char kCaptureMagic[4] = { 'B', '2', 'Q', 'R' };
+static const unsigned int kCaptureVersion = 2;
+
+enum CaptureRecord
+{
+	e_worldRecord = 1,
+	e_queryRecord = 2
+};
+
+// id for a fixture or user data pointer the recorder didn't see in the last world
+static const unsigned int kUnknownId = 0xFFFFFFFF;
+
+// results compared within these, to allow for a different order of operations in a rebuilt broadphase
+static const float32 kFractionTolerance = 1e-4f;
+static const float32 kPositionTolerance = 1e-3f;
+
+// the replayer sizes its result buffers from maxResults, so a capture can't ask for more than this
+static const int kMaxRecordedResults = 1 << 16;
+
+
+////////////////////////////////////////////////////////////////////////////
+// writing
+
+// a record is built up in memory, then written in one go so records from different threads don't interleave
+class CaptureBuffer
+{
+public:
+	template <typename T>
+	void Put( const T& value )
+	{
+		const unsigned char* bytes = (const unsigned char*)&value;
+		mData.insert(mData.end(), bytes, bytes + sizeof(T));
+	}
+	
+	void PutVec2( const b2Vec2& v )
+	{
+		Put(v.x);
+		Put(v.y);
+	}
+	
+	void Write( FILE* file ) const
+	{
+		if( !mData.empty() )
+			fwrite(&mData[0], 1, mData.size(), file);
+	}
+	
+private:
+	std::vector<unsigned char> mData;
+};
+
+static void PutShape( CaptureBuffer* buffer, const b2Shape* shape )
+{
+	buffer->Put((unsigned char)shape->m_type);
+	buffer->Put(shape->m_radius);
+	
+	switch( shape->m_type )
+	{
+		case b2Shape::e_circle:
+		{
+			const b2CircleShape* circle = (const b2CircleShape*)shape;
+			buffer->PutVec2(circle->m_p);
+			break;
+		}
+			
+		case b2Shape::e_polygon:
+		{
+			const b2PolygonShape* polygon = (const b2PolygonShape*)shape;
+			buffer->Put((unsigned int)polygon->m_vertexCount);
+			
+			for( int vertexIdx = 0; vertexIdx < polygon->m_vertexCount; ++vertexIdx )
+				buffer->PutVec2(polygon->m_vertices[vertexIdx]);
+			
+			break;
+		}
+			
+		case b2Shape::e_edge:
+		{
+			const b2EdgeShape* edge = (const b2EdgeShape*)shape;
+			buffer->PutVec2(edge->m_vertex0);
+			buffer->PutVec2(edge->m_vertex1);
+			buffer->PutVec2(edge->m_vertex2);
+			buffer->PutVec2(edge->m_vertex3);
+			buffer->Put((unsigned char)edge->m_hasVertex0);
+			buffer->Put((unsigned char)edge->m_hasVertex3);
+			break;
+		}
+			
+		case b2Shape::e_chain:
+		{
+			const b2ChainShape* chain = (const b2ChainShape*)shape;
+			buffer->Put((unsigned int)chain->m_count);
+			
+			for( int vertexIdx = 0; vertexIdx < chain->m_count; ++vertexIdx )
+				buffer->PutVec2(chain->m_vertices[vertexIdx]);
+			
+			break;
+		}
+			
+		default:
+			assert(false);
+			break;
+	}
+}
+
+QueryRecorder::QueryRecorder()
+: mFile(NULL)
+, mQueryCount(0)
+{
+}
+
+QueryRecorder::~QueryRecorder()
+{
+	Close();
+}
+
+bool QueryRecorder::Open( const char* path )
+{
+	Close();
+	
+	mFile = fopen(path, "wb");
+	
+	if( mFile == NULL )
+		return false;
+	
+	fwrite(kCaptureMagic, 1, sizeof(kCaptureMagic), mFile);
+	fwrite(&kCaptureVersion, sizeof(kCaptureVersion), 1, mFile);
+	
+	mQueryCount = 0;
+	return true;
+}
+
+void QueryRecorder::Close()
+{
+	if( mFile != NULL )
+	{
+		fclose(mFile);
+		mFile = NULL;
+	}
+	
+	mFixtureIds.clear();
+	mUserDataIds.clear();
+}
+
+void QueryRecorder::RecordWorld( b2World* world )
+{
+	if( mFile == NULL )
+		return;
+	
+	mFixtureIds.clear();
+	mUserDataIds.clear();
+	
+	CaptureBuffer buffer;
+	buffer.Put((unsigned char)e_worldRecord);
+	buffer.Put((unsigned int)world->GetBodyCount());
+	
+	for( b2Body* body = world->GetBodyList(); body != NULL; body = body->GetNext() )
+	{
+		// bodies sharing user data share an id, so the ignored body of a filter matches all of them
+		unsigned int userDataId = 0;
+		
+		if( body->GetUserData() != NULL )
+		{
+			std::unordered_map<void*, unsigned int>::iterator found = mUserDataIds.find(body->GetUserData());
+			
+			if( found == mUserDataIds.end() )
+			{
+				userDataId = (unsigned int)mUserDataIds.size() + 1;
+				mUserDataIds[body->GetUserData()] = userDataId;
+			}
+			else
+			{
+				userDataId = found->second;
+			}
+		}
+		
+		unsigned int fixtureCount = 0;
+		
+		for( b2Fixture* fixture = body->GetFixtureList(); fixture != NULL; fixture = fixture->GetNext() )
+			fixtureCount++;
+		
+		buffer.Put((unsigned char)body->GetType());
+		buffer.PutVec2(body->GetPosition());
+		buffer.Put(body->GetAngle());
+		buffer.Put((unsigned char)body->IsActive());
+		buffer.Put(userDataId);
+		buffer.Put(fixtureCount);
+		
+		for( b2Fixture* fixture = body->GetFixtureList(); fixture != NULL; fixture = fixture->GetNext() )
+		{
+			unsigned int fixtureId = (unsigned int)mFixtureIds.size();
+			mFixtureIds[fixture] = fixtureId;
+			
+			const b2Filter& filter = fixture->GetFilterData();
+			
+			PutShape(&buffer, fixture->GetShape());
+			buffer.Put(fixture->GetDensity());
+			buffer.Put(fixture->GetFriction());
+			buffer.Put(fixture->GetRestitution());
+			buffer.Put((unsigned char)fixture->IsSensor());
+			buffer.Put(filter.categoryBits);
+			buffer.Put(filter.maskBits);
+			buffer.Put(filter.groupIndex);
+		}
+	}
+	
+	std::lock_guard<std::mutex> lock(mMutex);
+	buffer.Write(mFile);
+}
+
+unsigned int QueryRecorder::GetFixtureId( const b2Fixture* fixture ) const
+{
+	std::unordered_map<const b2Fixture*, unsigned int>::const_iterator found = mFixtureIds.find(fixture);
+	return found != mFixtureIds.end() ? found->second : kUnknownId;
+}
+
+unsigned int QueryRecorder::GetUserDataId( void* userData ) const
+{
+	if( userData == NULL )
+		return 0;
+	
+	std::unordered_map<void*, unsigned int>::const_iterator found = mUserDataIds.find(userData);
+	return found != mUserDataIds.end() ? found->second : kUnknownId;
+}
+
+void QueryRecorder::RecordQuery( const CollisionQuery& query )
+{
+	if( mFile == NULL )
+		return;
+	
+	// the id maps only change in RecordWorld, so the record can be built without the lock
+	CaptureBuffer buffer;
+	buffer.Put((unsigned char)e_queryRecord);
+	buffer.Put((unsigned char)query.type);
+	buffer.Put(query.filter.maskFilter);
+	buffer.Put(query.filter.categoryFilter);
+	buffer.Put(GetUserDataId(query.filter.ignored));
+	buffer.Put(query.maxResults);
+	
+	switch( query.type )
+	{
+		case CollisionQuery::e_aabb:
+			buffer.PutVec2(query.aabb.lowerBound);
+			buffer.PutVec2(query.aabb.upperBound);
+			break;
+			
+		case CollisionQuery::e_ray:
+		case CollisionQuery::e_rayClosest:
+		case CollisionQuery::e_rayAny:
+			buffer.PutVec2(query.from);
+			buffer.PutVec2(query.to);
+			break;
+			
+		case CollisionQuery::e_swept:
+		case CollisionQuery::e_sweptClosest:
+		case CollisionQuery::e_sweptAny:
+			PutShape(&buffer, query.shape);
+			buffer.PutVec2(query.xform.position);
+			buffer.Put(query.xform.GetAngle());
+			buffer.PutVec2(query.localCenter);
+			buffer.PutVec2(query.motion);
+			break;
+	}
+	
+	// CollideRayAny has nothing to record but whether it hit
+	int resultCount = query.resultCount;
+	buffer.Put(resultCount);
+	
+	for( int resultIdx = 0; resultIdx < resultCount; ++resultIdx )
+	{
+		switch( query.type )
+		{
+			case CollisionQuery::e_aabb:
+				buffer.Put(GetFixtureId(query.fixtures[resultIdx]));
+				break;
+				
+			case CollisionQuery::e_ray:
+			case CollisionQuery::e_rayClosest:
+			{
+				const RayCastResult& result = query.rayResults[resultIdx];
+				buffer.Put(GetFixtureId(result.fixture));
+				buffer.PutVec2(result.point);
+				buffer.PutVec2(result.normal);
+				buffer.Put(result.fraction);
+				break;
+			}
+				
+			case CollisionQuery::e_swept:
+			case CollisionQuery::e_sweptClosest:
+			case CollisionQuery::e_sweptAny:
+			{
+				const ShapeCastResult& result = query.shapeCastResults[resultIdx];
+				buffer.Put(GetFixtureId(result.fixture));
+				buffer.PutVec2(result.normal);
+				buffer.PutVec2(result.contactPoint);
+				buffer.PutVec2(result.toi);
+				break;
+			}
+				
+			case CollisionQuery::e_rayAny:
+				break;
+		}
+	}
+	
+	std::lock_guard<std::mutex> lock(mMutex);
+	buffer.Write(mFile);
+	mQueryCount++;
+}
+
+void QueryRecorder::Execute( b2World* world, CollisionQuery* query )
+{
+	ExecuteQuery(world, query);
+	RecordQuery(*query);
+}
+
+
+////////////////////////////////////////////////////////////////////////////
+// reading
+
+template <typename T>
+static inline bool Get( FILE* file, T* value )
+{
+	return fread(value, sizeof(T), 1, file) == 1;
+}
+
+static inline bool GetVec2( FILE* file, b2Vec2* v )
+{
+	return Get(file, &v->x) && Get(file, &v->y);
+}
+
+// reads a shape into one of the shapes in storage and returns it, or NULL if it can't be read
+static b2Shape* GetShape( FILE* file, RecordedShapes* storage )
+{
+	unsigned char type;
+	float32 radius;
+	
+	if( !Get(file, &type) || !Get(file, &radius) )
+		return NULL;
+	
+	b2Shape* shape = NULL;
+	
+	switch( type )
+	{
+		case b2Shape::e_circle:
+			if( !GetVec2(file, &storage->circle.m_p) )
+				return NULL;
+			
+			shape = &storage->circle;
+			break;
+			
+		case b2Shape::e_polygon:
+		{
+			unsigned int vertexCount;
+			b2Vec2 vertices[b2_maxPolygonVertices];
+			
+			if( !Get(file, &vertexCount) || vertexCount > b2_maxPolygonVertices )
+				return NULL;
+			
+			for( unsigned int vertexIdx = 0; vertexIdx < vertexCount; ++vertexIdx )
+			{
+				if( !GetVec2(file, &vertices[vertexIdx]) )
+					return NULL;
+			}
+			
+			storage->polygon.Set(vertices, (int32)vertexCount);
+			shape = &storage->polygon;
+			break;
+		}
+			
+		case b2Shape::e_edge:
+		{
+			b2EdgeShape& edge = storage->edge;
+			unsigned char hasVertex0;
+			unsigned char hasVertex3;
+			
+			if( !GetVec2(file, &edge.m_vertex0) || !GetVec2(file, &edge.m_vertex1) || !GetVec2(file, &edge.m_vertex2) || !GetVec2(file, &edge.m_vertex3) ||
+			    !Get(file, &hasVertex0) || !Get(file, &hasVertex3) )
+				return NULL;
+			
+			edge.m_hasVertex0 = hasVertex0 != 0;
+			edge.m_hasVertex3 = hasVertex3 != 0;
+			shape = &edge;
+			break;
+		}
+			
+		case b2Shape::e_chain:
+		{
+			unsigned int vertexCount;
+			
+			if( !Get(file, &vertexCount) || vertexCount < 2 )
+				return NULL;
+			
+			std::vector<b2Vec2> vertices(vertexCount);
+			
+			for( unsigned int vertexIdx = 0; vertexIdx < vertexCount; ++vertexIdx )
+			{
+				if( !GetVec2(file, &vertices[vertexIdx]) )
+					return NULL;
+			}
+			
+			// a loop was stored with its closing vertex, so as a plain chain it has the same edges
+			delete storage->chain;
+			storage->chain = new b2ChainShape();
+			storage->chain->CreateChain(&vertices[0], (int32)vertexCount);
+			shape = storage->chain;
+			break;
+		}
+			
+		default:
+			return NULL;
+	}
+	
+	shape->m_radius = radius;
+	return shape;
+}
+
+QueryReplayer::QueryReplayer()
+: mFile(NULL)
+, mWorld(NULL)
+, mWorldCount(0)
+{
+}
+
+QueryReplayer::~QueryReplayer()
+{
+	Close();
+}
+
+bool QueryReplayer::Open( const char* path )
+{
+	Close();
+	
+	mFile = fopen(path, "rb");
+	
+	if( mFile == NULL )
+		return false;
+	
+	char magic[4];
+	unsigned int version;
+	
+	if( fread(magic, 1, sizeof(magic), mFile) != sizeof(magic) || memcmp(magic, kCaptureMagic, sizeof(magic)) != 0 ||
+	    !Get(mFile, &version) || version != kCaptureVersion )
+	{
+		Close();
+		return false;
+	}
+	
+	return true;
+}
+
+void QueryReplayer::Close()
+{
+	if( mFile != NULL )
+	{
+		fclose(mFile);
+		mFile = NULL;
+	}
+	
+	delete mWorld;
+	mWorld = NULL;
+	mWorldCount = 0;
+	
+	mFixtures.clear();
+	mUserData.clear();
+}
+
+bool QueryReplayer::ReadWorld()
+{
+	delete mWorld;
+	mWorld = new b2World(b2Vec2(0.0f, 0.0f));
+	mWorldCount++;
+	
+	mFixtures.clear();
+	
+	unsigned int bodyCount;
+	
+	if( !Get(mFile, &bodyCount) )
+		return false;
+	
+	// entry 0 stands in for pointers the recorder didn't know about, so it matches no body
+	mUserData.assign(bodyCount + 1, 0);
+	
+	RecordedShapes shapes;
+	
+	for( unsigned int bodyIdx = 0; bodyIdx < bodyCount; ++bodyIdx )
+	{
+		unsigned char type;
+		unsigned char active;
+		unsigned int userDataId;
+		unsigned int fixtureCount;
+		
+		b2BodyDef bodyDef;
+		
+		if( !Get(mFile, &type) || !GetVec2(mFile, &bodyDef.position) || !Get(mFile, &bodyDef.angle) || !Get(mFile, &active) || !Get(mFile, &userDataId) || !Get(mFile, &fixtureCount) )
+			return false;
+		
+		bodyDef.type = (b2BodyType)type;
+		bodyDef.active = active != 0;
+		bodyDef.userData = GetUserData(userDataId);
+		
+		b2Body* body = mWorld->CreateBody(&bodyDef);
+		
+		for( unsigned int fixtureIdx = 0; fixtureIdx < fixtureCount; ++fixtureIdx )
+		{
+			b2FixtureDef fixtureDef;
+			unsigned char isSensor;
+			
+			fixtureDef.shape = GetShape(mFile, &shapes);
+			
+			if( fixtureDef.shape == NULL || !Get(mFile, &fixtureDef.density) || !Get(mFile, &fixtureDef.friction) || !Get(mFile, &fixtureDef.restitution) ||
+			    !Get(mFile, &isSensor) || !Get(mFile, &fixtureDef.filter.categoryBits) || !Get(mFile, &fixtureDef.filter.maskBits) || !Get(mFile, &fixtureDef.filter.groupIndex) )
+				return false;
+			
+			fixtureDef.isSensor = isSensor != 0;
+			
+			mFixtures.push_back(body->CreateFixture(&fixtureDef));
+		}
+	}
+	
+	return true;
+}
+
+b2Fixture* QueryReplayer::GetFixture( unsigned int fixtureId ) const
+{
+	return fixtureId < mFixtures.size() ? mFixtures[fixtureId] : NULL;
+}
+
+void* QueryReplayer::GetUserData( unsigned int userDataId )
+{
+	if( userDataId == 0 )
+		return NULL;
+	
+	if( userDataId >= mUserData.size() )
+		return &mUserData[0];
+	
+	return &mUserData[userDataId];
+}
+
+QueryReplayer::ReadStatus QueryReplayer::ReadQuery( RecordedQuery* recorded )
+{
+	if( mFile == NULL )
+		return e_readError;
+	
+	unsigned char record;
+	
+	for( ;; )
+	{
+		// running out here is the end of the capture, anywhere else it was cut short
+		if( !Get(mFile, &record) )
+			return ferror(mFile) ? e_readError : e_readEnd;
+		
+		if( record == e_queryRecord )
+			break;
+		
+		if( record != e_worldRecord || !ReadWorld() )
+			return e_readError;
+	}
+	
+	// a query before any world would have nothing to run against
+	if( mWorld == NULL )
+		return e_readError;
+	
+	CollisionQuery& query = recorded->query;
+	query = CollisionQuery();
+	
+	unsigned char type;
+	unsigned int ignoredId;
+	
+	if( !Get(mFile, &type) || type > CollisionQuery::e_sweptAny || !Get(mFile, &query.filter.maskFilter) || !Get(mFile, &query.filter.categoryFilter) ||
+	    !Get(mFile, &ignoredId) || !Get(mFile, &query.maxResults) )
+		return e_readError;
+	
+	query.type = (CollisionQuery::Type)type;
+	query.filter.ignored = GetUserData(ignoredId);
+	
+	switch( query.type )
+	{
+		case CollisionQuery::e_aabb:
+			if( !GetVec2(mFile, &query.aabb.lowerBound) || !GetVec2(mFile, &query.aabb.upperBound) )
+				return e_readError;
+			
+			break;
+			
+		case CollisionQuery::e_ray:
+		case CollisionQuery::e_rayClosest:
+		case CollisionQuery::e_rayAny:
+			if( !GetVec2(mFile, &query.from) || !GetVec2(mFile, &query.to) )
+				return e_readError;
+			
+			break;
+			
+		case CollisionQuery::e_swept:
+		case CollisionQuery::e_sweptClosest:
+		case CollisionQuery::e_sweptAny:
+		{
+			b2Vec2 position;
+			float32 angle;
+			
+			query.shape = GetShape(mFile, &recorded->shapes);
+			
+			if( query.shape == NULL || !GetVec2(mFile, &position) || !Get(mFile, &angle) || !GetVec2(mFile, &query.localCenter) || !GetVec2(mFile, &query.motion) )
+				return e_readError;
+			
+			query.xform.Set(position, angle);
+			break;
+		}
+	}
+	
+	if( !Get(mFile, &recorded->resultCount) || recorded->resultCount < 0 || recorded->resultCount > kMaxRecordedResults )
+		return e_readError;
+	
+	// any buffer with room for one more than was found behaves the same, and a corrupt maxResults can't make the replayer allocate much
+	if( recorded->resultCount > b2Max(query.maxResults, 1) )
+		return e_readError;
+	
+	query.maxResults = b2Min(query.maxResults, recorded->resultCount + 1);
+	
+	recorded->fixtures.clear();
+	recorded->rayResults.clear();
+	recorded->shapeCastResults.clear();
+	
+	for( int resultIdx = 0; resultIdx < recorded->resultCount; ++resultIdx )
+	{
+		unsigned int fixtureId;
+		
+		switch( query.type )
+		{
+			case CollisionQuery::e_aabb:
+				if( !Get(mFile, &fixtureId) )
+					return e_readError;
+				
+				recorded->fixtures.push_back(GetFixture(fixtureId));
+				break;
+				
+			case CollisionQuery::e_ray:
+			case CollisionQuery::e_rayClosest:
+			{
+				RayCastResult result;
+				
+				if( !Get(mFile, &fixtureId) || !GetVec2(mFile, &result.point) || !GetVec2(mFile, &result.normal) || !Get(mFile, &result.fraction) )
+					return e_readError;
+				
+				result.fixture = GetFixture(fixtureId);
+				recorded->rayResults.push_back(result);
+				break;
+			}
+				
+			case CollisionQuery::e_swept:
+			case CollisionQuery::e_sweptClosest:
+			case CollisionQuery::e_sweptAny:
+			{
+				ShapeCastResult result;
+				
+				if( !Get(mFile, &fixtureId) || !GetVec2(mFile, &result.normal) || !GetVec2(mFile, &result.contactPoint) || !GetVec2(mFile, &result.toi) )
+					return e_readError;
+				
+				result.fixture = GetFixture(fixtureId);
+				recorded->shapeCastResults.push_back(result);
+				break;
+			}
+				
+			case CollisionQuery::e_rayAny:
+				break;
+		}
+	}
+	
+	return e_readQuery;
+}
+
+
+////////////////////////////////////////////////////////////////////////////
+// comparison
+
+static inline bool IsClose( const b2Vec2& a, const b2Vec2& b )
+{
+	return b2Abs(a.x - b.x) <= kPositionTolerance && b2Abs(a.y - b.y) <= kPositionTolerance;
+}
+
+static bool RayResultLess( const RayCastResult& a, const RayCastResult& b )
+{
+	return a.fixture != b.fixture ? a.fixture < b.fixture : a.fraction < b.fraction;
+}
+
+static bool ShapeCastResultLess( const ShapeCastResult& a, const ShapeCastResult& b )
+{
+	return a.fixture < b.fixture;
+}
+
+// whether any child of the fixture overlaps the box, computed from the shape so inactive bodies work too
+static bool OverlapsTightly( const b2Fixture* fixture, const b2AABB& aabb )
+{
+	const b2Shape* shape = fixture->GetShape();
+	const b2Transform& xform = fixture->GetBody()->GetTransform();
+	
+	for( int32 childIdx = 0; childIdx < shape->GetChildCount(); ++childIdx )
+	{
+		b2AABB childAABB;
+		shape->ComputeAABB(&childAABB, xform, childIdx);
+		
+		if( b2TestOverlap(childAABB, aabb) )
+			return true;
+	}
+	
+	return false;
+}
+
+// the fixtures that really overlap the box, sorted; the rest were only reached through the tree's fat AABBs, which depend on the world's history
+static std::vector<b2Fixture*> TightOverlaps( b2Fixture* const* fixtures, int count, const b2AABB& aabb )
+{
+	std::vector<b2Fixture*> overlaps;
+	
+	for( int fixtureIdx = 0; fixtureIdx < count; ++fixtureIdx )
+	{
+		// a fixture the recorder didn't know about is kept, so it still shows up as a mismatch
+		if( fixtures[fixtureIdx] == NULL || OverlapsTightly(fixtures[fixtureIdx], aabb) )
+			overlaps.push_back(fixtures[fixtureIdx]);
+	}
+	
+	std::sort(overlaps.begin(), overlaps.end());
+	return overlaps;
+}
+
+bool CompareQueryResults( const RecordedQuery& recorded, const CollisionQuery& replayed )
+{
+	if( replayed.type == CollisionQuery::e_aabb )
+	{
+		// the recorded and rebuilt trees have different fat AABBs, so the counts can differ while both are right
+		std::vector<b2Fixture*> expected = TightOverlaps(recorded.fixtures.empty() ? NULL : &recorded.fixtures[0], recorded.resultCount, replayed.aabb);
+		std::vector<b2Fixture*> actual = TightOverlaps(replayed.fixtures, replayed.resultCount, replayed.aabb);
+		
+		// a full buffer holds whichever fixtures the broadphase reached first, so it can only be checked against a complete one
+		bool recordedFull = recorded.resultCount >= replayed.maxResults;
+		bool replayedFull = replayed.resultCount >= replayed.maxResults;
+		
+		if( recordedFull && replayedFull )
+			return true;
+		
+		if( recordedFull )
+			return std::includes(actual.begin(), actual.end(), expected.begin(), expected.end());
+		
+		if( replayedFull )
+			return std::includes(expected.begin(), expected.end(), actual.begin(), actual.end());
+		
+		return expected == actual;
+	}
+	
+	if( recorded.resultCount != replayed.resultCount )
+		return false;
+	
+	int count = replayed.resultCount;
+	
+	// a full buffer holds whichever fixtures the broadphase reached first
+	bool truncated = count >= replayed.maxResults;
+	
+	switch( replayed.type )
+	{
+		case CollisionQuery::e_aabb:
+			break;
+			
+		case CollisionQuery::e_ray:
+		{
+			if( truncated )
+				return true;
+			
+			std::vector<RayCastResult> expected(recorded.rayResults);
+			std::vector<RayCastResult> actual(replayed.rayResults, replayed.rayResults + count);
+			std::sort(expected.begin(), expected.end(), RayResultLess);
+			std::sort(actual.begin(), actual.end(), RayResultLess);
+			
+			for( int resultIdx = 0; resultIdx < count; ++resultIdx )
+			{
+				if( expected[resultIdx].fixture != actual[resultIdx].fixture || b2Abs(expected[resultIdx].fraction - actual[resultIdx].fraction) > kFractionTolerance )
+					return false;
+			}
+			
+			return true;
+		}
+			
+		case CollisionQuery::e_rayClosest:
+			// two fixtures hit at the same distance can come back either way round, so only the distance has to match
+			return count == 0 || b2Abs(recorded.rayResults[0].fraction - replayed.rayResults[0].fraction) <= kFractionTolerance;
+			
+		case CollisionQuery::e_swept:
+		{
+			if( truncated )
+				return true;
+			
+			std::vector<ShapeCastResult> expected(recorded.shapeCastResults);
+			std::vector<ShapeCastResult> actual(replayed.shapeCastResults, replayed.shapeCastResults + count);
+			std::sort(expected.begin(), expected.end(), ShapeCastResultLess);
+			std::sort(actual.begin(), actual.end(), ShapeCastResultLess);
+			
+			for( int resultIdx = 0; resultIdx < count; ++resultIdx )
+			{
+				if( expected[resultIdx].fixture != actual[resultIdx].fixture || !IsClose(expected[resultIdx].toi, actual[resultIdx].toi) )
+					return false;
+			}
+			
+			return true;
+		}
+			
+		case CollisionQuery::e_sweptClosest:
+			return count == 0 || IsClose(recorded.shapeCastResults[0].toi, replayed.shapeCastResults[0].toi);
+			
+		case CollisionQuery::e_rayAny:
+		case CollisionQuery::e_sweptAny:
+			// any hit will do, so only whether there was one has to match
+			return true;
+	}
+	
+	return false;
+}
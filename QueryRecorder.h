@@ -0,0 +1,176 @@
+//
+//	QueryRecorder.h
+//
+//	Created by Aaron Pendley on 4/9/10.
+//	Copyright 2010 Aaron Pendley.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+// 
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+// 
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+
+#ifndef _QUERYRECORDER_H_INCLUDED_
+#define _QUERYRECORDER_H_INCLUDED_
+
+#include "QueryDispatcher.h"
+
+#include <mutex>
+#include <stdio.h>
+#include <unordered_map>
+#include <vector>
+
+
+// capture and replay of collision queries, so a frame that hitched in the field can be run
+// again at the desk, and a change to the queries can be checked against real traffic.
+//
+// a capture is a stream of world snapshots, each followed by the queries run against it
+// along with their results.  queries are described as CollisionQuery, see QueryDispatcher.h.
+// the file is written in the machine's own byte order.
+//
+// QueryReplay.cpp is a standalone tool that replays a capture, times every query, and
+// reports the ones whose results no longer match.
+
+
+////////////////////////////////////////////////////////////////////////////
+// capture
+
+class QueryRecorder
+{
+public:
+	QueryRecorder();
+	~QueryRecorder();
+	
+	bool Open( const char* path );
+	void Close();
+	
+	bool IsOpen() const { return mFile != NULL; }
+	
+	// writes the bodies, fixture geometry and filters of the world.  queries recorded after
+	// this are replayed against it, so record the world again whenever it has changed.
+	// not thread safe, and no queries may be recorded while it runs.
+	void RecordWorld( b2World* world );
+	
+	// writes a query that has already run, along with its results.  safe to call from
+	// several threads at once, e.g. for each query of a QueryDispatcher batch once it is done.
+	void RecordQuery( const CollisionQuery& query );
+	
+	// runs a query and records it
+	void Execute( b2World* world, CollisionQuery* query );
+	
+	int GetQueryCount() const { return mQueryCount; }
+	
+private:
+	QueryRecorder( const QueryRecorder& );
+	QueryRecorder& operator = ( const QueryRecorder& );
+	
+	unsigned int GetFixtureId( const b2Fixture* fixture ) const;
+	unsigned int GetUserDataId( void* userData ) const;
+	
+	FILE* mFile;
+	std::mutex mMutex;
+	int mQueryCount;
+	
+	// ids of the fixtures and body user data of the last world recorded, in the order they were written
+	std::unordered_map<const b2Fixture*, unsigned int> mFixtureIds;
+	std::unordered_map<void*, unsigned int> mUserDataIds;
+};
+
+
+////////////////////////////////////////////////////////////////////////////
+// replay
+
+// shapes read back from a capture
+struct RecordedShapes
+{
+	RecordedShapes() : chain(NULL) {}
+	~RecordedShapes() { delete chain; }
+	
+	b2CircleShape circle;
+	b2PolygonShape polygon;
+	b2EdgeShape edge;
+	b2ChainShape* chain;		// a chain can't be refilled, so a new one is made each time
+};
+
+// a query read back from a capture, with the results it had when it was recorded.
+// fixtures and filters are mapped onto the replayed world.
+struct RecordedQuery
+{
+	// inputs, ready to run.  the result buffers are left for the caller to supply.
+	CollisionQuery query;
+	
+	// results as recorded.  fixtures that were not in the world snapshot come back NULL.
+	int resultCount;
+	std::vector<b2Fixture*> fixtures;
+	std::vector<RayCastResult> rayResults;
+	std::vector<ShapeCastResult> shapeCastResults;
+	
+	RecordedShapes shapes;
+};
+
+class QueryReplayer
+{
+public:
+	QueryReplayer();
+	~QueryReplayer();
+	
+	bool Open( const char* path );
+	void Close();
+	
+	enum ReadStatus
+	{
+		e_readQuery,		// a query was read
+		e_readEnd,			// the capture ended cleanly, between records
+		e_readError			// the capture ended partway through a record, or holds something that isn't one
+	};
+	
+	// reads the next query, first rebuilding the world if a new snapshot comes before it
+	ReadStatus ReadQuery( RecordedQuery* recorded );
+	
+	// the world the last query read should be run against
+	b2World* GetWorld() const { return mWorld; }
+	
+	// number of world snapshots rebuilt so far
+	int GetWorldCount() const { return mWorldCount; }
+	
+private:
+	QueryReplayer( const QueryReplayer& );
+	QueryReplayer& operator = ( const QueryReplayer& );
+	
+	bool ReadWorld();
+	b2Fixture* GetFixture( unsigned int fixtureId ) const;
+	void* GetUserData( unsigned int userDataId );
+	
+	FILE* mFile;
+	b2World* mWorld;
+	int mWorldCount;
+	
+	std::vector<b2Fixture*> mFixtures;
+	
+	// body user data is replaced by the address of an entry here, so ignored bodies still match
+	std::vector<char> mUserData;
+};
+
+// true if a replayed query found what it found when it was recorded.
+// a rebuilt broadphase can hand back fixtures in a different order, so lists of results are
+// compared as sets, and lists that filled their buffer are only compared by count since which
+// fixtures made it in depends on the order too.  aabb queries report whatever the tree's fat
+// AABBs touch, and those differ between the recorded and rebuilt trees, so only fixtures that
+// really overlap the box are compared; a full list only has to be part of a complete one.
+bool CompareQueryResults( const RecordedQuery& recorded, const CollisionQuery& replayed );
+
+#endif
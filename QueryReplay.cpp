@@ -0,0 +1,168 @@
+//
+//	QueryReplay.cpp
+//
+//	Created by Aaron Pendley on 4/9/10.
+//	Copyright 2010 Aaron Pendley.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+// 
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+// 
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+
+//  Replays a query capture written by QueryRecorder.
+//
+//  Build it with the rest of the CollisionUtil sources and Box2D, e.g.
+//    c++ -O2 -std=c++11 -I<box2d> *.cpp <libBox2D> -o QueryReplay
+//  (leave out any other file with a main)
+//
+//  usage: QueryReplay capture.bin [repeat]
+//
+//  every query is run against its rebuilt world, repeat times (1 by default), and timed.
+//  one line per query goes to stdout as CSV: index, world, type, best time in ns, result count
+//  and whether the results match the recorded ones.  a summary per query type goes to stderr.
+//  the exit code is 1 if any query's results differed, and 2 if the capture couldn't be read to the end.
+
+#include "QueryRecorder.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+
+static const char* kQueryTypeNames[] =
+{
+	"QueryAABB",
+	"CollideRay",
+	"CollideRayClosest",
+	"CollideRayAny",
+	"CollideSwept",
+	"CollideSweptClosest",
+	"CollideSweptAny",
+};
+
+static const int kQueryTypeCount = sizeof(kQueryTypeNames) / sizeof(kQueryTypeNames[0]);
+
+struct TypeSummary
+{
+	TypeSummary() : count(0), mismatches(0), totalNanoseconds(0), maxNanoseconds(0) {}
+	
+	int count;
+	int mismatches;
+	long long totalNanoseconds;
+	long long maxNanoseconds;
+};
+
+int main( int argc, char** argv )
+{
+	if( argc < 2 )
+	{
+		fprintf(stderr, "usage: %s capture.bin [repeat]\n", argv[0]);
+		return 2;
+	}
+	
+	int repeat = argc > 2 ? b2Max(1, atoi(argv[2])) : 1;
+	
+	QueryReplayer replayer;
+	
+	if( !replayer.Open(argv[1]) )
+	{
+		fprintf(stderr, "couldn't read a capture from %s\n", argv[1]);
+		return 2;
+	}
+	
+	std::vector<b2Fixture*> fixtures;
+	std::vector<RayCastResult> rayResults;
+	std::vector<ShapeCastResult> shapeCastResults;
+	
+	TypeSummary summaries[kQueryTypeCount];
+	
+	RecordedQuery recorded;
+	int queryIdx = 0;
+	QueryReplayer::ReadStatus status;
+	
+	printf("query,world,type,ns,results,match\n");
+	
+	while( (status = replayer.ReadQuery(&recorded)) == QueryReplayer::e_readQuery )
+	{
+		CollisionQuery query = recorded.query;
+		int bufferSize = b2Max(query.maxResults, 1);
+		
+		fixtures.resize(bufferSize);
+		rayResults.resize(bufferSize);
+		shapeCastResults.resize(bufferSize);
+		
+		query.fixtures = &fixtures[0];
+		query.rayResults = &rayResults[0];
+		query.shapeCastResults = &shapeCastResults[0];
+		
+		// the best of the repeats, to keep scheduling noise out of the comparison
+		long long bestNanoseconds = -1;
+		
+		for( int repeatIdx = 0; repeatIdx < repeat; ++repeatIdx )
+		{
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			ExecuteQuery(replayer.GetWorld(), &query);
+			std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+			
+			long long nanoseconds = (long long)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+			
+			if( bestNanoseconds < 0 || nanoseconds < bestNanoseconds )
+				bestNanoseconds = nanoseconds;
+		}
+		
+		bool match = CompareQueryResults(recorded, query);
+		
+		TypeSummary& summary = summaries[query.type];
+		summary.count++;
+		summary.totalNanoseconds += bestNanoseconds;
+		summary.maxNanoseconds = b2Max(summary.maxNanoseconds, bestNanoseconds);
+		
+		if( !match )
+			summary.mismatches++;
+		
+		printf("%d,%d,%s,%lld,%d,%s\n", queryIdx, replayer.GetWorldCount() - 1, kQueryTypeNames[query.type], bestNanoseconds, query.resultCount, match ? "yes" : "no");
+		queryIdx++;
+	}
+	
+	int mismatches = 0;
+	
+	fprintf(stderr, "%d queries against %d worlds\n", queryIdx, replayer.GetWorldCount());
+	
+	for( int typeIdx = 0; typeIdx < kQueryTypeCount; ++typeIdx )
+	{
+		const TypeSummary& summary = summaries[typeIdx];
+		
+		if( summary.count == 0 )
+			continue;
+		
+		fprintf(stderr, "%-20s %8d queries  %10.1f ns avg  %10lld ns max  %d mismatched\n", kQueryTypeNames[typeIdx], summary.count,
+				(double)summary.totalNanoseconds / (double)summary.count, summary.maxNanoseconds, summary.mismatches);
+		
+		mismatches += summary.mismatches;
+	}
+	
+	// the queries after a damaged record were never checked, so don't pass them
+	if( status == QueryReplayer::e_readError )
+	{
+		fprintf(stderr, "the capture is truncated or corrupt after query %d\n", queryIdx);
+		return 2;
+	}
+	
+	return mismatches > 0 ? 1 : 0;
+}
@@ -0,0 +1,512 @@
+//
+//	RayKernels.cpp
+//
+//	Created by Aaron Pendley on 4/9/10.
+//	Copyright 2010 Aaron Pendley.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+// 
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+// 
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+
+#include "RayKernels.h"
+
+#if RAY_KERNELS_WIDTH == 8
+#include <immintrin.h>
+#elif RAY_KERNELS_WIDTH == 4
+#include <emmintrin.h>
+#elif RAY_KERNELS_WIDTH != 1
+#error RAY_KERNELS_WIDTH must be 1, 4 or 8
+#endif
+
+
+bool RayPolygonSoA::Set( const b2PolygonShape* polygon )
+{
+	count = polygon->m_vertexCount;
+	
+	if( count < 3 )
+		return false;
+	
+	for( int32 vertexIdx = 0; vertexIdx < kCapacity; ++vertexIdx )
+	{
+		if( vertexIdx < count )
+		{
+			normalX[vertexIdx] = polygon->m_normals[vertexIdx].x;
+			normalY[vertexIdx] = polygon->m_normals[vertexIdx].y;
+			vertexX[vertexIdx] = polygon->m_vertices[vertexIdx].x;
+			vertexY[vertexIdx] = polygon->m_vertices[vertexIdx].y;
+		}
+		else
+		{
+			normalX[vertexIdx] = 0.0f;
+			normalY[vertexIdx] = 0.0f;
+			vertexX[vertexIdx] = 0.0f;
+			vertexY[vertexIdx] = 0.0f;
+		}
+	}
+	
+	return true;
+}
+
+// the b2CircleShape::RayCast test for one circle, returns false or sets a to the hit fraction times rr
+static inline bool RayCastCircle( const RayCircleSoA& circles, int32 circleIdx, const b2Vec2& p1, const b2Vec2& r, float32 rr, float32 limit, float32* a )
+{
+	b2Vec2 s(p1.x - circles.centerX[circleIdx], p1.y - circles.centerY[circleIdx]);
+	float32 radius = circles.radius[circleIdx];
+	float32 b = b2Dot(s, s) - radius * radius;
+	
+	float32 c = b2Dot(s, r);
+	float32 sigma = c * c - rr * b;
+	
+	if( sigma < 0.0f )
+		return false;
+	
+	float32 hit = -(c + b2Sqrt(sigma));
+	
+	if( hit < 0.0f || hit > limit )
+		return false;
+	
+	*a = hit;
+	return true;
+}
+
+static void SetCircleOutput( const RayCircleSoA& circles, int32 circleIdx, const b2RayCastInput& input, float32 a, float32 rr, b2RayCastOutput* output )
+{
+	b2Vec2 r = input.p2 - input.p1;
+	b2Vec2 s(input.p1.x - circles.centerX[circleIdx], input.p1.y - circles.centerY[circleIdx]);
+	
+	a /= rr;
+	output->fraction = a;
+	output->normal = s + a * r;
+	output->normal.Normalize();
+}
+
+
+#if RAY_KERNELS_WIDTH > 1
+
+////////////////////////////////////////////////////////////////////////////
+// lanes
+
+// just enough of a vector type to write the kernels once for both widths.
+// masks are lanes with every bit set or clear, as the compare instructions return them.
+namespace
+{
+	const int kWidth = RAY_KERNELS_WIDTH;
+	
+#if RAY_KERNELS_WIDTH == 8
+	typedef __m256 Lanes;
+	
+	inline Lanes Load( const float32* p ) { return _mm256_loadu_ps(p); }
+	inline void Store( float32* p, Lanes a ) { _mm256_storeu_ps(p, a); }
+	inline Lanes Splat( float32 a ) { return _mm256_set1_ps(a); }
+	inline Lanes Add( Lanes a, Lanes b ) { return _mm256_add_ps(a, b); }
+	inline Lanes Sub( Lanes a, Lanes b ) { return _mm256_sub_ps(a, b); }
+	inline Lanes Mul( Lanes a, Lanes b ) { return _mm256_mul_ps(a, b); }
+	inline Lanes Div( Lanes a, Lanes b ) { return _mm256_div_ps(a, b); }
+	inline Lanes Sqrt( Lanes a ) { return _mm256_sqrt_ps(a); }
+	inline Lanes Min( Lanes a, Lanes b ) { return _mm256_min_ps(a, b); }
+	inline Lanes Max( Lanes a, Lanes b ) { return _mm256_max_ps(a, b); }
+	inline Lanes Less( Lanes a, Lanes b ) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+	inline Lanes LessEqual( Lanes a, Lanes b ) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+	inline Lanes Equal( Lanes a, Lanes b ) { return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+	inline Lanes And( Lanes a, Lanes b ) { return _mm256_and_ps(a, b); }
+	inline Lanes Or( Lanes a, Lanes b ) { return _mm256_or_ps(a, b); }
+	inline Lanes AndNot( Lanes a, Lanes b ) { return _mm256_andnot_ps(a, b); }
+	inline Lanes Select( Lanes mask, Lanes a, Lanes b ) { return _mm256_blendv_ps(b, a, mask); }
+	inline int MaskBits( Lanes mask ) { return _mm256_movemask_ps(mask); }
+#else
+	typedef __m128 Lanes;
+	
+	inline Lanes Load( const float32* p ) { return _mm_loadu_ps(p); }
+	inline void Store( float32* p, Lanes a ) { _mm_storeu_ps(p, a); }
+	inline Lanes Splat( float32 a ) { return _mm_set1_ps(a); }
+	inline Lanes Add( Lanes a, Lanes b ) { return _mm_add_ps(a, b); }
+	inline Lanes Sub( Lanes a, Lanes b ) { return _mm_sub_ps(a, b); }
+	inline Lanes Mul( Lanes a, Lanes b ) { return _mm_mul_ps(a, b); }
+	inline Lanes Div( Lanes a, Lanes b ) { return _mm_div_ps(a, b); }
+	inline Lanes Sqrt( Lanes a ) { return _mm_sqrt_ps(a); }
+	inline Lanes Min( Lanes a, Lanes b ) { return _mm_min_ps(a, b); }
+	inline Lanes Max( Lanes a, Lanes b ) { return _mm_max_ps(a, b); }
+	inline Lanes Less( Lanes a, Lanes b ) { return _mm_cmplt_ps(a, b); }
+	inline Lanes LessEqual( Lanes a, Lanes b ) { return _mm_cmple_ps(a, b); }
+	inline Lanes Equal( Lanes a, Lanes b ) { return _mm_cmpeq_ps(a, b); }
+	inline Lanes And( Lanes a, Lanes b ) { return _mm_and_ps(a, b); }
+	inline Lanes Or( Lanes a, Lanes b ) { return _mm_or_ps(a, b); }
+	inline Lanes AndNot( Lanes a, Lanes b ) { return _mm_andnot_ps(a, b); }
+	inline Lanes Select( Lanes mask, Lanes a, Lanes b ) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+	inline int MaskBits( Lanes mask ) { return _mm_movemask_ps(mask); }
+#endif
+	
+	// the n lowest lanes set
+	inline Lanes FirstLanes( int n )
+	{
+		float32 indices[kWidth];
+		
+		for( int laneIdx = 0; laneIdx < kWidth; ++laneIdx )
+			indices[laneIdx] = (float32)laneIdx;
+		
+		return Less(Load(indices), Splat((float32)n));
+	}
+}
+
+
+////////////////////////////////////////////////////////////////////////////
+// polygons
+
+bool RayCastPolygon( const RayPolygonSoA& polygon, const b2Transform& xf, const b2RayCastInput& input, b2RayCastOutput* output )
+{
+	// put the ray into the polygon's frame of reference
+	b2Vec2 p1 = b2MulT(xf.R, input.p1 - xf.position);
+	b2Vec2 p2 = b2MulT(xf.R, input.p2 - xf.position);
+	b2Vec2 d = p2 - p1;
+	
+	Lanes p1x = Splat(p1.x);
+	Lanes p1y = Splat(p1.y);
+	Lanes dx = Splat(d.x);
+	Lanes dy = Splat(d.y);
+	Lanes zero = Splat(0.0f);
+	Lanes maxFraction = Splat(input.maxFraction);
+	
+	// b2PolygonShape::RayCast clips [0, maxFraction] by one edge at a time, raising lower at edges the
+	// ray enters and dropping upper at edges it leaves.  clipping by every edge at once and taking the
+	// largest lower and smallest upper comes to the same interval.
+	Lanes lower = zero;
+	Lanes upper = maxFraction;
+	Lanes outside = zero;
+	
+	float32 fractions[RayPolygonSoA::kCapacity];
+	int enteringBits = 0;
+	
+	for( int32 edgeIdx = 0; edgeIdx < polygon.count; edgeIdx += kWidth )
+	{
+		Lanes nx = Load(polygon.normalX + edgeIdx);
+		Lanes ny = Load(polygon.normalY + edgeIdx);
+		
+		Lanes numerator = Add(Mul(nx, Sub(Load(polygon.vertexX + edgeIdx), p1x)), Mul(ny, Sub(Load(polygon.vertexY + edgeIdx), p1y)));
+		Lanes denominator = Add(Mul(nx, dx), Mul(ny, dy));
+		
+		// parallel to an edge and outside it.  padding has zero numerators, so never counts.
+		outside = Or(outside, And(Equal(denominator, zero), Less(numerator, zero)));
+		
+		// parallel lanes divide by zero, but are masked out of both sides
+		Lanes fraction = Div(numerator, denominator);
+		Lanes entering = Less(denominator, zero);
+		Lanes leaving = Less(zero, denominator);
+		
+		lower = Max(lower, Select(entering, fraction, zero));
+		upper = Min(upper, Select(leaving, fraction, maxFraction));
+		
+		Store(fractions + edgeIdx, fraction);
+		enteringBits |= MaskBits(entering) << edgeIdx;
+	}
+	
+	if( MaskBits(outside) != 0 )
+		return false;
+	
+	float32 lowers[kWidth];
+	float32 uppers[kWidth];
+	Store(lowers, lower);
+	Store(uppers, upper);
+	
+	float32 lowerFraction = lowers[0];
+	float32 upperFraction = uppers[0];
+	
+	for( int laneIdx = 1; laneIdx < kWidth; ++laneIdx )
+	{
+		lowerFraction = b2Max(lowerFraction, lowers[laneIdx]);
+		upperFraction = b2Min(upperFraction, uppers[laneIdx]);
+	}
+	
+	// a lower of zero means the ray never entered an edge, i.e. it started inside, which
+	// b2PolygonShape::RayCast doesn't count as a hit either
+	if( upperFraction < lowerFraction || lowerFraction == 0.0f )
+		return false;
+	
+	// the first edge giving lower, as the scalar loop would have kept
+	for( int32 edgeIdx = 0; edgeIdx < polygon.count; ++edgeIdx )
+	{
+		if( (enteringBits & (1 << edgeIdx)) != 0 && fractions[edgeIdx] == lowerFraction )
+		{
+			output->fraction = lowerFraction;
+			output->normal = b2Mul(xf.R, b2Vec2(polygon.normalX[edgeIdx], polygon.normalY[edgeIdx]));
+			return true;
+		}
+	}
+	
+	return false;
+}
+
+int RayCastPolygon( const RayPolygonSoA& polygon, const b2Transform& xf, const b2RayCastInput* inputs, int count, b2RayCastOutput* outputs, bool* hits )
+{
+	int hitCount = 0;
+	Lanes zero = Splat(0.0f);
+	
+	for( int first = 0; first < count; first += kWidth )
+	{
+		int laneCount = b2Min(kWidth, count - first);
+		
+		// each lane's ray in the polygon's frame of reference
+		float32 p1x[kWidth];
+		float32 p1y[kWidth];
+		float32 dx[kWidth];
+		float32 dy[kWidth];
+		float32 maxFractions[kWidth];
+		
+		for( int laneIdx = 0; laneIdx < kWidth; ++laneIdx )
+		{
+			const b2RayCastInput& input = inputs[first + b2Min(laneIdx, laneCount - 1)];
+			
+			b2Vec2 p1 = b2MulT(xf.R, input.p1 - xf.position);
+			b2Vec2 p2 = b2MulT(xf.R, input.p2 - xf.position);
+			
+			p1x[laneIdx] = p1.x;
+			p1y[laneIdx] = p1.y;
+			dx[laneIdx] = p2.x - p1.x;
+			dy[laneIdx] = p2.y - p1.y;
+			maxFractions[laneIdx] = input.maxFraction;
+		}
+		
+		Lanes rayX = Load(p1x);
+		Lanes rayY = Load(p1y);
+		Lanes rayDX = Load(dx);
+		Lanes rayDY = Load(dy);
+		
+		// the same clipping loop as b2PolygonShape::RayCast, one ray per lane.  a lane drops out
+		// where the scalar version would have returned false.
+		Lanes lower = zero;
+		Lanes upper = Load(maxFractions);
+		Lanes index = Splat(-1.0f);
+		Lanes alive = FirstLanes(laneCount);
+		
+		for( int32 edgeIdx = 0; edgeIdx < polygon.count && MaskBits(alive) != 0; ++edgeIdx )
+		{
+			Lanes nx = Splat(polygon.normalX[edgeIdx]);
+			Lanes ny = Splat(polygon.normalY[edgeIdx]);
+			
+			Lanes numerator = Add(Mul(nx, Sub(Splat(polygon.vertexX[edgeIdx]), rayX)), Mul(ny, Sub(Splat(polygon.vertexY[edgeIdx]), rayY)));
+			Lanes denominator = Add(Mul(nx, rayDX), Mul(ny, rayDY));
+			
+			alive = AndNot(And(Equal(denominator, zero), Less(numerator, zero)), alive);
+			
+			Lanes fraction = Div(numerator, denominator);
+			Lanes entering = And(Less(denominator, zero), Less(lower, fraction));
+			Lanes leaving = And(Less(zero, denominator), Less(fraction, upper));
+			
+			lower = Select(entering, fraction, lower);
+			index = Select(entering, Splat((float32)edgeIdx), index);
+			upper = Select(leaving, fraction, upper);
+			
+			alive = AndNot(Less(upper, lower), alive);
+		}
+		
+		int hitBits = MaskBits(And(alive, LessEqual(zero, index)));
+		
+		float32 fractions[kWidth];
+		float32 indices[kWidth];
+		Store(fractions, lower);
+		Store(indices, index);
+		
+		for( int laneIdx = 0; laneIdx < laneCount; ++laneIdx )
+		{
+			bool hit = (hitBits & (1 << laneIdx)) != 0;
+			hits[first + laneIdx] = hit;
+			
+			if( !hit )
+				continue;
+			
+			int32 edgeIdx = (int32)indices[laneIdx];
+			b2RayCastOutput& output = outputs[first + laneIdx];
+			output.fraction = fractions[laneIdx];
+			output.normal = b2Mul(xf.R, b2Vec2(polygon.normalX[edgeIdx], polygon.normalY[edgeIdx]));
+			hitCount++;
+		}
+	}
+	
+	return hitCount;
+}
+
+
+////////////////////////////////////////////////////////////////////////////
+// circles
+
+int RayCastCircles( const RayCircleSoA& circles, const b2RayCastInput& input, b2RayCastOutput* output )
+{
+	b2Vec2 r = input.p2 - input.p1;
+	float32 rr = b2Dot(r, r);
+	
+	if( rr < b2_epsilon )
+		return -1;
+	
+	// b2CircleShape::RayCast hits at a / rr, for 0 <= a <= maxFraction * rr
+	float32 limit = input.maxFraction * rr;
+	
+	Lanes p1x = Splat(input.p1.x);
+	Lanes p1y = Splat(input.p1.y);
+	Lanes rx = Splat(r.x);
+	Lanes ry = Splat(r.y);
+	Lanes rrLanes = Splat(rr);
+	Lanes limitLanes = Splat(limit);
+	Lanes zero = Splat(0.0f);
+	Lanes none = Splat(b2_maxFloat);
+	
+	float32 closest = b2_maxFloat;
+	int32 closestIdx = -1;
+	
+	int32 laneCircles = circles.count - circles.count % kWidth;
+	
+	for( int32 first = 0; first < laneCircles; first += kWidth )
+	{
+		Lanes sx = Sub(p1x, Load(circles.centerX + first));
+		Lanes sy = Sub(p1y, Load(circles.centerY + first));
+		Lanes radius = Load(circles.radius + first);
+		Lanes b = Sub(Add(Mul(sx, sx), Mul(sy, sy)), Mul(radius, radius));
+		
+		Lanes c = Add(Mul(sx, rx), Mul(sy, ry));
+		Lanes sigma = Sub(Mul(c, c), Mul(rrLanes, b));
+		
+		// misses take the square root of a negative, but are masked out
+		Lanes a = Sub(zero, Add(c, Sqrt(sigma)));
+		Lanes hit = And(And(LessEqual(zero, sigma), LessEqual(zero, a)), LessEqual(a, limitLanes));
+		
+		if( MaskBits(hit) == 0 )
+			continue;
+		
+		float32 as[kWidth];
+		Store(as, Select(hit, a, none));
+		
+		for( int laneIdx = 0; laneIdx < kWidth; ++laneIdx )
+		{
+			if( as[laneIdx] < closest )
+			{
+				closest = as[laneIdx];
+				closestIdx = first + laneIdx;
+			}
+		}
+	}
+	
+	for( int32 circleIdx = laneCircles; circleIdx < circles.count; ++circleIdx )
+	{
+		float32 a;
+		
+		if( RayCastCircle(circles, circleIdx, input.p1, r, rr, limit, &a) && a < closest )
+		{
+			closest = a;
+			closestIdx = circleIdx;
+		}
+	}
+	
+	if( closestIdx >= 0 )
+		SetCircleOutput(circles, closestIdx, input, closest, rr, output);
+	
+	return closestIdx;
+}
+
+
+#else
+
+////////////////////////////////////////////////////////////////////////////
+// scalar
+
+bool RayCastPolygon( const RayPolygonSoA& polygon, const b2Transform& xf, const b2RayCastInput& input, b2RayCastOutput* output )
+{
+	// b2PolygonShape::RayCast, reading the SoA copy
+	b2Vec2 p1 = b2MulT(xf.R, input.p1 - xf.position);
+	b2Vec2 p2 = b2MulT(xf.R, input.p2 - xf.position);
+	b2Vec2 d = p2 - p1;
+	
+	float32 lower = 0.0f;
+	float32 upper = input.maxFraction;
+	int32 index = -1;
+	
+	for( int32 edgeIdx = 0; edgeIdx < polygon.count; ++edgeIdx )
+	{
+		float32 numerator = polygon.normalX[edgeIdx] * (polygon.vertexX[edgeIdx] - p1.x) + polygon.normalY[edgeIdx] * (polygon.vertexY[edgeIdx] - p1.y);
+		float32 denominator = polygon.normalX[edgeIdx] * d.x + polygon.normalY[edgeIdx] * d.y;
+		
+		if( denominator == 0.0f )
+		{
+			if( numerator < 0.0f )
+				return false;
+		}
+		else if( denominator < 0.0f && numerator < lower * denominator )
+		{
+			lower = numerator / denominator;
+			index = edgeIdx;
+		}
+		else if( denominator > 0.0f && numerator < upper * denominator )
+		{
+			upper = numerator / denominator;
+		}
+		
+		if( upper < lower )
+			return false;
+	}
+	
+	if( index < 0 )
+		return false;
+	
+	output->fraction = lower;
+	output->normal = b2Mul(xf.R, b2Vec2(polygon.normalX[index], polygon.normalY[index]));
+	return true;
+}
+
+int RayCastPolygon( const RayPolygonSoA& polygon, const b2Transform& xf, const b2RayCastInput* inputs, int count, b2RayCastOutput* outputs, bool* hits )
+{
+	int hitCount = 0;
+	
+	for( int rayIdx = 0; rayIdx < count; ++rayIdx )
+	{
+		hits[rayIdx] = RayCastPolygon(polygon, xf, inputs[rayIdx], &outputs[rayIdx]);
+		
+		if( hits[rayIdx] )
+			hitCount++;
+	}
+	
+	return hitCount;
+}
+
+int RayCastCircles( const RayCircleSoA& circles, const b2RayCastInput& input, b2RayCastOutput* output )
+{
+	b2Vec2 r = input.p2 - input.p1;
+	float32 rr = b2Dot(r, r);
+	
+	if( rr < b2_epsilon )
+		return -1;
+	
+	float32 limit = input.maxFraction * rr;
+	float32 closest = b2_maxFloat;
+	int32 closestIdx = -1;
+	
+	for( int32 circleIdx = 0; circleIdx < circles.count; ++circleIdx )
+	{
+		float32 a;
+		
+		if( RayCastCircle(circles, circleIdx, input.p1, r, rr, limit, &a) && a < closest )
+		{
+			closest = a;
+			closestIdx = circleIdx;
+		}
+	}
+	
+	if( closestIdx >= 0 )
+		SetCircleOutput(circles, closestIdx, input, closest, rr, output);
+	
+	return closestIdx;
+}
+
+#endif
@@ -0,0 +1,89 @@
+//
+//	RayKernels.h
+//
+//	Created by Aaron Pendley on 4/9/10.
+//	Copyright 2010 Aaron Pendley.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+// 
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+// 
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+
+#ifndef _RAYKERNELS_H_INCLUDED_
+#define _RAYKERNELS_H_INCLUDED_
+
+#include "Box2D.h"
+
+
+// ray casts against polygons and circles that test several edges, circles or rays at once, in place of
+// the virtual b2Shape::RayCast that tests one polygon edge at a time.  the math is Box2D's, done in the
+// same order per lane, so fractions and normals match b2Shape::RayCast to within rounding.
+//
+// RAY_KERNELS_WIDTH is the number of lanes: 8 when built with AVX2, 4 with SSE2, 1 otherwise.  define it
+// to 1 to build the plain scalar versions everywhere.
+
+#ifndef RAY_KERNELS_WIDTH
+#if defined(__AVX2__)
+#define RAY_KERNELS_WIDTH 8
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RAY_KERNELS_WIDTH 4
+#else
+#define RAY_KERNELS_WIDTH 1
+#endif
+#endif
+
+
+// a polygon's edges in SoA layout, in the polygon's own frame.  edges past count are padded out with
+// zero normals, which never clip a ray, so every lane can be tested without a tail loop.
+struct RayPolygonSoA
+{
+	// b2_maxPolygonVertices rounded up to a whole number of lanes
+	static const int32 kCapacity = ((b2_maxPolygonVertices + 7) / 8) * 8;
+	
+	// returns false for 2 vertex polygons (SetAsEdge), which the kernels don't handle
+	bool Set( const b2PolygonShape* polygon );
+	
+	float32 normalX[kCapacity];
+	float32 normalY[kCapacity];
+	float32 vertexX[kCapacity];
+	float32 vertexY[kCapacity];
+	int32 count;
+};
+
+// any number of circles in SoA layout, in world space.  the arrays belong to the caller.
+struct RayCircleSoA
+{
+	const float32* centerX;
+	const float32* centerY;
+	const float32* radius;
+	int32 count;
+};
+
+
+// one ray against every edge of the polygon at xf, like b2PolygonShape::RayCast
+bool RayCastPolygon( const RayPolygonSoA& polygon, const b2Transform& xf, const b2RayCastInput& input, b2RayCastOutput* output );
+
+// count rays against the polygon at xf, RAY_KERNELS_WIDTH rays at a time.  hits[i] says whether
+// outputs[i] was filled in.  returns the number of hits.
+int RayCastPolygon( const RayPolygonSoA& polygon, const b2Transform& xf, const b2RayCastInput* inputs, int count, b2RayCastOutput* outputs, bool* hits );
+
+// one ray against every circle, RAY_KERNELS_WIDTH circles at a time.  returns the index of the closest
+// circle hit, with its output, or -1 if none was.
+int RayCastCircles( const RayCircleSoA& circles, const b2RayCastInput& input, b2RayCastOutput* output );
+
+#endif
@@ -0,0 +1,163 @@
+//
+//	RayProbe.cpp
+//
+//	Created by Aaron Pendley on 4/9/10.
+//	Copyright 2010 Aaron Pendley.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+// 
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+// 
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+
+#include "RayProbe.h"
+#include "CollisionStats.h"
+#include "QueryPolicies.h"
+
+
+namespace
+{
+	// keeps the closest hit like ClosestHitCollector, along with the child of the fixture that was hit,
+	// which the probe needs to test a chain again next time
+	class ProbeRayCastQuery
+	{
+	public:
+		ProbeRayCastQuery( const b2BroadPhase* broadPhase, const QueryFilter& filter, RayCastResult* result )
+		: mBroadPhase(broadPhase)
+		, mFilter(filter)
+		, mResult(result)
+		, mChildIndex(0)
+		{
+		}
+		
+		float32 RayCastCallback( const b2RayCastInput& input, int32 proxyId )
+		{
+			b2FixtureProxy* proxy = (b2FixtureProxy*)mBroadPhase->GetUserData(proxyId);
+			b2Fixture* fixture = proxy->fixture;
+			
+			COLLISION_STATS_COUNT(e_statsCandidates, 1);
+			
+			if( !mFilter.Accept(fixture) )
+			{
+				COLLISION_STATS_COUNT(e_statsFixturesFiltered, 1);
+				return input.maxFraction;
+			}
+			
+			b2RayCastOutput output;
+			
+			if( !fixture->RayCast(&output, input, proxy->childIndex) )
+				return input.maxFraction;
+			
+			// same math b2World::RayCast uses
+			float32 fraction = output.fraction;
+			
+			mResult->fixture = fixture;
+			mResult->point = (1.0f - fraction) * input.p1 + fraction * input.p2;
+			mResult->normal = output.normal;
+			mResult->fraction = fraction;
+			mChildIndex = proxy->childIndex;
+			
+			return fraction;
+		}
+		
+		const b2BroadPhase* mBroadPhase;
+		QueryFilterPolicy mFilter;
+		RayCastResult* mResult;
+		int32 mChildIndex;
+	};
+}
+
+RayProbe::RayProbe()
+: mFixture(NULL)
+, mChildIndex(0)
+, mCastCount(0)
+, mReuseCount(0)
+{
+}
+
+bool RayProbe::Cast( b2World* world, const b2Vec2& from, const b2Vec2& to, const QueryFilter& filter, RayCastResult* result )
+{
+	COLLISION_STATS_QUERY(e_statsRayProbe);
+	
+	mCastCount++;
+	
+	b2RayCastInput input;
+	input.p1 = from;
+	input.p2 = to;
+	input.maxFraction = 1.0f;
+	
+	RayCastResult hit;
+	const b2BroadPhase* broadPhase = &world->GetContactManager().m_broadPhase;
+	ProbeRayCastQuery query(broadPhase, filter, &hit);
+	
+	// seed the query with last time's fixture, if it passes the filter this time and the ray still hits it
+	b2Fixture* seed = NULL;
+	
+	// a deactivated body is out of the broadphase, so the world wouldn't report it either
+	if( mFixture != NULL && mFixture->GetBody()->IsActive() && query.mFilter.Accept(mFixture) )
+	{
+		b2RayCastOutput output;
+		
+		if( mFixture->RayCast(&output, input, mChildIndex) )
+		{
+			seed = mFixture;
+			
+			hit.fixture = mFixture;
+			hit.point = (1.0f - output.fraction) * input.p1 + output.fraction * input.p2;
+			hit.normal = output.normal;
+			hit.fraction = output.fraction;
+			query.mChildIndex = mChildIndex;
+			
+			input.maxFraction = output.fraction;
+		}
+	}
+	
+	broadPhase->RayCast(&query, input);
+	
+	mFixture = hit.fixture;
+	mChildIndex = query.mChildIndex;
+	
+	if( seed != NULL && hit.fixture == seed )
+		mReuseCount++;
+	
+	if( hit.fixture == NULL )
+		return false;
+	
+	if( result != NULL )
+		*result = hit;
+	
+	COLLISION_STATS_REPORTED(1);
+	return true;
+}
+
+void RayProbe::OnFixtureDestroyed( b2Fixture* fixture )
+{
+	if( fixture == mFixture )
+		Reset();
+}
+
+void RayProbe::Reset()
+{
+	mFixture = NULL;
+	mChildIndex = 0;
+}
+
+void RayProbe::ResetStats()
+{
+	mCastCount = 0;
+	mReuseCount = 0;
+}
@@ -0,0 +1,69 @@
+//
+//	RayProbe.h
+//
+//	Created by Aaron Pendley on 4/9/10.
+//	Copyright 2010 Aaron Pendley.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+// 
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+// 
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+
+#ifndef _RAYPROBE_H_INCLUDED_
+#define _RAYPROBE_H_INCLUDED_
+
+#include "CollisionUtil.h"
+
+
+// a ray cast every frame, like a laser sight, a ground probe or a wall sensor, which almost always
+// hits the same fixture it hit last time.  Cast tests that fixture on its own first, and if the ray
+// still hits it, walks the broadphase with the ray already clipped there, so nothing beyond it is visited.
+//
+// the probe holds on to the last fixture hit, so call OnFixtureDestroyed for every fixture destroyed:
+// from your b2DestructionListener for fixtures destroyed along with their body, and yourself after
+// b2Body::DestroyFixture, which doesn't call the listener.
+class RayProbe
+{
+public:
+	RayProbe();
+	
+	// returns the closest hit along the ray, the same as CollideRayClosest
+	bool Cast( b2World* world, const b2Vec2& from, const b2Vec2& to, const QueryFilter& filter, RayCastResult* result );
+	
+	void OnFixtureDestroyed( b2Fixture* fixture );
+	
+	// forgets the last hit
+	void Reset();
+	
+	b2Fixture* GetLastFixture() const { return mFixture; }
+	
+	// how often the last hit was still the closest one
+	int GetCastCount() const { return mCastCount; }
+	int GetReuseCount() const { return mReuseCount; }
+	float32 GetReuseRate() const { return mCastCount > 0 ? (float32)mReuseCount / (float32)mCastCount : 0.0f; }
+	void ResetStats();
+	
+private:
+	b2Fixture* mFixture;
+	int32 mChildIndex;
+	
+	int mCastCount;
+	int mReuseCount;
+};
+
+#endif
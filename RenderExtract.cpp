@@ -0,0 +1,137 @@
+//
+//	RenderExtract.cpp
+//
+//	Created by Aaron Pendley on 4/9/10.
+//	Copyright 2010 Aaron Pendley.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+// 
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+// 
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+
+#include "RenderExtract.h"
+
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define RENDER_EXTRACT_SSE2 1
+#endif
+
+
+// collects the body of every proxy in the viewport.  bodies with a single fixture can only come up
+// once, bodies with more are set aside to have their duplicates removed.
+class VisibleBodyQuery
+{
+public:
+	VisibleBodyQuery( const b2BroadPhase* broadPhase, QueryArray<b2Body*>* bodies, QueryArray<b2Body*>* multiFixtureBodies )
+	: mBroadPhase(broadPhase)
+	, mBodies(bodies)
+	, mMultiFixtureBodies(multiFixtureBodies)
+	{
+	}
+	
+	bool QueryCallback( int32 proxyId )
+	{
+		b2FixtureProxy* proxy = (b2FixtureProxy*)mBroadPhase->GetUserData(proxyId);
+		b2Fixture* fixture = proxy->fixture;
+		b2Body* body = fixture->GetBody();
+		
+		if( fixture->GetNext() == NULL && body->GetFixtureList() == fixture && fixture->GetShape()->GetChildCount() == 1 )
+			mBodies->Push(body);
+		else
+			mMultiFixtureBodies->Push(body);
+		
+		return true;
+	}
+	
+	const b2BroadPhase* mBroadPhase;
+	QueryArray<b2Body*>* mBodies;
+	QueryArray<b2Body*>* mMultiFixtureBodies;
+};
+
+// values[i] *= kPhysicsPTMRatio, four at a time where SSE2 is there.  values is 16 byte aligned,
+// as QueryContext hands it out.
+static void ScaleToPoints( float32* values, int count )
+{
+	int valueIdx = 0;
+	
+#if RENDER_EXTRACT_SSE2
+	__m128 ratio = _mm_set1_ps(kPhysicsPTMRatio);
+	
+	for( ; valueIdx + 4 <= count; valueIdx += 4 )
+		_mm_store_ps(values + valueIdx, _mm_mul_ps(_mm_load_ps(values + valueIdx), ratio));
+#endif
+	
+	for( ; valueIdx < count; ++valueIdx )
+		values[valueIdx] = fromb2(values[valueIdx]);
+}
+
+int ExtractVisibleBodies( b2World* world, const b2AABB& viewport, QueryContext* context, RenderBodies* bodies )
+{
+	assert(context != NULL && bodies != NULL);
+	
+	b2AABB aabb;
+	aabb.lowerBound = tob2(viewport.lowerBound);
+	aabb.upperBound = tob2(viewport.upperBound);
+	
+	QueryArray<b2Body*> visible(context, 256);
+	QueryArray<b2Body*> multiFixture(context);
+	
+	const b2BroadPhase* broadPhase = &world->GetContactManager().m_broadPhase;
+	VisibleBodyQuery query(broadPhase, &visible, &multiFixture);
+	broadPhase->Query(&query, aabb);
+	
+	if( multiFixture.GetCount() > 0 )
+	{
+		b2Body** first = multiFixture.GetData();
+		b2Body** last = first + multiFixture.GetCount();
+		
+		std::sort(first, last);
+		last = std::unique(first, last);
+		
+		for( b2Body** body = first; body != last; ++body )
+			visible.Push(*body);
+	}
+	
+	int count = visible.GetCount();
+	
+	bodies->x = (float32*)context->Allocate(count * (int)sizeof(float32));
+	bodies->y = (float32*)context->Allocate(count * (int)sizeof(float32));
+	bodies->angle = (float32*)context->Allocate(count * (int)sizeof(float32));
+	bodies->userData = (void**)context->Allocate(count * (int)sizeof(void*));
+	bodies->bodies = visible.GetData();
+	bodies->count = count;
+	
+	// the one pass that touches the bodies themselves, then the unit conversion runs over packed arrays
+	for( int bodyIdx = 0; bodyIdx < count; ++bodyIdx )
+	{
+		const b2Body* body = visible[bodyIdx];
+		const b2Vec2& position = body->GetPosition();
+		
+		bodies->x[bodyIdx] = position.x;
+		bodies->y[bodyIdx] = position.y;
+		bodies->angle[bodyIdx] = body->GetAngle();
+		bodies->userData[bodyIdx] = body->GetUserData();
+	}
+	
+	ScaleToPoints(bodies->x, count);
+	ScaleToPoints(bodies->y, count);
+	
+	return count;
+}
@@ -0,0 +1,53 @@
+//
+//	RenderExtract.h
+//
+//	Created by Aaron Pendley on 4/9/10.
+//	Copyright 2010 Aaron Pendley.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+// 
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+// 
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+
+#ifndef _RENDEREXTRACT_H_INCLUDED_
+#define _RENDEREXTRACT_H_INCLUDED_
+
+#include "Box2DUtil.h"
+#include "QueryContext.h"
+
+
+// the bodies in view, in SoA layout for handing straight to the renderer.  positions are in points,
+// as b2toccp gives them, and angles in radians, as b2Body::GetAngle gives them.
+struct RenderBodies
+{
+	float32* x;
+	float32* y;
+	float32* angle;
+	void** userData;
+	b2Body** bodies;
+	int count;
+};
+
+// fills in the bodies with a fixture overlapping viewport, which is given in points, from one broadphase
+// query instead of a walk over every body.  the broadphase AABBs are fattened, so a body just outside
+// the viewport can be included.  each body is listed once however many of its fixtures are in view.
+//
+// the arrays are allocated from context and stay valid until it is reset.  returns the number of bodies.
+int ExtractVisibleBodies( b2World* world, const b2AABB& viewport, QueryContext* context, RenderBodies* bodies );
+
+#endif
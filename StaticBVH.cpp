@@ -0,0 +1,307 @@
+//
+//	StaticBVH.cpp
+//
+//	Created by Aaron Pendley on 4/9/10.
+//	Copyright 2010 Aaron Pendley.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+// 
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+// 
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+
+#include "StaticBVH.h"
+
+#include <algorithm>
+
+
+// bins per axis for the surface area heuristic
+static const int kSAHBinCount = 16;
+
+// past this depth the build splits at the median, which caps the depth of the rest of the tree at log2 of the leaf count
+static const int kMedianSplitDepth = 40;
+
+// in 2D the surface area heuristic uses perimeters
+static inline float32 Perimeter( const b2AABB& aabb )
+{
+	return 2.0f * ((aabb.upperBound.x - aabb.lowerBound.x) + (aabb.upperBound.y - aabb.lowerBound.y));
+}
+
+static inline float32 GetAxis( const b2Vec2& v, int axis )
+{
+	return axis == 0 ? v.x : v.y;
+}
+
+struct StaticBVH::BuildItem
+{
+	b2AABB aabb;
+	b2Vec2 centroid;
+	int32 proxy;
+};
+
+// orders build items along an axis by centroid, for median splits
+struct CentroidLess
+{
+	explicit CentroidLess( int axis ) : mAxis(axis) {}
+	
+	template <class Item>
+	bool operator () ( const Item& a, const Item& b ) const
+	{
+		return GetAxis(a.centroid, mAxis) < GetAxis(b.centroid, mAxis);
+	}
+	
+	int mAxis;
+};
+
+StaticBVH::StaticBVH()
+: mHeight(0)
+{
+}
+
+void StaticBVH::Clear()
+{
+	mNodes.clear();
+	mLeafMinX.clear();
+	mLeafMinY.clear();
+	mLeafMaxX.clear();
+	mLeafMaxY.clear();
+	mProxies.clear();
+	mHeight = 0;
+}
+
+void StaticBVH::Build( b2World* world )
+{
+	Clear();
+	
+	std::vector<b2FixtureProxy> proxies;
+	
+	for( b2Body* body = world->GetBodyList(); body != NULL; body = body->GetNext() )
+	{
+		if( body->GetType() != b2_staticBody )
+			continue;
+		
+		for( b2Fixture* fixture = body->GetFixtureList(); fixture != NULL; fixture = fixture->GetNext() )
+		{
+			b2Shape* shape = fixture->GetShape();
+			
+			for( int32 childIdx = 0; childIdx < shape->GetChildCount(); ++childIdx )
+			{
+				b2FixtureProxy proxy;
+				shape->ComputeAABB(&proxy.aabb, body->GetTransform(), childIdx);
+				proxy.fixture = fixture;
+				proxy.childIndex = childIdx;
+				proxy.proxyId = 0;
+				proxies.push_back(proxy);
+			}
+		}
+	}
+	
+	BuildProxies(proxies);
+}
+
+void StaticBVH::BuildProxies( const std::vector<b2FixtureProxy>& proxies )
+{
+	if( proxies.empty() )
+		return;
+	
+	std::vector<BuildItem> items(proxies.size());
+	
+	for( size_t proxyIdx = 0; proxyIdx < proxies.size(); ++proxyIdx )
+	{
+		BuildItem& item = items[proxyIdx];
+		item.aabb = proxies[proxyIdx].aabb;
+		item.centroid = item.aabb.GetCenter();
+		item.proxy = (int32)proxyIdx;
+	}
+	
+	// a binary tree with leaves of at least one item has fewer than 2n nodes
+	mNodes.reserve(2 * items.size());
+	
+	BuildNode(&items[0], 0, (int)items.size(), 1);
+	
+	// lay the leaves out in the order the leaf nodes visit them
+	int leafCount = (int)items.size();
+	mLeafMinX.resize(leafCount);
+	mLeafMinY.resize(leafCount);
+	mLeafMaxX.resize(leafCount);
+	mLeafMaxY.resize(leafCount);
+	mProxies.resize(leafCount);
+	
+	for( int leafIdx = 0; leafIdx < leafCount; ++leafIdx )
+	{
+		const BuildItem& item = items[leafIdx];
+		
+		mLeafMinX[leafIdx] = item.aabb.lowerBound.x;
+		mLeafMinY[leafIdx] = item.aabb.lowerBound.y;
+		mLeafMaxX[leafIdx] = item.aabb.upperBound.x;
+		mLeafMaxY[leafIdx] = item.aabb.upperBound.y;
+		
+		mProxies[leafIdx] = proxies[item.proxy];
+		mProxies[leafIdx].proxyId = leafIdx;
+	}
+}
+
+// builds the node for items [begin, end) and its children, returns its index
+int32 StaticBVH::BuildNode( BuildItem* items, int begin, int end, int depth )
+{
+	int32 nodeIdx = (int32)mNodes.size();
+	mNodes.push_back(Node());
+	
+	mHeight = b2Max(mHeight, depth);
+	
+	b2AABB bounds = items[begin].aabb;
+	b2AABB centroidBounds;
+	centroidBounds.lowerBound = centroidBounds.upperBound = items[begin].centroid;
+	
+	for( int itemIdx = begin + 1; itemIdx < end; ++itemIdx )
+	{
+		bounds.Combine(bounds, items[itemIdx].aabb);
+		centroidBounds.lowerBound = b2Min(centroidBounds.lowerBound, items[itemIdx].centroid);
+		centroidBounds.upperBound = b2Max(centroidBounds.upperBound, items[itemIdx].centroid);
+	}
+	
+	mNodes[nodeIdx].aabb = bounds;
+	
+	int count = end - begin;
+	
+	if( count <= kMaxLeafSize )
+	{
+		mNodes[nodeIdx].index = begin;
+		mNodes[nodeIdx].leafCount = (int16)count;
+		mNodes[nodeIdx].axis = 0;
+		return nodeIdx;
+	}
+	
+	b2Vec2 centroidExtent = centroidBounds.upperBound - centroidBounds.lowerBound;
+	int bestAxis = centroidExtent.x >= centroidExtent.y ? 0 : 1;
+	int mid = -1;
+	
+	if( depth < kMedianSplitDepth && GetAxis(centroidExtent, bestAxis) > 0.0f )
+	{
+		// binned SAH over both axes: sort the items into bins by centroid, then try every split between bins
+		float32 bestCost = b2_maxFloat;
+		int bestSplit = -1;
+		
+		for( int axis = 0; axis < 2; ++axis )
+		{
+			float32 axisMin = GetAxis(centroidBounds.lowerBound, axis);
+			float32 axisExtent = GetAxis(centroidExtent, axis);
+			
+			if( axisExtent <= 0.0f )
+				continue;
+			
+			float32 binScale = (float32)kSAHBinCount / axisExtent;
+			
+			int binCounts[kSAHBinCount] = { 0 };
+			b2AABB binBounds[kSAHBinCount];
+			
+			for( int itemIdx = begin; itemIdx < end; ++itemIdx )
+			{
+				int bin = b2Min((int)((GetAxis(items[itemIdx].centroid, axis) - axisMin) * binScale), kSAHBinCount - 1);
+				
+				if( binCounts[bin] == 0 )
+					binBounds[bin] = items[itemIdx].aabb;
+				else
+					binBounds[bin].Combine(binBounds[bin], items[itemIdx].aabb);
+				
+				binCounts[bin]++;
+			}
+			
+			// perimeter and count of everything left of each split, swept from the left
+			float32 leftPerimeter[kSAHBinCount];
+			int leftCount[kSAHBinCount];
+			b2AABB running;
+			int runningCount = 0;
+			
+			for( int bin = 0; bin < kSAHBinCount - 1; ++bin )
+			{
+				if( binCounts[bin] > 0 )
+				{
+					if( runningCount == 0 )
+						running = binBounds[bin];
+					else
+						running.Combine(running, binBounds[bin]);
+					
+					runningCount += binCounts[bin];
+				}
+				
+				leftCount[bin] = runningCount;
+				leftPerimeter[bin] = runningCount > 0 ? Perimeter(running) : 0.0f;
+			}
+			
+			// then sweep from the right, scoring each split on the way
+			runningCount = 0;
+			
+			for( int bin = kSAHBinCount - 1; bin > 0; --bin )
+			{
+				if( binCounts[bin] > 0 )
+				{
+					if( runningCount == 0 )
+						running = binBounds[bin];
+					else
+						running.Combine(running, binBounds[bin]);
+					
+					runningCount += binCounts[bin];
+				}
+				
+				if( leftCount[bin - 1] == 0 || runningCount == 0 )
+					continue;
+				
+				float32 cost = leftPerimeter[bin - 1] * (float32)leftCount[bin - 1] + Perimeter(running) * (float32)runningCount;
+				
+				if( cost < bestCost )
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestSplit = bin;
+				}
+			}
+		}
+		
+		if( bestSplit >= 0 )
+		{
+			float32 axisMin = GetAxis(centroidBounds.lowerBound, bestAxis);
+			float32 binScale = (float32)kSAHBinCount / GetAxis(centroidExtent, bestAxis);
+			
+			BuildItem* split = std::partition(items + begin, items + end, [=]( const BuildItem& item ) {
+				return b2Min((int)((GetAxis(item.centroid, bestAxis) - axisMin) * binScale), kSAHBinCount - 1) < bestSplit;
+			});
+			
+			// there are too many items here for a leaf, so the best split is taken even when SAH says
+			// a leaf would be cheaper
+			mid = (int)(split - items);
+		}
+	}
+	
+	// nothing to split on (or too deep for SAH), so split in half along the longest axis
+	if( mid <= begin || mid >= end )
+	{
+		bestAxis = centroidExtent.x >= centroidExtent.y ? 0 : 1;
+		mid = begin + count / 2;
+		std::nth_element(items + begin, items + mid, items + end, CentroidLess(bestAxis));
+	}
+	
+	BuildNode(items, begin, mid, depth + 1);
+	int32 secondChild = BuildNode(items, mid, end, depth + 1);
+	
+	Node& node = mNodes[nodeIdx];
+	node.index = secondChild;
+	node.leafCount = 0;
+	node.axis = (int16)bestAxis;
+	
+	return nodeIdx;
+}
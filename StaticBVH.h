@@ -0,0 +1,313 @@
+//
+//	StaticBVH.h
+//
+//	Created by Aaron Pendley on 4/9/10.
+//	Copyright 2010 Aaron Pendley.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+// 
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+// 
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+
+#ifndef _STATICBVH_H_INCLUDED_
+#define _STATICBVH_H_INCLUDED_
+
+#include "Box2D.h"
+
+#include <vector>
+
+
+// a snapshot of the world's static fixtures in a bounding volume hierarchy built for queries
+// rather than for updates.  it is built once with the surface area heuristic, the nodes sit in one
+// array in depth first order, so the near child of a node is usually on the same cache line, and
+// each leaf node holds up to kMaxLeafSize fixture children whose bounds are stored as separate
+// min/max arrays that the compiler can test several at a time.
+//
+// pass it along with the world to the CollisionUtil queries that take one.  static fixtures are
+// then found through the BVH first, and fixtures on static bodies are skipped when the world's
+// broadphase is walked for the rest.  the world walk is bounded by the static result, so a closest
+// hit ray only looks at bodies in front of the nearest static hit, and a nearest query only at
+// bodies closer than the nearest static fixture.
+//
+// nothing is tracked after Build, so build again whenever static geometry is created, destroyed or moved.
+class StaticBVH
+{
+public:
+	static const int kMaxLeafSize = 4;
+	
+	StaticBVH();
+	
+	// snapshots every child of every fixture on a static body
+	void Build( b2World* world );
+	void Clear();
+	
+	int GetNodeCount() const { return (int)mNodes.size(); }
+	int GetLeafCount() const { return (int)mProxies.size(); }
+	int GetHeight() const { return mHeight; }
+	
+	// the same interface b2DynamicTree has, so the query templates in QueryPolicies.h work with it.
+	// a proxy id is a leaf index, and the user data of each is a b2FixtureProxy*.
+	void* GetUserData( int32 proxyId ) const { return (void*)&mProxies[proxyId]; }
+	
+	template <typename T>
+	void Query( T* callback, const b2AABB& aabb ) const;
+	
+	template <typename T>
+	void RayCast( T* callback, const b2RayCastInput& input ) const;
+	
+	// visits the leaves within maxDistance of the AABB, nearer subtrees first.  the callback is called as
+	// float32 NearestCallback( int32 proxyId ) and returns the distance anything else still has to be within,
+	// which prunes every subtree farther away than that.
+	template <typename T>
+	void QueryNearest( T* callback, const b2AABB& aabb, float32 maxDistance ) const;
+	
+private:
+	struct Node
+	{
+		b2AABB aabb;
+		int32 index;			// first leaf for a leaf node, the second child for an inner node (the first follows the node)
+		int16 leafCount;		// 0 for an inner node
+		int16 axis;				// axis the children were split along
+	};
+	
+	// tree traversal never goes deeper than this, the build switches to median splits to make sure of it
+	static const int kMaxDepth = 64;
+	
+	struct BuildItem;
+	
+	void BuildProxies( const std::vector<b2FixtureProxy>& proxies );
+	int32 BuildNode( BuildItem* items, int begin, int end, int depth );
+	
+	// true if leaf bounds overlap the AABB
+	inline bool LeafOverlaps( int32 leaf, const b2AABB& aabb ) const
+	{
+		return mLeafMinX[leaf] <= aabb.upperBound.x && mLeafMinY[leaf] <= aabb.upperBound.y
+			&& aabb.lowerBound.x <= mLeafMaxX[leaf] && aabb.lowerBound.y <= mLeafMaxY[leaf];
+	}
+	
+	static inline float32 DistanceSquared( float32 minX, float32 minY, float32 maxX, float32 maxY, const b2AABB& aabb )
+	{
+		float32 dx = b2Max(0.0f, b2Max(minX - aabb.upperBound.x, aabb.lowerBound.x - maxX));
+		float32 dy = b2Max(0.0f, b2Max(minY - aabb.upperBound.y, aabb.lowerBound.y - maxY));
+		return dx * dx + dy * dy;
+	}
+	
+	static inline float32 DistanceSquared( const b2AABB& a, const b2AABB& b )
+	{
+		return DistanceSquared(a.lowerBound.x, a.lowerBound.y, a.upperBound.x, a.upperBound.y, b);
+	}
+	
+	std::vector<Node> mNodes;
+	
+	// leaves, in the order the leaf nodes refer to them
+	std::vector<float32> mLeafMinX;
+	std::vector<float32> mLeafMinY;
+	std::vector<float32> mLeafMaxX;
+	std::vector<float32> mLeafMaxY;
+	std::vector<b2FixtureProxy> mProxies;
+	
+	int mHeight;
+};
+
+template <typename T>
+inline void StaticBVH::Query( T* callback, const b2AABB& aabb ) const
+{
+	if( mNodes.empty() )
+		return;
+	
+	int32 stack[kMaxDepth];
+	int32 count = 0;
+	stack[count++] = 0;
+	
+	while( count > 0 )
+	{
+		const Node& node = mNodes[stack[--count]];
+		
+		if( !b2TestOverlap(node.aabb, aabb) )
+			continue;
+		
+		if( node.leafCount > 0 )
+		{
+			for( int32 leaf = node.index; leaf < node.index + node.leafCount; ++leaf )
+			{
+				if( LeafOverlaps(leaf, aabb) && !callback->QueryCallback(leaf) )
+					return;
+			}
+		}
+		else
+		{
+			int32 nodeIdx = (int32)(&node - &mNodes[0]);
+			stack[count++] = node.index;
+			stack[count++] = nodeIdx + 1;
+		}
+	}
+}
+
+// same contract as b2DynamicTree::RayCast: the callback returns 0 to stop, a fraction to clip the
+// ray there, or -1 to leave it alone.  children are visited near side first so clipping kicks in early.
+template <typename T>
+inline void StaticBVH::RayCast( T* callback, const b2RayCastInput& input ) const
+{
+	if( mNodes.empty() )
+		return;
+	
+	b2Vec2 p1 = input.p1;
+	b2Vec2 p2 = input.p2;
+	b2Vec2 r = p2 - p1;
+	
+	if( r.LengthSquared() <= 0.0f )
+		return;
+	
+	r.Normalize();
+	
+	// v is perpendicular to the segment
+	b2Vec2 v = b2Cross(1.0f, r);
+	b2Vec2 absV = b2Abs(v);
+	
+	float32 maxFraction = input.maxFraction;
+	
+	b2AABB segmentAABB;
+	{
+		b2Vec2 t = p1 + maxFraction * (p2 - p1);
+		segmentAABB.lowerBound = b2Min(p1, t);
+		segmentAABB.upperBound = b2Max(p1, t);
+	}
+	
+	int32 stack[kMaxDepth];
+	int32 count = 0;
+	stack[count++] = 0;
+	
+	while( count > 0 )
+	{
+		int32 nodeIdx = stack[--count];
+		const Node& node = mNodes[nodeIdx];
+		
+		if( !b2TestOverlap(node.aabb, segmentAABB) )
+			continue;
+		
+		// separating axis for segment (Gino, p80)
+		// |dot(v, p1 - c)| > dot(|v|, h)
+		b2Vec2 c = node.aabb.GetCenter();
+		b2Vec2 h = node.aabb.GetExtents();
+		
+		if( b2Abs(b2Dot(v, p1 - c)) - b2Dot(absV, h) > 0.0f )
+			continue;
+		
+		if( node.leafCount > 0 )
+		{
+			for( int32 leaf = node.index; leaf < node.index + node.leafCount; ++leaf )
+			{
+				if( !LeafOverlaps(leaf, segmentAABB) )
+					continue;
+				
+				b2RayCastInput subInput;
+				subInput.p1 = input.p1;
+				subInput.p2 = input.p2;
+				subInput.maxFraction = maxFraction;
+				
+				float32 value = callback->RayCastCallback(subInput, leaf);
+				
+				if( value == 0.0f )
+					return;
+				
+				if( value > 0.0f )
+				{
+					maxFraction = value;
+					
+					b2Vec2 t = p1 + maxFraction * (p2 - p1);
+					segmentAABB.lowerBound = b2Min(p1, t);
+					segmentAABB.upperBound = b2Max(p1, t);
+				}
+			}
+		}
+		else
+		{
+			// push the far child first so the near one comes off the stack first
+			bool firstIsNear = (node.axis == 0 ? r.x : r.y) >= 0.0f;
+			
+			if( firstIsNear )
+			{
+				stack[count++] = node.index;
+				stack[count++] = nodeIdx + 1;
+			}
+			else
+			{
+				stack[count++] = nodeIdx + 1;
+				stack[count++] = node.index;
+			}
+		}
+	}
+}
+
+template <typename T>
+inline void StaticBVH::QueryNearest( T* callback, const b2AABB& aabb, float32 maxDistance ) const
+{
+	if( mNodes.empty() )
+		return;
+	
+	float32 boundSquared = maxDistance * maxDistance;
+	
+	int32 stack[kMaxDepth];
+	int32 count = 0;
+	stack[count++] = 0;
+	
+	while( count > 0 )
+	{
+		int32 nodeIdx = stack[--count];
+		const Node& node = mNodes[nodeIdx];
+		
+		// the bound may have shrunk since the node was pushed
+		if( DistanceSquared(node.aabb, aabb) > boundSquared )
+			continue;
+		
+		if( node.leafCount > 0 )
+		{
+			for( int32 leaf = node.index; leaf < node.index + node.leafCount; ++leaf )
+			{
+				if( DistanceSquared(mLeafMinX[leaf], mLeafMinY[leaf], mLeafMaxX[leaf], mLeafMaxY[leaf], aabb) > boundSquared )
+					continue;
+				
+				float32 bound = callback->NearestCallback(leaf);
+				boundSquared = b2Min(boundSquared, bound * bound);
+			}
+		}
+		else
+		{
+			// push the far child first so the near one comes off the stack first
+			int32 first = nodeIdx + 1;
+			int32 second = node.index;
+			
+			float32 firstDistance = DistanceSquared(mNodes[first].aabb, aabb);
+			float32 secondDistance = DistanceSquared(mNodes[second].aabb, aabb);
+			
+			if( firstDistance > secondDistance )
+			{
+				b2Swap(first, second);
+				b2Swap(firstDistance, secondDistance);
+			}
+			
+			if( secondDistance <= boundSquared )
+				stack[count++] = second;
+			
+			if( firstDistance <= boundSquared )
+				stack[count++] = first;
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,276 @@
+//
+//	SweepCache.cpp
+//
+//	Created by Aaron Pendley on 4/9/10.
+//	Copyright 2010 Aaron Pendley.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+// 
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+// 
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+
+#include "SweepCache.h"
+#include "CollisionStats.h"
+
+
+// extra distance required before a pair is rejected without a TOI.  b2TimeOfImpact reports a
+// touch slightly before the shapes' surfaces meet, so leave room for its tolerance.
+static const float32 kCullMargin = 2.0f * b2_linearSlop;
+
+// projects a proxy, placed at xform, onto a world space axis
+static void ProjectProxy( const b2DistanceProxy& proxy, const b2Transform& xform, const b2Vec2& axis, float32* minProjection, float32* maxProjection )
+{
+	float32 lower = b2_maxFloat;
+	float32 upper = -b2_maxFloat;
+	
+	for( int32 vertexIdx = 0; vertexIdx < proxy.GetVertexCount(); ++vertexIdx )
+	{
+		float32 projection = b2Dot(axis, b2Mul(xform, proxy.GetVertex(vertexIdx)));
+		lower = b2Min(lower, projection);
+		upper = b2Max(upper, projection);
+	}
+	
+	*minProjection = lower - proxy.m_radius;
+	*maxProjection = upper + proxy.m_radius;
+}
+
+SweepCache::SweepCache( int maxIdleFrames )
+: mFrame(0)
+, mMaxIdleFrames(maxIdleFrames)
+, mTotalIterationsSaved(0.0f)
+{
+}
+
+void SweepCache::BeginFrame()
+{
+	if( mFrame > 0 )
+		mTotalIterationsSaved += GetIterationsSavedThisFrame();
+	
+	mFrame++;
+	mFrameStats.Reset();
+	
+	for( EntryMap::iterator it = mEntries.begin(); it != mEntries.end(); )
+	{
+		if( mFrame - it->second.lastFrame > (unsigned int)mMaxIdleFrames )
+			it = mEntries.erase(it);
+		else
+			++it;
+	}
+	
+	for( ProxyMap::iterator it = mProxies.begin(); it != mProxies.end(); )
+	{
+		if( mFrame - it->second.lastFrame > (unsigned int)mMaxIdleFrames )
+			it = mProxies.erase(it);
+		else
+			++it;
+	}
+}
+
+void SweepCache::RemoveFixture( b2Fixture* fixture )
+{
+	for( EntryMap::iterator it = mEntries.begin(); it != mEntries.end(); )
+	{
+		if( it->first.fixture == fixture )
+			it = mEntries.erase(it);
+		else
+			++it;
+	}
+	
+	// children past the shape's current count, left over from a shape change, go idle and are evicted
+	ProxyKey key;
+	key.fixture = fixture;
+	
+	for( key.childIndex = 0; key.childIndex < fixture->GetShape()->GetChildCount(); ++key.childIndex )
+		mProxies.erase(key);
+}
+
+void SweepCache::RemoveShape( const b2Shape* shape )
+{
+	for( EntryMap::iterator it = mEntries.begin(); it != mEntries.end(); )
+	{
+		if( it->first.shape == shape )
+			it = mEntries.erase(it);
+		else
+			++it;
+	}
+}
+
+void SweepCache::Clear()
+{
+	mEntries.clear();
+	mProxies.clear();
+}
+
+const b2DistanceProxy& SweepCache::GetProxy( b2Fixture* fixture, int32 childIndex )
+{
+	ProxyKey key;
+	key.fixture = fixture;
+	key.childIndex = childIndex;
+	
+	std::pair<ProxyMap::iterator, bool> inserted = mProxies.insert(std::make_pair(key, ProxyEntry()));
+	ProxyEntry& entry = inserted.first->second;
+	const b2Shape* shape = fixture->GetShape();
+	
+	mFrameStats.proxyLookups++;
+	mTotalStats.proxyLookups++;
+	
+	// a new entry, or a fixture whose shape was replaced or edited
+	if( inserted.second || entry.shape != shape || entry.childCount != shape->GetChildCount() || entry.radius != shape->m_radius )
+	{
+		entry.shape = shape;
+		entry.childCount = shape->GetChildCount();
+		entry.radius = shape->m_radius;
+		
+		// built in the map node, which is where a chain child's proxy points its vertices
+		entry.proxy.Set(shape, childIndex);
+		
+		mFrameStats.proxyBuilds++;
+		mTotalStats.proxyBuilds++;
+	}
+	
+	entry.lastFrame = mFrame;
+	return entry.proxy;
+}
+
+bool SweepCache::MayCollide( const b2Shape* shape, const b2DistanceProxy& proxy, const b2Transform& xform, b2Fixture* otherFixture, int32 childIndex, const b2DistanceProxy& proxyOther, const b2Transform& xformOther, const b2Vec2& motion )
+{
+	Key key;
+	key.shape = shape;
+	key.fixture = otherFixture;
+	key.childIndex = childIndex;
+	
+	std::pair<EntryMap::iterator, bool> inserted = mEntries.insert(std::make_pair(key, Entry()));
+	Entry& entry = inserted.first->second;
+	
+	// a new entry, or a shape that was replaced by a different one at the same address
+	if( inserted.second || entry.vertexCount != proxy.GetVertexCount() || entry.vertexCountOther != proxyOther.GetVertexCount() )
+	{
+		entry.simplex.count = 0;
+		entry.vertexCount = proxy.GetVertexCount();
+		entry.vertexCountOther = proxyOther.GetVertexCount();
+		entry.hasAxis = false;
+	}
+	
+	entry.lastFrame = mFrame;
+	
+	mFrameStats.queries++;
+	mTotalStats.queries++;
+	
+	// moving by motion closes the gap along an axis by at most dot(motion, axis), and the other
+	// shape doesn't move, so if the gap is bigger than that the axis separates the whole sweep
+	if( entry.hasAxis )
+	{
+		float32 minA, maxA, minB, maxB;
+		ProjectProxy(proxy, xform, entry.axis, &minA, &maxA);
+		ProjectProxy(proxyOther, xformOther, entry.axis, &minB, &maxB);
+		
+		float32 gap = minB - maxA;
+		
+		if( gap > b2Max(0.0f, b2Dot(motion, entry.axis)) + kCullMargin )
+		{
+			mFrameStats.axisCulls++;
+			mTotalStats.axisCulls++;
+			return false;
+		}
+	}
+	
+	// the axis didn't separate them, so find the closest points, starting from last time's simplex
+	b2DistanceInput distInput;
+	distInput.proxyA = proxy;
+	distInput.proxyB = proxyOther;
+	distInput.transformA = xform;
+	distInput.transformB = xformOther;
+	distInput.useRadii = true;
+	
+	bool warm = entry.simplex.count > 0;
+	
+	b2DistanceOutput distOutput;
+	b2Distance(&distOutput, &entry.simplex, &distInput);
+	
+	COLLISION_STATS_COUNT(e_statsDistanceCalls, 1);
+	COLLISION_STATS_COUNT(e_statsDistanceIterations, (uint64_t)distOutput.iterations);
+	
+	if( warm )
+	{
+		mFrameStats.warmDistanceCalls++;
+		mFrameStats.warmIterations += distOutput.iterations;
+		mTotalStats.warmDistanceCalls++;
+		mTotalStats.warmIterations += distOutput.iterations;
+	}
+	else
+	{
+		mFrameStats.coldDistanceCalls++;
+		mFrameStats.coldIterations += distOutput.iterations;
+		mTotalStats.coldDistanceCalls++;
+		mTotalStats.coldIterations += distOutput.iterations;
+	}
+	
+	if( distOutput.distance <= 0.0f )
+	{
+		// overlapping, there is no separating axis to remember
+		entry.hasAxis = false;
+		return true;
+	}
+	
+	// the direction between the closest points is the best separating axis there is
+	b2Vec2 axis = distOutput.pointB - distOutput.pointA;
+	
+	if( axis.Normalize() < b2_epsilon )
+	{
+		entry.hasAxis = false;
+		return true;
+	}
+	
+	entry.axis = axis;
+	entry.hasAxis = true;
+	
+	if( distOutput.distance > b2Max(0.0f, b2Dot(motion, axis)) + kCullMargin )
+	{
+		mFrameStats.distanceCulls++;
+		mTotalStats.distanceCulls++;
+		return false;
+	}
+	
+	return true;
+}
+
+float32 SweepCache::GetAverageColdIterations() const
+{
+	if( mTotalStats.coldDistanceCalls == 0 )
+		return 0.0f;
+	
+	return (float32)mTotalStats.coldIterations / (float32)mTotalStats.coldDistanceCalls;
+}
+
+float32 SweepCache::GetIterationsSavedThisFrame() const
+{
+	// every warm started query and every axis cull would otherwise have been a cold distance query
+	float32 coldAverage = GetAverageColdIterations();
+	float32 saved = coldAverage * (float32)(mFrameStats.warmDistanceCalls + mFrameStats.axisCulls) - (float32)mFrameStats.warmIterations;
+	
+	return b2Max(0.0f, saved);
+}
+
+float32 SweepCache::GetAverageIterationsSavedPerFrame() const
+{
+	// frames 1 to mFrame - 1 are accumulated, the current frame isn't yet
+	if( mFrame == 0 )
+		return GetIterationsSavedThisFrame();
+	
+	return (mTotalIterationsSaved + GetIterationsSavedThisFrame()) / (float32)mFrame;
+}
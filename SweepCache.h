@@ -0,0 +1,203 @@
+//
+//	SweepCache.h
+//
+//	Created by Aaron Pendley on 4/9/10.
+//	Copyright 2010 Aaron Pendley.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+// 
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+// 
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+
+
+#ifndef _SWEEPCACHE_H_INCLUDED_
+#define _SWEEPCACHE_H_INCLUDED_
+
+#include "Box2D.h"
+
+#include <unordered_map>
+
+
+struct SweepCacheStats
+{
+	SweepCacheStats() { Reset(); }
+	
+	void Reset()
+	{
+		queries = 0;
+		axisCulls = 0;
+		distanceCulls = 0;
+		warmDistanceCalls = 0;
+		warmIterations = 0;
+		coldDistanceCalls = 0;
+		coldIterations = 0;
+		proxyLookups = 0;
+		proxyBuilds = 0;
+	}
+	
+	int queries;				// shape vs fixture pairs tested against the cache
+	int axisCulls;				// pairs rejected by the cached separating axis, no GJK at all
+	int distanceCulls;			// pairs rejected by the warm started distance query, no TOI
+	int warmDistanceCalls;		// distance queries started from a cached simplex
+	int warmIterations;			// GJK iterations spent by those
+	int coldDistanceCalls;		// distance queries started from scratch
+	int coldIterations;			// GJK iterations spent by those
+	int proxyLookups;			// fixture child proxies asked for
+	int proxyBuilds;			// of those, the ones that had to be built
+};
+
+
+// remembers, per (query shape, other fixture child), the GJK simplex and separating axis from
+// the last sweep between them.  before running a TOI, the sweep queries ask the cache whether
+// the pair can possibly touch: first with a projection onto last frame's separating axis, then
+// with a distance query warm started from last frame's simplex.  characters and projectiles that
+// sweep near the same fixtures every frame mostly get rejected here without a TOI.
+//
+// b2TimeOfImpact always starts its own simplex from scratch, so the cache saves work by
+// skipping the TOI rather than by seeding it.
+//
+// the cache also keeps the distance proxy of every fixture child the sweeps test against, so a
+// fixture swept against by many queries has its proxy built once rather than once per query.
+//
+// not thread safe; use one cache per thread.  call RemoveFixture from your b2DestructionListener,
+// and before b2Body::DestroyFixture, so entries never refer to destroyed fixtures, and BeginFrame
+// once per frame.
+class SweepCache
+{
+public:
+	// entries not used for maxIdleFrames frames are dropped in BeginFrame
+	explicit SweepCache( int maxIdleFrames = 30 );
+	
+	// starts a new frame: evicts idle entries and resets the frame stats
+	void BeginFrame();
+	
+	// drops all entries referring to the fixture or query shape.  the fixture must not be destroyed yet.
+	void RemoveFixture( b2Fixture* fixture );
+	void RemoveShape( const b2Shape* shape );
+	
+	void Clear();
+	
+	// returns false if the shape at xform, moved by motion, can't touch the other proxy.
+	// returns true if a TOI is needed to find out.  xform must place the shape where the sweep starts
+	// it, i.e. the sweep's transform at t = 0.
+	bool MayCollide( const b2Shape* shape, const b2DistanceProxy& proxy, const b2Transform& xform, b2Fixture* otherFixture, int32 childIndex, const b2DistanceProxy& proxyOther, const b2Transform& xformOther, const b2Vec2& motion );
+	
+	// the proxy of a fixture child, built the first time it's asked for.  it's rebuilt when the fixture's
+	// shape is replaced or its child count or radius changes.  polygon, circle and edge proxies point into
+	// the shape, so vertices moved in place are picked up; a chain child's two vertices are copied, so call
+	// RemoveFixture after moving a chain's vertices in place.  the reference stays valid until the entry
+	// is dropped.
+	const b2DistanceProxy& GetProxy( b2Fixture* fixture, int32 childIndex );
+	
+	int GetEntryCount() const { return (int)mEntries.size(); }
+	int GetProxyCount() const { return (int)mProxies.size(); }
+	
+	// stats for the current frame, and accumulated since the cache was created
+	const SweepCacheStats& GetFrameStats() const { return mFrameStats; }
+	const SweepCacheStats& GetTotalStats() const { return mTotalStats; }
+	
+	// estimate of the GJK iterations saved this frame, compared to running every distance query cold
+	// and not counting the iterations inside the TOIs that were skipped
+	float32 GetIterationsSavedThisFrame() const;
+	
+	// average of GetIterationsSavedThisFrame over all frames so far
+	float32 GetAverageIterationsSavedPerFrame() const;
+	
+private:
+	struct Key
+	{
+		const b2Shape* shape;
+		const b2Fixture* fixture;
+		int32 childIndex;
+		
+		bool operator == ( const Key& other ) const
+		{
+			return shape == other.shape && fixture == other.fixture && childIndex == other.childIndex;
+		}
+	};
+	
+	struct KeyHash
+	{
+		size_t operator () ( const Key& key ) const
+		{
+			size_t h = (size_t)key.shape;
+			h = h * 31 + (size_t)key.fixture;
+			h = h * 31 + (size_t)key.childIndex;
+			return h ^ (h >> 16);
+		}
+	};
+	
+	struct Entry
+	{
+		b2SimplexCache simplex;
+		int32 vertexCount;
+		int32 vertexCountOther;
+		b2Vec2 axis;
+		bool hasAxis;
+		unsigned int lastFrame;
+	};
+	
+	struct ProxyKey
+	{
+		const b2Fixture* fixture;
+		int32 childIndex;
+		
+		bool operator == ( const ProxyKey& other ) const
+		{
+			return fixture == other.fixture && childIndex == other.childIndex;
+		}
+	};
+	
+	struct ProxyKeyHash
+	{
+		size_t operator () ( const ProxyKey& key ) const
+		{
+			size_t h = (size_t)key.fixture;
+			h = h * 31 + (size_t)key.childIndex;
+			return h ^ (h >> 16);
+		}
+	};
+	
+	// what the proxy was built from, to notice when that changes
+	struct ProxyEntry
+	{
+		const b2Shape* shape;
+		int32 childCount;
+		float32 radius;
+		unsigned int lastFrame;
+		b2DistanceProxy proxy;
+	};
+	
+	float32 GetAverageColdIterations() const;
+	
+	typedef std::unordered_map<Key, Entry, KeyHash> EntryMap;
+	
+	// map nodes don't move, so a chain child's proxy can keep pointing at its own m_buffer
+	typedef std::unordered_map<ProxyKey, ProxyEntry, ProxyKeyHash> ProxyMap;
+	
+	EntryMap mEntries;
+	ProxyMap mProxies;
+	unsigned int mFrame;
+	int mMaxIdleFrames;
+	
+	SweepCacheStats mFrameStats;
+	SweepCacheStats mTotalStats;
+	float32 mTotalIterationsSaved;
+};
+
+#endif
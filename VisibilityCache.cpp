@@ -0,0 +1,368 @@
+//
+//	VisibilityCache.cpp
+//
+//	Created by Aaron Pendley on 4/9/10.
+//	Copyright 2010 Aaron Pendley.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+// 
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+// 
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+
+#include "VisibilityCache.h"
+#include "QueryPolicies.h"
+
+#include <stdint.h>
+
+
+static const int32 kNullEntry = -1;
+
+// b2DynamicTree keeps an internal node for every leaf, a little under 40 bytes each
+static const int kTreeBytesPerEntry = 2 * 40;
+
+// an unordered_map node carries a next pointer, and the map a bucket pointer, besides the value
+static const int kMapBytesPerNode = 2 * (int)sizeof(void*);
+
+// skips the fixtures of the body the line starts from, then applies the query filter
+struct LineOfSightFilterPolicy
+{
+	LineOfSightFilterPolicy( const QueryFilter& filter, const b2Body* from ) : mFilter(filter), mFrom(from) {}
+	
+	bool Accept( b2Fixture* fixture ) const
+	{
+		return fixture->GetBody() != mFrom && mFilter.Accept(fixture);
+	}
+	
+	QueryFilterPolicy mFilter;
+	const b2Body* mFrom;
+};
+
+// bounds of a body's fixtures, or of its origin if it has none.  computed from the shapes, since
+// fixtures on an inactive body have no broadphase AABBs to read.
+static b2AABB ComputeBodyAABB( b2Body* body, int32* fixtureCount )
+{
+	b2AABB aabb;
+	aabb.lowerBound = aabb.upperBound = body->GetPosition();
+	
+	*fixtureCount = 0;
+	
+	for( b2Fixture* fixture = body->GetFixtureList(); fixture != NULL; fixture = fixture->GetNext() )
+	{
+		const b2Shape* shape = fixture->GetShape();
+		
+		for( int32 childIdx = 0; childIdx < shape->GetChildCount(); ++childIdx )
+		{
+			b2AABB childAABB;
+			shape->ComputeAABB(&childAABB, body->GetTransform(), childIdx);
+			
+			if( *fixtureCount == 0 && childIdx == 0 )
+				aabb = childAABB;
+			else
+				aabb.Combine(aabb, childAABB);
+		}
+		
+		(*fixtureCount)++;
+	}
+	
+	return aabb;
+}
+
+VisibilityCache::VisibilityCache( int maxBytes, float32 quantization )
+: mHead(kNullEntry)
+, mTail(kNullEntry)
+, mFreeList(kNullEntry)
+, mStamp(0)
+, mMaxBytes(maxBytes)
+, mInvQuantization(1.0f / quantization)
+{
+	assert(quantization > 0.0f);
+}
+
+int VisibilityCache::GetMaxEntries() const
+{
+	int bytesPerEntry = (int)(sizeof(Entry) + sizeof(EntryMap::value_type)) + kMapBytesPerNode + kTreeBytesPerEntry;
+	int bodyBytes = (int)mBodies.size() * ((int)sizeof(BodyMap::value_type) + kMapBytesPerNode);
+	
+	return b2Max(1, (mMaxBytes - bodyBytes) / bytesPerEntry);
+}
+
+int VisibilityCache::GetBytesUsed() const
+{
+	int bytesPerEntry = (int)(sizeof(Entry) + sizeof(EntryMap::value_type)) + kMapBytesPerNode + kTreeBytesPerEntry;
+	int bodyBytes = (int)mBodies.size() * ((int)sizeof(BodyMap::value_type) + kMapBytesPerNode);
+	
+	return (int)mEntryMap.size() * bytesPerEntry + bodyBytes;
+}
+
+VisibilityCache::Key VisibilityCache::MakeKey( b2Body* bodyA, b2Body* bodyB, const b2Vec2& from, const b2Vec2& to, const QueryFilter& filter ) const
+{
+	Key key;
+	key.bodyA = bodyA;
+	key.bodyB = bodyB;
+	key.ignored = filter.ignored;
+	key.maskBits = filter.maskFilter;
+	key.categoryBits = filter.categoryFilter;
+	key.from[0] = (int32)floorf(from.x * mInvQuantization);
+	key.from[1] = (int32)floorf(from.y * mInvQuantization);
+	key.to[0] = (int32)floorf(to.x * mInvQuantization);
+	key.to[1] = (int32)floorf(to.y * mInvQuantization);
+	return key;
+}
+
+bool VisibilityCache::TestLineOfSight( b2World* world, b2Body* bodyA, b2Body* bodyB, const b2Vec2& from, const b2Vec2& to, const QueryFilter& filter, b2Fixture** occluder )
+{
+	Key key = MakeKey(bodyA, bodyB, from, to, filter);
+	EntryMap::iterator found = mEntryMap.find(key);
+	
+	if( found != mEntryMap.end() )
+	{
+		Entry& entry = mEntries[found->second];
+		
+		Unlink(found->second);
+		LinkFront(found->second);
+		
+		mStats.hits++;
+		
+		if( occluder != NULL )
+			*occluder = entry.occluder;
+		
+		return entry.visible;
+	}
+	
+	mStats.misses++;
+	
+	// the closest hit decides it: nothing, or the target itself, means the line is clear
+	RayCastResult result;
+	ClosestHitCollector collector(&result);
+	CollideRayWith(world, from, to, &collector, LineOfSightFilterPolicy(filter, bodyA));
+	
+	bool visible = !collector.mHit || (bodyB != NULL && result.fixture->GetBody() == bodyB);
+	b2Fixture* blocker = visible ? NULL : result.fixture;
+	
+	Evict(GetMaxEntries() - 1);
+	
+	int32 entryIdx = AllocateEntry();
+	Entry& entry = mEntries[entryIdx];
+	entry.key = key;
+	entry.occluder = blocker;
+	entry.visible = visible;
+	
+	// the answer is reused for any line with its ends in the same grid cells, so the bounds cover the cells
+	float32 cellSize = 1.0f / mInvQuantization;
+	b2AABB bounds;
+	bounds.lowerBound = b2Min(from, to) - b2Vec2(cellSize, cellSize);
+	bounds.upperBound = b2Max(from, to) + b2Vec2(cellSize, cellSize);
+	
+	entry.proxyId = mTree.CreateProxy(bounds, (void*)(intptr_t)entryIdx);
+	
+	mEntryMap[key] = entryIdx;
+	LinkFront(entryIdx);
+	
+	if( occluder != NULL )
+		*occluder = blocker;
+	
+	return visible;
+}
+
+void VisibilityCache::Update( b2World* world )
+{
+	mStamp++;
+	
+	for( b2Body* body = world->GetBodyList(); body != NULL; body = body->GetNext() )
+	{
+		int32 fixtureCount = 0;
+		
+		for( b2Fixture* fixture = body->GetFixtureList(); fixture != NULL; fixture = fixture->GetNext() )
+			fixtureCount++;
+		
+		std::pair<BodyMap::iterator, bool> inserted = mBodies.insert(std::make_pair(body, BodyState()));
+		BodyState& state = inserted.first->second;
+		
+		if( inserted.second )
+		{
+			// something new may be in the way of anything near it
+			state.aabb = ComputeBodyAABB(body, &state.fixtureCount);
+			Invalidate(state.aabb, NULL);
+		}
+		else if( !(state.position == body->GetPosition()) || state.angle != body->GetAngle() || state.fixtureCount != fixtureCount )
+		{
+			// entries along both where it was and where it is now are affected
+			b2AABB aabb = ComputeBodyAABB(body, &state.fixtureCount);
+			
+			b2AABB swept;
+			swept.Combine(state.aabb, aabb);
+			Invalidate(swept, body);
+			
+			state.aabb = aabb;
+		}
+		
+		state.position = body->GetPosition();
+		state.angle = body->GetAngle();
+		state.stamp = mStamp;
+	}
+	
+	// anything we didn't see has been destroyed
+	for( BodyMap::iterator it = mBodies.begin(); it != mBodies.end(); )
+	{
+		if( it->second.stamp != mStamp )
+		{
+			Invalidate(it->second.aabb, NULL);
+			it = mBodies.erase(it);
+		}
+		else
+		{
+			++it;
+		}
+	}
+	
+	// new bodies take their share of the budget from the entries
+	Evict(GetMaxEntries());
+}
+
+void VisibilityCache::Evict( int maxEntries )
+{
+	while( (int)mEntryMap.size() > maxEntries )
+	{
+		RemoveEntry(mTail);
+		mStats.evictions++;
+	}
+}
+
+void VisibilityCache::OnFixtureDestroyed( b2Fixture* fixture )
+{
+	const b2Shape* shape = fixture->GetShape();
+	
+	for( int32 childIdx = 0; childIdx < shape->GetChildCount(); ++childIdx )
+	{
+		b2AABB aabb;
+		shape->ComputeAABB(&aabb, fixture->GetBody()->GetTransform(), childIdx);
+		Invalidate(aabb, NULL);
+	}
+}
+
+// collects the entries a change inside an AABB affects
+class VisibilityInvalidateQuery
+{
+public:
+	VisibilityInvalidateQuery( const b2DynamicTree* tree, std::vector<int32>* invalidated )
+	: mTree(tree)
+	, mInvalidated(invalidated)
+	{
+	}
+	
+	bool QueryCallback( int32 proxyId )
+	{
+		mInvalidated->push_back((int32)(intptr_t)mTree->GetUserData(proxyId));
+		return true;
+	}
+	
+	const b2DynamicTree* mTree;
+	std::vector<int32>* mInvalidated;
+};
+
+void VisibilityCache::Invalidate( const b2AABB& aabb, const b2Body* mover )
+{
+	if( mEntryMap.empty() )
+		return;
+	
+	mInvalidated.clear();
+	
+	VisibilityInvalidateQuery query(&mTree, &mInvalidated);
+	mTree.Query(&query, aabb);
+	
+	for( size_t invalidatedIdx = 0; invalidatedIdx < mInvalidated.size(); ++invalidatedIdx )
+	{
+		int32 entryIdx = mInvalidated[invalidatedIdx];
+		const Key& key = mEntries[entryIdx].key;
+		
+		// the ends of the line follow the bodies there, and the snapped ends already cover their movement
+		if( mover != NULL && (key.bodyA == mover || key.bodyB == mover) )
+			continue;
+		
+		RemoveEntry(entryIdx);
+		mStats.invalidations++;
+	}
+}
+
+void VisibilityCache::Clear()
+{
+	for( EntryMap::iterator it = mEntryMap.begin(); it != mEntryMap.end(); ++it )
+		mTree.DestroyProxy(mEntries[it->second].proxyId);
+	
+	mEntryMap.clear();
+	mEntries.clear();
+	mBodies.clear();
+	
+	mHead = kNullEntry;
+	mTail = kNullEntry;
+	mFreeList = kNullEntry;
+}
+
+int32 VisibilityCache::AllocateEntry()
+{
+	if( mFreeList != kNullEntry )
+	{
+		int32 entryIdx = mFreeList;
+		mFreeList = mEntries[entryIdx].next;
+		return entryIdx;
+	}
+	
+	mEntries.push_back(Entry());
+	return (int32)mEntries.size() - 1;
+}
+
+void VisibilityCache::RemoveEntry( int32 entryIdx )
+{
+	Entry& entry = mEntries[entryIdx];
+	
+	mTree.DestroyProxy(entry.proxyId);
+	mEntryMap.erase(entry.key);
+	Unlink(entryIdx);
+	
+	entry.next = mFreeList;
+	mFreeList = entryIdx;
+}
+
+void VisibilityCache::LinkFront( int32 entryIdx )
+{
+	Entry& entry = mEntries[entryIdx];
+	entry.prev = kNullEntry;
+	entry.next = mHead;
+	
+	if( mHead != kNullEntry )
+		mEntries[mHead].prev = entryIdx;
+	else
+		mTail = entryIdx;
+	
+	mHead = entryIdx;
+}
+
+void VisibilityCache::Unlink( int32 entryIdx )
+{
+	Entry& entry = mEntries[entryIdx];
+	
+	if( entry.prev != kNullEntry )
+		mEntries[entry.prev].next = entry.next;
+	else
+		mHead = entry.next;
+	
+	if( entry.next != kNullEntry )
+		mEntries[entry.next].prev = entry.prev;
+	else
+		mTail = entry.prev;
+}
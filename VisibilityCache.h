@@ -0,0 +1,201 @@
+//
+//	VisibilityCache.h
+//
+//	Created by Aaron Pendley on 4/9/10.
+//	Copyright 2010 Aaron Pendley.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+// 
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+// 
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+
+#ifndef _VISIBILITYCACHE_H_INCLUDED_
+#define _VISIBILITYCACHE_H_INCLUDED_
+
+#include "CollisionUtil.h"
+
+#include <unordered_map>
+#include <vector>
+
+
+struct VisibilityCacheStats
+{
+	VisibilityCacheStats() { Reset(); }
+	
+	void Reset()
+	{
+		hits = 0;
+		misses = 0;
+		invalidations = 0;
+		evictions = 0;
+	}
+	
+	float32 GetHitRate() const { return hits + misses > 0 ? (float32)hits / (float32)(hits + misses) : 0.0f; }
+	
+	int hits;				// answered from the cache
+	int misses;				// answered with a ray cast
+	int invalidations;		// entries dropped because something near their ray moved or was destroyed
+	int evictions;			// entries dropped, least recently used first, to stay in budget
+};
+
+// remembers line of sight answers between pairs of bodies.  an entry is keyed by the two bodies,
+// the filter, and both ends of the line snapped to a grid, so an agent that stands still, or barely
+// moves, keeps getting the same answer without a ray cast.
+//
+// an entry stays valid until a body whose fixtures overlap the line's bounds moves, gains or loses
+// fixtures, or is destroyed.  that covers the occluder the answer depended on, since it lies on the
+// line, and anything that could have moved into the way.  the two bodies at the ends of the line are
+// the exception: their movement is already covered by the snapped ends.
+//
+// the entries' bounds are kept in a dynamic tree of their own, so finding the entries a moving body
+// affects doesn't depend on how many there are.  memory is held to a fixed budget, which also pays
+// for what the cache remembers about each body in the world, and the least recently used entries go
+// first when it runs out.  a world with more bodies leaves room for fewer entries.
+//
+// call Update once per frame after stepping the world, and OnFixtureDestroyed from your
+// b2DestructionListener.  not thread safe.
+class VisibilityCache
+{
+public:
+	static const int kDefaultMaxBytes = 64 * 1024;
+	
+	// quantization is the size, in meters, of the grid the ends of a line are snapped to
+	explicit VisibilityCache( int maxBytes = kDefaultMaxBytes, float32 quantization = 0.25f );
+	
+	// returns true if nothing the filter accepts lies between from and to.  fixtures on bodyA are
+	// skipped, and the line counts as clear if the first thing it hits is on bodyB.  either body may be NULL.
+	// occluder is set to the fixture in the way, or NULL if the line is clear.
+	bool TestLineOfSight( b2World* world, b2Body* bodyA, b2Body* bodyB, const b2Vec2& from, const b2Vec2& to, const QueryFilter& filter, b2Fixture** occluder = NULL );
+	
+	// drops the entries affected by bodies that moved, or changed fixtures, or were destroyed, since the last update
+	void Update( b2World* world );
+	
+	// drops the entries that may have depended on the fixture
+	void OnFixtureDestroyed( b2Fixture* fixture );
+	
+	void Clear();
+	
+	int GetEntryCount() const { return (int)mEntryMap.size(); }
+	
+	// entries that fit in what's left of the budget after the body states, always at least one
+	int GetMaxEntries() const;
+	
+	// approximate memory held by the entries, their map nodes and tree nodes, and the body states
+	int GetBytesUsed() const;
+	int GetMaxBytes() const { return mMaxBytes; }
+	
+	const VisibilityCacheStats& GetStats() const { return mStats; }
+	void ResetStats() { mStats.Reset(); }
+	
+private:
+	VisibilityCache( const VisibilityCache& );
+	VisibilityCache& operator = ( const VisibilityCache& );
+	
+	struct Key
+	{
+		const b2Body* bodyA;
+		const b2Body* bodyB;
+		const void* ignored;
+		uint16 maskBits;
+		uint16 categoryBits;
+		int32 from[2];
+		int32 to[2];
+		
+		bool operator == ( const Key& other ) const
+		{
+			return bodyA == other.bodyA && bodyB == other.bodyB && ignored == other.ignored
+				&& maskBits == other.maskBits && categoryBits == other.categoryBits
+				&& from[0] == other.from[0] && from[1] == other.from[1] && to[0] == other.to[0] && to[1] == other.to[1];
+		}
+	};
+	
+	struct KeyHash
+	{
+		size_t operator () ( const Key& key ) const
+		{
+			size_t h = (size_t)key.bodyA;
+			h = h * 31 + (size_t)key.bodyB;
+			h = h * 31 + (size_t)key.ignored;
+			h = h * 31 + ((size_t)key.maskBits << 16 | key.categoryBits);
+			h = h * 31 + (size_t)(uint32)key.from[0];
+			h = h * 31 + (size_t)(uint32)key.from[1];
+			h = h * 31 + (size_t)(uint32)key.to[0];
+			h = h * 31 + (size_t)(uint32)key.to[1];
+			return h ^ (h >> 16);
+		}
+	};
+	
+	struct Entry
+	{
+		Key key;
+		b2Fixture* occluder;
+		bool visible;
+		int32 proxyId;
+		
+		// least recently used list, and the free list for unused entries
+		int32 prev;
+		int32 next;
+	};
+	
+	// what a body looked like at the last update
+	struct BodyState
+	{
+		b2Vec2 position;
+		float32 angle;
+		int32 fixtureCount;
+		b2AABB aabb;
+		unsigned int stamp;
+	};
+	
+	typedef std::unordered_map<Key, int32, KeyHash> EntryMap;
+	typedef std::unordered_map<const b2Body*, BodyState> BodyMap;
+	
+	Key MakeKey( b2Body* bodyA, b2Body* bodyB, const b2Vec2& from, const b2Vec2& to, const QueryFilter& filter ) const;
+	
+	int32 AllocateEntry();
+	void RemoveEntry( int32 entryIdx );
+	void LinkFront( int32 entryIdx );
+	void Unlink( int32 entryIdx );
+	
+	// drops the entries whose bounds overlap the AABB, except those with mover at one end
+	void Invalidate( const b2AABB& aabb, const b2Body* mover );
+	
+	// drops least recently used entries until at most maxEntries are left
+	void Evict( int maxEntries );
+	
+	std::vector<Entry> mEntries;
+	EntryMap mEntryMap;
+	b2DynamicTree mTree;
+	
+	int32 mHead;			// most recently used
+	int32 mTail;			// least recently used
+	int32 mFreeList;
+	
+	BodyMap mBodies;
+	unsigned int mStamp;
+	
+	// scratch for Invalidate, entries can't be removed while the tree is being walked
+	std::vector<int32> mInvalidated;
+	
+	int mMaxBytes;
+	float32 mInvQuantization;
+	
+	VisibilityCacheStats mStats;
+};
+
+#endif
@@ -0,0 +1,528 @@
+//
+//	VisibilityPolygon.cpp
+//
+//	Created by Aaron Pendley on 4/9/10.
+//	Copyright 2010 Aaron Pendley.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+// 
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+// 
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+
+#include "VisibilityPolygon.h"
+#include "QueryContext.h"
+#include "QueryPolicies.h"
+
+#include <algorithm>
+#include <iterator>
+#include <math.h>
+#include <set>
+
+
+namespace
+{
+	const int kMinCircleSegments = 8;
+	const int kMaxCircleSegments = 256;
+	
+	// an occluding edge relative to the origin, a to b counter-clockwise around it
+	struct Segment
+	{
+		b2Vec2 a;
+		b2Vec2 b;
+	};
+	
+	// a segment's end passing under the sweeping ray
+	struct Event
+	{
+		float32 angle;
+		int segment;
+		bool start;
+		
+		// at the same angle, segments ending there leave before the ones starting there arrive
+		bool operator < ( const Event& other ) const
+		{
+			if( angle != other.angle )
+				return angle < other.angle;
+			
+			return !start && other.start;
+		}
+	};
+	
+	// two segments next to each other in the active set crossing, after which farther is the nearer one
+	struct Crossing
+	{
+		float32 angle;
+		b2Vec2 point;
+		int nearer;
+		int farther;
+	};
+	
+	// orders the crossing heap soonest first
+	struct CrossingLater
+	{
+		bool operator () ( const Crossing& a, const Crossing& b ) const
+		{
+			return a.angle > b.angle;
+		}
+	};
+	
+	// number of chords to cut a circle into so none strays more than tolerance from it
+	int GetCircleSegmentCount( float32 radius, float32 tolerance )
+	{
+		if( tolerance >= radius )
+			return kMinCircleSegments;
+		
+		// a chord spanning angle 2a is radius * (1 - cos(a)) from the circle at its middle
+		int count = (int)ceilf(b2_pi / acosf(1.0f - tolerance / radius));
+		return b2Clamp(count, kMinCircleSegments, kMaxCircleSegments);
+	}
+	
+	// distance along the ray from the origin in direction d to the line through the segment
+	float32 IntersectSegment( const Segment& segment, const b2Vec2& d )
+	{
+		b2Vec2 e = segment.b - segment.a;
+		float32 denominator = b2Cross(d, e);
+		
+		// the ray runs along the segment, its nearer end is where it's hit
+		if( b2Abs(denominator) < b2_epsilon )
+			return b2Min(segment.a.Length(), segment.b.Length());
+		
+		return b2Cross(segment.a, e) / denominator;
+	}
+	
+	// where two segments cross, if they do
+	bool IntersectSegments( const Segment& segment1, const Segment& segment2, b2Vec2* point )
+	{
+		b2Vec2 e1 = segment1.b - segment1.a;
+		b2Vec2 e2 = segment2.b - segment2.a;
+		float32 denominator = b2Cross(e1, e2);
+		
+		// parallel segments never change which one is nearer
+		if( denominator == 0.0f )
+			return false;
+		
+		b2Vec2 d = segment2.a - segment1.a;
+		float32 t1 = b2Cross(d, e2) / denominator;
+		float32 t2 = b2Cross(d, e1) / denominator;
+		
+		if( t1 < 0.0f || t1 > 1.0f || t2 < 0.0f || t2 > 1.0f )
+			return false;
+		
+		*point = segment1.a + t1 * e1;
+		return true;
+	}
+	
+	// distances along the ray closer than this, relative to the distance, are the same point
+	const float32 kSameDistance = 1e-4f;
+	
+	// how far behind the ray a crossing found by rounding can be and still be taken as on it
+	const float32 kCrossingAngleTolerance = 1e-3f;
+	
+	// orders the active segments by distance along the sweeping ray.  segments that meet on the ray
+	// are ordered by which is nearer just past it, so the order holds until the next event.
+	class NearerAlongRay
+	{
+	public:
+		NearerAlongRay( const Segment* segments, const b2Vec2* ray )
+		: mSegments(segments)
+		, mRay(ray)
+		{
+		}
+		
+		bool operator () ( int segment1, int segment2 ) const
+		{
+			if( segment1 == segment2 )
+				return false;
+			
+			float32 distance1 = IntersectSegment(mSegments[segment1], *mRay);
+			float32 distance2 = IntersectSegment(mSegments[segment2], *mRay);
+			
+			if( b2Abs(distance1 - distance2) > kSameDistance * b2Max(distance1, distance2) )
+				return distance1 < distance2;
+			
+			// turning counter-clockwise, the segment heading more towards the origin is in front
+			float32 cross = b2Cross(mSegments[segment1].b - mSegments[segment1].a, mSegments[segment2].b - mSegments[segment2].a);
+			
+			if( cross != 0.0f )
+				return cross < 0.0f;
+			
+			return segment1 < segment2;
+		}
+		
+	private:
+		const Segment* mSegments;
+		const b2Vec2* mRay;
+	};
+	
+	typedef std::set<int, NearerAlongRay, QueryAllocator<int> > ActiveSet;
+	
+	// queues the crossing of two neighbours in the active set, if it's still ahead of the ray and swaps them
+	void AddCrossing( const Segment* segments, int nearer, int farther, float32 angle, QueryArray<Crossing>* crossings )
+	{
+		Crossing crossing;
+		
+		if( !IntersectSegments(segments[nearer], segments[farther], &crossing.point) )
+			return;
+		
+		// meeting without passing through each other, e.g. at an end they share
+		if( b2Cross(segments[farther].b - segments[farther].a, segments[nearer].b - segments[nearer].a) >= 0.0f )
+			return;
+		
+		// far behind the ray is where a segment that wraps past -pi crosses on the next lap, which the sweep
+		// doesn't reach
+		crossing.angle = atan2f(crossing.point.y, crossing.point.x);
+		
+		if( crossing.angle < angle - kCrossingAngleTolerance )
+			return;
+		
+		crossing.angle = b2Max(crossing.angle, angle);
+		crossing.nearer = nearer;
+		crossing.farther = farther;
+		
+		crossings->Push(crossing);
+		std::push_heap(crossings->GetData(), crossings->GetData() + crossings->GetCount(), CrossingLater());
+	}
+	
+	// collects the edges that can block the view from the origin, relative to the origin
+	class SegmentCollector
+	{
+	public:
+		SegmentCollector( const b2Vec2& origin, float32 radius, QueryArray<Segment>* segments )
+		: mOrigin(origin)
+		, mRadius(radius)
+		, mSegments(segments)
+		{
+		}
+		
+		// an edge that blocks from both sides
+		void AddEdge( const b2Vec2& v1, const b2Vec2& v2 )
+		{
+			Segment segment;
+			segment.a = v1 - mOrigin;
+			segment.b = v2 - mOrigin;
+			
+			// seen edge on, it covers no angle
+			float32 cross = b2Cross(segment.a, segment.b);
+			
+			if( cross == 0.0f )
+				return;
+			
+			if( cross < 0.0f )
+				b2Swap(segment.a, segment.b);
+			
+			// skip edges entirely out of range
+			b2Vec2 e = segment.b - segment.a;
+			float32 t = b2Clamp(-b2Dot(segment.a, e) / b2Dot(e, e), 0.0f, 1.0f);
+			
+			if( (segment.a + t * e).LengthSquared() > mRadius * mRadius )
+				return;
+			
+			mSegments->Push(segment);
+		}
+		
+		// an edge of a counter-clockwise outline.  only an edge facing the origin can be the first
+		// thing a ray hits, and none of them do if the origin is inside the outline.
+		void AddOutlineEdge( const b2Vec2& v1, const b2Vec2& v2 )
+		{
+			if( b2Cross(v2 - v1, mOrigin - v1) < 0.0f )
+				AddEdge(v1, v2);
+		}
+		
+		void AddFixture( b2Fixture* fixture, int32 childIndex, float32 circleTolerance )
+		{
+			const b2Shape* shape = fixture->GetShape();
+			const b2Transform& xform = fixture->GetBody()->GetTransform();
+			
+			switch( shape->m_type )
+			{
+				case b2Shape::e_circle:
+				{
+					const b2CircleShape* circle = (const b2CircleShape*)shape;
+					b2Vec2 center = b2Mul(xform, circle->m_p);
+					float32 radius = circle->m_radius;
+					
+					int count = GetCircleSegmentCount(radius, circleTolerance);
+					float32 step = 2.0f * b2_pi / (float32)count;
+					
+					b2Vec2 previous = center + b2Vec2(radius, 0.0f);
+					
+					for( int vertexIdx = 1; vertexIdx <= count; ++vertexIdx )
+					{
+						float32 angle = step * (float32)vertexIdx;
+						b2Vec2 vertex = center + radius * b2Vec2(cosf(angle), sinf(angle));
+						AddOutlineEdge(previous, vertex);
+						previous = vertex;
+					}
+					
+					break;
+				}
+					
+				case b2Shape::e_polygon:
+				{
+					const b2PolygonShape* polygon = (const b2PolygonShape*)shape;
+					b2Vec2 previous = b2Mul(xform, polygon->m_vertices[polygon->m_vertexCount - 1]);
+					
+					for( int vertexIdx = 0; vertexIdx < polygon->m_vertexCount; ++vertexIdx )
+					{
+						b2Vec2 vertex = b2Mul(xform, polygon->m_vertices[vertexIdx]);
+						AddOutlineEdge(previous, vertex);
+						previous = vertex;
+					}
+					
+					break;
+				}
+					
+				case b2Shape::e_edge:
+				{
+					const b2EdgeShape* edge = (const b2EdgeShape*)shape;
+					AddEdge(b2Mul(xform, edge->m_vertex1), b2Mul(xform, edge->m_vertex2));
+					break;
+				}
+					
+				case b2Shape::e_chain:
+				{
+					const b2ChainShape* chain = (const b2ChainShape*)shape;
+					
+					b2EdgeShape edge;
+					chain->GetChildEdge(&edge, childIndex);
+					AddEdge(b2Mul(xform, edge.m_vertex1), b2Mul(xform, edge.m_vertex2));
+					break;
+				}
+					
+				default:
+					break;
+			}
+		}
+		
+		b2Vec2 mOrigin;
+		float32 mRadius;
+		QueryArray<Segment>* mSegments;
+	};
+	
+	// broadphase callback handing the accepted fixture proxies to a SegmentCollector
+	class VisibilityQuery
+	{
+	public:
+		VisibilityQuery( const b2BroadPhase* broadPhase, const QueryFilter& filter, float32 circleTolerance, SegmentCollector* collector )
+		: mBroadPhase(broadPhase)
+		, mFilter(filter)
+		, mCircleTolerance(circleTolerance)
+		, mCollector(collector)
+		{
+		}
+		
+		bool QueryCallback( int32 proxyId )
+		{
+			b2FixtureProxy* proxy = (b2FixtureProxy*)mBroadPhase->GetUserData(proxyId);
+			
+			if( mFilter.Accept(proxy->fixture) )
+				mCollector->AddFixture(proxy->fixture, proxy->childIndex, mCircleTolerance);
+			
+			return true;
+		}
+		
+		const b2BroadPhase* mBroadPhase;
+		QueryFilterPolicy mFilter;
+		float32 mCircleTolerance;
+		SegmentCollector* mCollector;
+	};
+	
+	// the same point comes out of both intervals around an event that doesn't change the nearest segment
+	const float32 kWeldDistanceSquared = 0.01f * b2_linearSlop * b2_linearSlop;
+	
+	void AddVertex( QueryArray<b2Vec2>* vertices, const b2Vec2& vertex )
+	{
+		if( vertices->GetCount() > 0 && b2DistanceSquared((*vertices)[vertices->GetCount() - 1], vertex) <= kWeldDistanceSquared )
+			return;
+		
+		vertices->Push(vertex);
+	}
+}
+
+int ComputeVisibilityPolygon( b2World* world, const b2Vec2& origin, float32 radius, const QueryFilter& filter, QueryContext* context, b2Vec2** vertices, float32 circleTolerance )
+{
+	assert(radius > 0.0f && circleTolerance > 0.0f);
+	
+	QueryArray<Segment> segments(context);
+	SegmentCollector collector(origin, radius, &segments);
+	
+	// everything that can block the view, from one broadphase query
+	b2AABB aabb;
+	aabb.lowerBound = origin - b2Vec2(radius, radius);
+	aabb.upperBound = origin + b2Vec2(radius, radius);
+	
+	const b2BroadPhase* broadPhase = &world->GetContactManager().m_broadPhase;
+	VisibilityQuery query(broadPhase, filter, circleTolerance, &collector);
+	broadPhase->Query(&query, aabb);
+	
+	// the view ends at the radius, which also makes sure every ray hits something
+	int boundaryCount = GetCircleSegmentCount(radius, circleTolerance);
+	float32 boundaryStep = 2.0f * b2_pi / (float32)boundaryCount;
+	
+	for( int vertexIdx = 0; vertexIdx < boundaryCount; ++vertexIdx )
+	{
+		float32 angle1 = boundaryStep * (float32)vertexIdx;
+		float32 angle2 = boundaryStep * (float32)(vertexIdx + 1);
+		collector.AddEdge(origin + radius * b2Vec2(cosf(angle1), sinf(angle1)), origin + radius * b2Vec2(cosf(angle2), sinf(angle2)));
+	}
+	
+	// the sweep starts pointing along -x, where atan2 wraps, with the segments that cross it already active
+	QueryArray<Event> events(context, 2 * segments.GetCount());
+	
+	b2Vec2 ray(-1.0f, 0.0f);
+	ActiveSet active(NearerAlongRay(segments.GetData(), &ray), QueryAllocator<int>(context));
+	
+	// where each segment is in the active set, or active.end() when it isn't in it
+	QueryArray<ActiveSet::iterator> positions(context, segments.GetCount());
+	
+	for( int segmentIdx = 0; segmentIdx < segments.GetCount(); ++segmentIdx )
+		positions.Push(active.end());
+	
+	for( int segmentIdx = 0; segmentIdx < segments.GetCount(); ++segmentIdx )
+	{
+		const Segment& segment = segments[segmentIdx];
+		
+		Event start;
+		start.angle = atan2f(segment.a.y, segment.a.x);
+		start.segment = segmentIdx;
+		start.start = true;
+		
+		Event end;
+		end.angle = atan2f(segment.b.y, segment.b.x);
+		end.segment = segmentIdx;
+		end.start = false;
+		
+		// too narrow to see past rounding
+		if( start.angle == end.angle )
+			continue;
+		
+		events.Push(start);
+		events.Push(end);
+		
+		if( start.angle > end.angle )
+			positions[segmentIdx] = active.insert(segmentIdx).first;
+	}
+	
+	std::sort(events.GetData(), events.GetData() + events.GetCount());
+	
+	// segments cross each other wherever fixtures overlap, and each crossing of two neighbours in the
+	// active set is an event of its own, where they swap places
+	QueryArray<Crossing> crossings(context);
+	
+	for( ActiveSet::iterator it = active.begin(); it != active.end() && std::next(it) != active.end(); ++it )
+		AddCrossing(segments.GetData(), *it, *std::next(it), -b2_pi, &crossings);
+	
+	// each event can change the nearest segment, which adds a vertex on the old one and one on the new one
+	QueryArray<b2Vec2> polygon(context, 2 * events.GetCount() + 1);
+	
+	int eventIdx = 0;
+	
+	while( eventIdx < events.GetCount() || crossings.GetCount() > 0 )
+	{
+		int front = active.empty() ? -1 : *active.begin();
+		
+		// a crossing at the same angle as an end comes first, so the set is in order for the end
+		bool crossing = crossings.GetCount() > 0 && (eventIdx == events.GetCount() || crossings[0].angle <= events[eventIdx].angle);
+		float32 angle;
+		
+		if( crossing )
+		{
+			std::pop_heap(crossings.GetData(), crossings.GetData() + crossings.GetCount(), CrossingLater());
+			Crossing next = crossings[crossings.GetCount() - 1];
+			crossings.Truncate(crossings.GetCount() - 1);
+			
+			angle = next.angle;
+			
+			// the pair may have stopped being neighbours, or already swapped, since it was queued
+			ActiveSet::iterator nearer = positions[next.nearer];
+			ActiveSet::iterator farther = positions[next.farther];
+			
+			if( nearer == active.end() || farther == active.end() || std::next(nearer) != farther )
+				continue;
+			
+			// swapped where they sit rather than reinserted, so rounding at the crossing can't put them back
+			// the way they were.  the rest of the set is untouched, so it stays in order.
+			const_cast<int&>(*nearer) = next.farther;
+			const_cast<int&>(*farther) = next.nearer;
+			positions[next.farther] = nearer;
+			positions[next.nearer] = farther;
+			
+			if( nearer != active.begin() )
+				AddCrossing(segments.GetData(), *std::prev(nearer), next.farther, angle, &crossings);
+			
+			if( std::next(farther) != active.end() )
+				AddCrossing(segments.GetData(), next.nearer, *std::next(farther), angle, &crossings);
+		}
+		else
+		{
+			angle = events[eventIdx].angle;
+			
+			for( ; eventIdx < events.GetCount() && events[eventIdx].angle == angle; ++eventIdx )
+			{
+				const Event& event = events[eventIdx];
+				
+				if( event.start )
+				{
+					// compared where it starts, and by its direction against any it starts at the same point as
+					ray = segments[event.segment].a;
+					ray.Normalize();
+					
+					ActiveSet::iterator position = active.insert(event.segment).first;
+					positions[event.segment] = position;
+					
+					if( position != active.begin() )
+						AddCrossing(segments.GetData(), *std::prev(position), event.segment, angle, &crossings);
+					
+					if( std::next(position) != active.end() )
+						AddCrossing(segments.GetData(), event.segment, *std::next(position), angle, &crossings);
+				}
+				else if( positions[event.segment] != active.end() )
+				{
+					// the segments either side become neighbours
+					ActiveSet::iterator position = positions[event.segment];
+					
+					if( position != active.begin() && std::next(position) != active.end() )
+						AddCrossing(segments.GetData(), *std::prev(position), *std::next(position), angle, &crossings);
+					
+					active.erase(position);
+					positions[event.segment] = active.end();
+				}
+			}
+		}
+		
+		int newFront = active.empty() ? -1 : *active.begin();
+		
+		if( newFront == front )
+			continue;
+		
+		b2Vec2 direction(cosf(angle), sinf(angle));
+		
+		if( front >= 0 )
+			AddVertex(&polygon, origin + IntersectSegment(segments[front], direction) * direction);
+		
+		if( newFront >= 0 )
+			AddVertex(&polygon, origin + IntersectSegment(segments[newFront], direction) * direction);
+	}
+	
+	// the last interval ends where the first one starts
+	if( polygon.GetCount() > 1 && b2DistanceSquared(polygon[0], polygon[polygon.GetCount() - 1]) <= kWeldDistanceSquared )
+		polygon.Truncate(polygon.GetCount() - 1);
+	
+	*vertices = polygon.GetData();
+	return polygon.GetCount();
+}
@@ -0,0 +1,48 @@
+//
+//	VisibilityPolygon.h
+//
+//	Created by Aaron Pendley on 4/9/10.
+//	Copyright 2010 Aaron Pendley.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+// 
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+// 
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+
+#ifndef _VISIBILITYPOLYGON_H_INCLUDED_
+#define _VISIBILITYPOLYGON_H_INCLUDED_
+
+#include "CollisionUtil.h"
+
+
+// computes the region visible from origin out to radius, for vision cones and 2D lighting, in place of
+// a fan of CollideRayClosest calls.  the edges of the polygon, edge and chain fixtures found through one
+// broadphase query, along with circles cut into segments, are swept around the origin once, so the
+// result is exact for straight edges rather than sampled.  the edges under the sweeping ray are kept
+// ordered by distance along it, and wherever overlapping fixtures' edges cross the two swap places, so
+// a sweep over n edges that cross k times is O((n + k) log n).
+//
+// circleTolerance is how far the segments approximating a circle fixture, and the radius itself, may stray
+// from the true circle.  fixtures the origin is inside of don't block anything, same as a ray starting
+// inside a fixture.  polygon skins (the shape radius of polygons and edges) are ignored.
+//
+// *vertices gets the polygon counter-clockwise around origin, in world coordinates, pointing into the context
+// and valid until the context is reset.  returns the vertex count.
+int ComputeVisibilityPolygon( b2World* world, const b2Vec2& origin, float32 radius, const QueryFilter& filter, QueryContext* context, b2Vec2** vertices, float32 circleTolerance = 0.05f );
+
+#endif